@@ -7,7 +7,7 @@
 *     - EPSILON - is used for comparing floating point values
 *     - PI - is just the Pi number stolen from the Internet (just kidding... I calculated it myself)
 * - Functions
-*     - utils::equal - checks if difference between 2 values is less than or equals to the EPSILON constant
+*     - utils::equal - checks if difference between 2 values, or between each component of 2 vectors, is less than or equals to the EPSILON constant
 *                      (values must have *-* and *<=* operators implemented)
 * - Structs
 *     - vec2d<T> - a struct for storing *x* and *y* components of type T
@@ -34,6 +34,224 @@
 *             - vec2d::cart - treats *x* as a radius and *y* as an angle and returns a vector where *x* and *y* are points in the cartesian space
 *             - vec2d::polar - returns a vector where "x" component is a length of the *this* vector and "y" is the angle between (length, 0) and (x, y) points
 *             - vec2d::str - returns *x* and *y* components as a string: "(x, y)"
+*         - vec2d::angle, vec2d::norm, vec2d::cart and vec2d::polar take a math policy as a template argument,
+*           it defaults to math_policy<T>::type which is exact_math unless math_policy is specialized for T
+*     - polygon<T> - a struct for storing a closed ring of vertices
+*         - Methods:
+*             - polygon::area - calculates an area of the polygon
+*             - polygon::signed_area - calculates an area of the polygon, it's positive for counter-clockwise vertices
+*             - polygon::perimeter - calculates a perimeter of the polygon
+*             - polygon::side - returns an edge that goes from the *i*-th vertex to the next one
+*     - capsule<T> - a struct for storing a segment from *start* to *end* swept by a circle of *radius*
+*         - Methods:
+*             - capsule::area - calculates an area of the capsule
+*             - capsule::perimeter - calculates a perimeter of the capsule
+*             - capsule::axis - returns the segment from *start* to *end*
+*     - triangle<T> - a struct for storing vertices *a*, *b* and *c* of a triangle
+*         - Methods:
+*             - triangle::area - calculates an area of the triangle
+*             - triangle::signed_area - calculates an area of the triangle, it's positive for counter-clockwise vertices
+*             - triangle::perimeter - calculates a perimeter of the triangle
+*             - triangle::degenerate - checks if the vertices are collinear so the triangle has no inside
+*             - triangle::side - returns an edge that goes from the *i*-th vertex to the next one
+*             - triangle::barycentric - calculates barycentric weights of a point
+*     - quadratic_bezier<T>, cubic_bezier<T> - structs for storing control points of Bezier curves
+*     - arc<T> - a struct for storing a circular arc that starts at *start_angle* and turns by *sweep* radians
+*         - Methods:
+*             - point - returns a point of the curve at parameter *t* from 0 to 1
+*             - bounds - returns the smallest rectangle that contains the curve
+*             - split - splits the curve at parameter *t* into 2 curves of the same type
+*             - segments - returns number of segments that keep a polyline within *tolerance* of the curve
+*             - flatten - calls a function for each point of the polyline, points are stepped with forward differences
+*     - affine<T> - a 2x3 matrix that maps (x, y) to (a * x + c * y + tx, b * x + d * y + ty)
+*         - Methods:
+*             - affine::translation, affine::rotation, affine::scale, affine::shear - create basic transforms
+*             - affine::operator* - composes transforms, (m1 * m2) applies m2 first
+*             - affine::apply - transforms a point
+*             - affine::apply_vector - transforms a direction, translation is ignored
+*             - affine::determinant - returns the determinant of the linear part
+*             - affine::invert - calculates the inverse transform
+*             - affine::decompose - splits the transform into translation, rotation, shear and scale
+*     - triangulator<T> - triangulates polygons with holes in O(n log n) through monotone decomposition,
+*                         keeps its scratch buffers between calls so reusing it doesn't allocate
+* - Triangulation
+*     - triangulate - writes 3 vertex indices per triangle into *indices*, indices of the holes
+*                     go after the outer vertices in the same order as the holes are passed
+*     - triangulate (batch) - triangulates each polygon of the span on all cores
+* - Clipping
+*     - clipper<T> - performs boolean operations on polygons and clips polygons by rectangles,
+*                    keeps its scratch buffers between calls so reusing it doesn't allocate
+*     - clip - performs CLIP_INTERSECTION, CLIP_UNION, CLIP_DIFFERENCE or CLIP_XOR on 2 polygons,
+*              candidate pairs of edges are found by sorting edges along x axis and keeping a list of active edges,
+*              then each piece between intersections is classified by a crossing test against the other ring,
+*              so the cost is O(n log n + p + n * k) for p candidate pairs and k intersections,
+*              false is returned with an empty result when pieces don't chain into closed rings (self-intersecting input)
+*     - clip (rect) - clips a polygon by a rectangle with Sutherland-Hodgman algorithm
+*     - clip (line) - clips a line by a rectangle with Liang-Barsky algorithm and returns parameters
+*                     and sides of the entry and exit points in one pass
+*     - clip (lines) - clips each line of the span by a rectangle on all cores
+* - Rasterization
+*     - coverage_mask - a grid of 8-bit coverage values
+*     - bit_mask - a grid of bits, each row starts with a new 64-bit word
+*     - rasterizer - fills masks with circles, rectangles, lines and polygons row by row using spans,
+*                    each span is a single std::fill (whole 64-bit words in a bit_mask), there is no hand-written SIMD,
+*                    antialiased coverage is accumulated from 4 sub-rows per row
+*     - rasterize - draws a shape into a mask
+*     - rasterize (batch) - splits the mask into tiles of rows and draws all shapes into them on all cores,
+*                           a thread takes at least a few thousand rows of shapes so small masks are drawn on the caller
+* - Distance fields
+*     - signed_distance - returns exact signed distance from a point to a circle, a rectangle, a capsule around a line or a polygon
+*     - distance_field - a grid of distances that can be sampled in O(1)
+*     - build_distance_field - evaluates signed distances of shapes on all cores or
+*                              transforms a bit mask with two-pass Euclidean distance transform
+* - Instrumentation (only when DEF_GEOMETRY2D_INSTRUMENT is defined, otherwise the probes expand to nothing)
+*     - instrument::collect - sums calls, hits, early-outs and cycles of each contains/intersects overload over all threads,
+*                             a call is counted once by the overload that was called, overloads it forwards to
+*                             or calls internally aren't counted
+*     - instrument::reset - zeroes all counters
+*     - instrument::dump_text, instrument::dump_json - formats collected counters
+* - Tracing (only when DEF_GEOMETRY2D_TRACE is defined, otherwise the scopes expand to nothing)
+*     - trace::drain - moves events that batch operations buffered in per-thread rings into a vector
+*     - trace::to_chrome_json - formats events as Chrome trace JSON (also readable by Perfetto)
+* - Caching
+*     - pair_cache<T> - stores results of pair tests keyed by user ids and shape versions,
+*                       only recomputes pairs whose shapes changed and reports CONTACT_BEGIN,
+*                       CONTACT_PERSIST and CONTACT_END events
+*     - shape_store<T> - owns circles, rectangles and lines by handle, tracks shapes that were added, updated or removed
+*                        since the last commit and finds those that overlap an area now or did at the last commit
+*                        through a packed_rtree over the changed shapes,
+*                        so per-tick work is proportional to the number of moving shapes
+* - Memory
+*     - frame_arena - std::pmr::memory_resource that bumps a pointer over a fixed block and is reset in O(1),
+*                     intersects, triangulate and offset accept output vectors with any allocator (including std::pmr ones),
+*                     triangulator, clipper, offsetter and rasterizer keep their scratch buffers in a memory resource,
+*                     single-shape clip and rasterize take that resource as the last argument
+*                     while triangulate and offset take it from the output's allocator
+*                   - not covered: polygon<T> stores its vertices in std::vector, so vertices of output polygons
+*                     (clip, offset, minkowski_sum, voronoi) and shard_service replies use the default allocator,
+*                     batch functions that run on all cores use the default resource in each worker
+*                     since a frame_arena is not thread-safe
+* - Contacts
+*     - contact_manifold - a normal and up to 2 contact points with penetration depths and feature ids
+*     - contact_buffer - stores manifolds in structure-of-arrays layout for solvers
+*     - collide - builds a manifold of circles, rectangles, lines and convex polygons,
+*                 polygon pairs use separating axes and clipping of the incident edge
+* - Physics (translation only)
+*     - rigid_body<T> - a translating circle, rectangle or convex polygon with velocity, inverse mass, friction and restitution,
+*                       there is no orientation, angular velocity or inertia, so off-center contacts and friction never spin bodies
+*     - physics_world<T> - integrates bodies, finds pairs with sort-and-sweep, builds manifolds on all cores
+*                          and solves contacts with sequential impulses warm started from the previous step,
+*                          penetration is removed by moving bodies apart in separate position iterations
+*                          that don't change velocities (split impulses), so stacks and piles come to rest,
+*                          contacts are split into colors that share no dynamic body so each color is solved on all cores
+* - Point location
+*     - prepared_polygon<T> - classifies cells of a grid over a polygon as inside, outside or boundary
+*                             so contains is O(1) for most points and only tests a few edges near the boundary
+*     - contains (batch) - tests a span of points against a prepared polygon on all cores
+* - Delaunay
+*     - delaunay<T> - Delaunay triangulation of a point set stored as triangle and half-edge arrays,
+*                     points are inserted by sweeping a convex hull and illegal edges are flipped,
+*                     also finds the nearest point by walking the triangulation
+*     - voronoi - builds Voronoi cells of points from circumcenters of the Delaunay triangles on all cores
+* - Simplification
+*     - simplifier<T> - simplifies polylines with iterative Douglas-Peucker or heap-based Visvalingam-Whyatt,
+*                       keeps its scratch buffers between calls so reusing it doesn't allocate
+*     - stream_simplifier<T> - simplifies a stream of points with bounded memory
+*     - simplify - writes kept points of a polyline
+*     - simplify (batch) - simplifies each polyline of the span on all cores
+* - Offsetting
+*     - offsetter<T> - inflates or deflates polygons with miter, round or bevel joins and removes self-intersections of the result,
+*                      keeps its scratch buffers between calls so reusing it doesn't allocate
+*     - offset - offsets a polygon
+*     - offset (batch) - offsets each polygon of the span on all cores
+*     - minkowski_sum - adds a convex polygon, a rectangle or a circle to a convex polygon in linear time
+*     - minkowski_sum (batch) - adds the same shape to each polygon of the span on all cores
+* - Capsules
+*     - closest_points - finds parameters of the closest points of 2 segments and the squared distance between them
+*     - intersects - checks if a capsule overlaps a circle, a rectangle, a line or another capsule in closed form
+*     - distance - returns distance between a capsule and a circle, a rectangle, a line or another capsule, zero if they overlap
+*     - capsule_buffer<T> - stores capsules in structure-of-arrays layout
+*     - intersects (batch), distance (batch) - test each capsule of a buffer against one shape on all cores
+* - Triangles
+*     - contains - checks if a triangle contains a point with edge functions, either vertex order works
+*     - intersects - checks if a triangle overlaps a rectangle, a circle or a line, degenerate triangles intersect nothing
+*     - triangle_buffer<T> - stores triangles in structure-of-arrays layout
+*     - contains (batch) - tests many points against one triangle or one point against many triangles on all cores,
+*                          loops are branchless so they vectorize
+* - Curves
+*     - flatten - writes points or lines of a polyline that approximates a curve within tolerance
+*     - flatten (batch) - flattens each curve of the span on all cores
+*     - intersects - finds points where a curve crosses a line, a rectangle or another curve by splitting both in halves
+*                    until their bounds stop overlapping or both are within tolerance of their chords,
+*                    one template takes any pair of a curve and a curve, a line or a rectangle (utils::curve_pair),
+*                    crossings at ends of pieces snap to the ends so they are found once and close crossings stay apart,
+*                    *complete* receives false if the curves share a stretch within tolerance or the search stopped
+*                    after utils::CURVE_STEPS pairs of pieces, the points found so far are still returned
+* - Transforms
+*     - transform - applies an affine transform to points, circles, rectangles or lines, loops are branchless so they vectorize
+*                   and spans longer than a threshold are split over all cores
+* - Spatial keys
+*     - key_grid - quantizes points to a 2^bits x 2^bits grid over bounds and returns their Morton or Hilbert keys
+*     - key_sorter - stable parallel LSD radix sort of 64-bit keys that skips digits shared by all keys, each chunk counts digits
+*                    into its own cache line aligned histogram, inputs below 2 * PARALLEL_THRESHOLD keys are sorted on the calling thread
+*     - spatial_keys - computes a key of each shape on all cores, circles use their centers, rectangles and lines their middles
+*     - spatial_sort - reorders shapes along the Morton or Hilbert curve so shapes that are close in space are close in memory
+*     - packed_rtree - static R-tree built bottom-up from boxes sorted along the Hilbert curve,
+*                      answers overlap queries and visits boxes from the nearest one in O(log n) per reported box
+* - Math policies
+*     - exact_math - calls std::sqrt, std::sin, std::cos, std::atan2 and std::acos
+*     - fast_math - branchless approximations that vectorize, errors are measured against std functions in double:
+*         - rsqrt, sqrt - magic constant refined by 3 Newton steps, relative error below 2e-7 for float and 5e-11 for double
+*         - sin, cos - reduction to [-pi/4, pi/4] in double and minimax polynomials, absolute error below 1e-7 for float
+*                      and 3e-9 for double while |x| < 1e5, the error of the reduction grows with |x|
+*         - atan2 - minimax polynomial of degree 15 on [0, 1], absolute error below 4e-7 for float and 1e-7 for double,
+*                   quadrants are picked by sign bits so signed zeros give the same result as std::atan2
+*         - acos - atan2(sqrt(1 - x * x), x), absolute error below 1e-6 for float and 1e-7 for double,
+*                  inputs are clamped to [-1, 1] instead of producing NaN
+*     - math_policy<T> - picks the default policy of vec2d<T>, specialize it to make a type fast everywhere
+*     - norm, polar, cart (batch) - apply vec2d methods to each vector of the span on all cores,
+*                                   the policy defaults to math_policy<T>::type as it does for the methods
+*     - fast_math pays off only where the compiler vectorizes the loop, on 1M floats on one x86-64 core with GCC 12
+*       it is faster than exact_math by (norm, polar, cart):
+*         - -O2 - 0.6x, 2.1x, 0.8x, loops stay scalar, so the fast norm and cart are slower than the std functions
+*         - -O3 - 1.3x, 10x, 4.2x with SSE2 only
+*         - -O3 -mavx2 -mfma - 2.8x, 24x, 8.4x
+*         - -O3 -march=native (AVX-512) - 2.8x, 44x, 16x
+* - Sharding (only on Linux when DEF_GEOMETRY2D_SHARDING is defined, so other users don't get POSIX headers)
+*     - shard_service<T> - splits the world into tiles and forks a worker process per tile that keeps shapes of the tile
+*                          sorted along the Hilbert curve with bounds of each block of shapes in a packed_rtree,
+*                          point, rectangle and k nearest queries are sent to workers in batches over Unix domain sockets
+*                          and their replies are merged by the calling process,
+*                          if a worker fails all workers are shut down and later queries return false until start is called again
+* - Coroutines (only when DEF_GEOMETRY2D_COROUTINES is defined, it also defines DEF_GEOMETRY2D_THREADS)
+*     - async_task<R> - awaitable that runs a move-only job on the thread pool of utils::parallel_for when awaited,
+*                       the job may use utils::parallel_for, the awaiting coroutine is resumed on the pool thread
+*                       or handed to a scheduler such as an event loop, no thread is started per await
+*     - async_stream<V> - values produced by jobs on the same pool and consumed one by one with *co_await stream.next()*,
+*                         a job parks itself while the stream is full and is resubmitted once the consumer takes a value,
+*                         so producers never hold pool threads waiting, they stop when the stream is destroyed,
+*                         the consumer is resumed by the job that pushed the value (or handed to the scheduler from it),
+*                         exceptions of producers end the stream and are rethrown by next() after the values pushed before
+*     - run_async - wraps any call, for example a batch function, into an async_task
+*     - intersections_async - streams intersections of each pair of shapes from 2 spans as they are found
+*     - shard_service::query_async, shard_service::nearest_async - awaitable versions of shard_service queries
+*                                                                  (only when DEF_GEOMETRY2D_SHARDING is defined as well)
+* - Threads (only when DEF_GEOMETRY2D_THREADS is defined, otherwise functions described as running on all cores
+*            run on the calling thread and the header doesn't include <thread>, <mutex> or <atomic>)
+*     - utils::thread_pool - persistent workers started on first use, parallel_for runs its chunks on them
+*     - utils::unique_function - move-only callable that stores jobs of the pool
+* - Utils
+*     - utils::orient2d, utils::incircle - orientation and in-circle predicates whose signs are exact,
+*                                          a fast floating point filter falls back to utils::expansion arithmetic
+*     - utils::parallel_for - splits [0, count) into contiguous chunks and runs *func(begin, end)* on each chunk,
+*                             chunks are taken by the calling thread and by workers of the thread pool,
+*                             the first exception thrown by a chunk is rethrown after all chunks have finished
+*     - utils::concurrency - number of threads parallel_for splits work between
+*     - utils::sqrt, utils::abs, utils::sin, utils::cos, utils::atan2, utils::acos - call the standard library at run time and
+*                                                                             evaluate series and Newton steps in constant expressions,
+*                                                                             compile time results are within a few ulps of run time ones
+*     - utils::morton_encode, utils::morton_decode - interleave bits of cell coordinates, BMI2 instructions are used when available
+*     - utils::hilbert_encode, utils::hilbert_decode - map cell coordinates to a distance along the Hilbert curve and back
 ***/
 #pragma endregion
 
@@ -41,7 +259,63 @@
 #include <string>
 #include <cmath>
 #include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+// Coroutines run their jobs on the thread pool
+#if defined(DEF_GEOMETRY2D_COROUTINES) && !defined(DEF_GEOMETRY2D_THREADS)
+#define DEF_GEOMETRY2D_THREADS
+#endif
+
+#ifdef DEF_GEOMETRY2D_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifdef DEF_GEOMETRY2D_COROUTINES
+#include <coroutine>
+#include <functional>
+#include <optional>
+#endif
+
+#if defined(DEF_GEOMETRY2D_INSTRUMENT) || defined(DEF_GEOMETRY2D_TRACE)
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#endif
+
+#ifdef DEF_GEOMETRY2D_INSTRUMENT
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#if defined(DEF_GEOMETRY2D_SHARDING) && defined(__linux__)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #ifndef DGE_IGNORE_VEC2D
 #define DGE_IGNORE_VEC2D
@@ -56,8 +330,442 @@ namespace def
 	{
 		template <class T1, class T2>
 		constexpr auto equal(T1 lhs, T2 rhs);
+
+		// Splits [0, count) into chunks of at least grain items and calls func(begin, end) for each of them,
+		// the calling thread runs chunks too, the first exception thrown by a chunk is rethrown once all chunks have finished
+		template <class F>
+		void parallel_for(size_t count, F&& func, size_t grain = 1);
+
+		// Number of threads parallel_for splits work between, 1 unless DEF_GEOMETRY2D_THREADS is defined
+		size_t concurrency();
+
+#ifdef DEF_GEOMETRY2D_THREADS
+		// Callable that can own move-only captures, unlike std::function it can't be copied
+		template <class R>
+		struct unique_function
+		{
+			unique_function() = default;
+
+			template <class F>
+			unique_function(F func);
+
+			R operator()();
+			explicit operator bool() const;
+
+			struct callable
+			{
+				virtual ~callable() = default;
+				virtual R call() = 0;
+			};
+
+			template <class F>
+			struct holder : callable
+			{
+				explicit holder(F f);
+				R call() override;
+
+				F func;
+			};
+
+			std::unique_ptr<callable> impl;
+		};
+
+		// Persistent worker threads that run jobs in the order they were submitted, jobs must not throw
+		struct thread_pool
+		{
+			explicit thread_pool(size_t threads);
+			~thread_pool();
+
+			thread_pool(const thread_pool&) = delete;
+			thread_pool& operator=(const thread_pool&) = delete;
+
+			void submit(unique_function<void> job);
+			size_t size() const;
+
+			// The pool of parallel_for, async tasks and streams, it is started on first use with a worker less than the hardware has
+			// (at least one) since the thread that calls parallel_for runs chunks as well
+			static thread_pool& shared();
+
+			void work();
+
+			std::mutex lock;
+			std::condition_variable wake;
+			std::deque<unique_function<void>> jobs;
+			std::vector<std::thread> workers;
+			bool stopping = false;
+		};
+#endif
+
+		// Versions of std functions that also work in constant expressions, the result types follow the std overloads
+		template <class F>
+		constexpr auto sqrt(F x);
+
+		template <class F>
+		constexpr auto abs(F x);
+
+		template <class F>
+		constexpr auto sin(F x);
+
+		template <class F>
+		constexpr auto cos(F x);
+
+		template <class F>
+		constexpr auto atan2(F y, F x);
+
+		template <class F>
+		constexpr auto acos(F x);
+
+		// Sine or cosine of x computed with Taylor series after reducing x to [-pi/4, pi/4], the reduction is exact
+		// while |x| < 2^20 * pi / 2 and loses precision above, past 2^51 * pi / 2 the result is only bounded
+		constexpr double sin_cos_series(double x, uint32_t offset);
+
+		// Arctangent of t from 0 to 1, the argument is halved twice before the Taylor series
+		constexpr double atan_series(double t);
+
+		// Returns the resource of a polymorphic allocator and the default resource for any other allocator
+		template <class A>
+		std::pmr::memory_resource* resource_of(const A& alloc);
+
+		// Bits of x go to even bits of the key and bits of y go to odd bits
+		uint64_t morton_encode(uint32_t x, uint32_t y);
+		void morton_decode(uint64_t key, uint32_t& x, uint32_t& y);
+
+		// The curve of order bits starts at (0, 0) and ends at (2^bits - 1, 0), bits can be up to 32
+		uint64_t hilbert_encode(uint32_t x, uint32_t y, uint32_t bits);
+		void hilbert_decode(uint64_t key, uint32_t bits, uint32_t& x, uint32_t& y);
+
+		// Sum of non-overlapping terms sorted by magnitude that represents a value exactly,
+		// N is the most terms it can hold, each operation returns an expansion large enough for its result
+		// so predicates keep all terms on the stack
+		template <size_t N>
+		struct expansion
+		{
+			expansion() = default;
+			expansion(double value);
+
+			// Exact a * b
+			static expansion<2> product(double a, double b);
+
+			// Exact a - b
+			static expansion<2> difference(double a, double b);
+
+			template <size_t M>
+			expansion<N + M> operator+(const expansion<M>& e) const;
+
+			template <size_t M>
+			expansion<N + M> operator-(const expansion<M>& e) const;
+
+			// Each pair of terms adds a product and its round-off
+			template <size_t M>
+			expansion<2 * N * M> operator*(const expansion<M>& e) const;
+
+			expansion operator-() const;
+
+			// Adds b to the expansion without rounding, the expansion must have room for one more term
+			void grow(double b);
+
+			// Returns the most significant term, it has the sign of the exact value
+			double estimate() const;
+
+			double terms[N];
+			size_t count = 0;
+		};
+
+		// Returns a positive value if a, b and c go counter-clockwise, a negative one if they go clockwise
+		// and zero if they are collinear, the sign is exact because the result is recomputed exactly when rounding could flip it
+		double orient2d(double ax, double ay, double bx, double by, double cx, double cy);
+
+		// Returns a positive value if d lies inside the circle through counter-clockwise a, b and c,
+		// a negative one if it lies outside and zero if on the circle, the sign is exact
+		double incircle(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy);
+	}
+
+	// Calls functions of the standard library, in constant expressions they are evaluated by utils functions
+	struct exact_math
+	{
+		template <class F>
+		static constexpr auto sqrt(F x);
+
+		template <class F>
+		static constexpr auto rsqrt(F x);
+
+		template <class F>
+		static constexpr auto sin(F x);
+
+		template <class F>
+		static constexpr auto cos(F x);
+
+		template <class F>
+		static constexpr auto atan2(F y, F x);
+
+		template <class F>
+		static constexpr auto acos(F x);
+	};
+
+	// Approximations without branches or library calls so loops over them vectorize,
+	// floats are computed in float and everything else in double
+	struct fast_math
+	{
+		template <class F>
+		using real = std::conditional_t<std::is_same_v<F, float>, float, double>;
+
+		template <class F>
+		static constexpr real<F> sqrt(F x);
+
+		template <class F>
+		static constexpr real<F> rsqrt(F x);
+
+		template <class F>
+		static constexpr real<F> sin(F x);
+
+		template <class F>
+		static constexpr real<F> cos(F x);
+
+		template <class F>
+		static constexpr real<F> atan2(F y, F x);
+
+		template <class F>
+		static constexpr real<F> acos(F x);
+
+		// Sine and cosine of the angle reduced to [-pi/4, pi/4] in the given quadrant
+		template <class F>
+		static constexpr F sin_cos(F x, uint32_t offset);
+
+		// Returns magnitude with the sign bit of sign, so -0.0 is negative as it is for std::atan2,
+		// it only moves bits, so loops vectorize without blends even where there are no mask registers
+		template <class F>
+		static constexpr F copy_sign(F magnitude, F sign);
+
+		// Returns a if condition is true and b otherwise by masking bits, compilers keep floating point operations
+		// on one side of ?: out of vectorized loops unless -fno-trapping-math is given, masks don't have that problem
+		template <class F>
+		static constexpr F select(bool condition, F a, F b);
+	};
+
+	template <class T>
+	struct math_policy
+	{
+		using type = exact_math;
+	};
+
+	template <class T>
+	using math_policy_t = typename math_policy<T>::type;
+
+	// Bump allocator over a fixed block that frees everything at once, it is not thread-safe
+	struct frame_arena : std::pmr::memory_resource
+	{
+		// When the block runs out memory is taken from upstream, the null resource makes it throw std::bad_alloc instead
+		explicit frame_arena(size_t capacity, std::pmr::memory_resource* upstream = std::pmr::null_memory_resource());
+		frame_arena(void* buffer, size_t capacity, std::pmr::memory_resource* upstream = std::pmr::null_memory_resource());
+		~frame_arena();
+
+		frame_arena(const frame_arena&) = delete;
+		frame_arena& operator=(const frame_arena&) = delete;
+
+		// Makes the whole block available again, only blocks taken from upstream are released one by one
+		void reset();
+
+		size_t used() const;
+		size_t capacity() const;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+		struct overflow_block
+		{
+			overflow_block* next;
+			size_t bytes;
+			size_t alignment;
+		};
+
+		std::byte* block = nullptr;
+		size_t size = 0;
+		size_t offset = 0;
+		bool owns_block = false;
+
+		std::pmr::memory_resource* upstream = nullptr;
+		overflow_block* overflow = nullptr;
+	};
+
+#ifdef DEF_GEOMETRY2D_INSTRUMENT
+	namespace instrument
+	{
+		enum probe_id : uint16_t
+		{
+			PROBE_CONTAINS_POINT_POINT,
+			PROBE_CONTAINS_CIRCLE_POINT,
+			PROBE_CONTAINS_RECT_POINT,
+			PROBE_CONTAINS_RECT_RECT,
+			PROBE_CONTAINS_RECT_LINE,
+			PROBE_CONTAINS_RECT_CIRCLE,
+			PROBE_CONTAINS_LINE_LINE,
+			PROBE_CONTAINS_LINE_POINT,
+			PROBE_CONTAINS_CIRCLE_CIRCLE,
+			PROBE_CONTAINS_CIRCLE_LINE,
+			PROBE_CONTAINS_CIRCLE_RECT,
+			PROBE_INTERSECTS_POINT_POINT,
+			PROBE_INTERSECTS_POINT_LINE,
+			PROBE_INTERSECTS_POINT_RECT,
+			PROBE_INTERSECTS_POINT_CIRCLE,
+			PROBE_INTERSECTS_CIRCLE_POINT,
+			PROBE_INTERSECTS_RECT_POINT,
+			PROBE_INTERSECTS_RECT_RECT,
+			PROBE_INTERSECTS_RECT_CIRCLE,
+			PROBE_INTERSECTS_LINE_LINE,
+			PROBE_INTERSECTS_LINE_RECT,
+			PROBE_INTERSECTS_LINE_CIRCLE,
+			PROBE_INTERSECTS_RECT_LINE,
+			PROBE_INTERSECTS_LINE_POINT,
+			PROBE_INTERSECTS_CIRCLE_CIRCLE,
+			PROBE_INTERSECTS_CIRCLE_LINE,
+			PROBE_INTERSECTS_CIRCLE_RECT,
+			PROBE_CONTAINS_TRIANGLE_POINT,
+			PROBE_COUNT
+		};
+
+		struct counters
+		{
+			uint64_t calls = 0;
+			uint64_t hits = 0;
+			uint64_t early_outs = 0;
+			uint64_t cycles = 0;
+		};
+
+		// Each thread owns its counters so probes never contend, they are only summed when collected
+		struct thread_counters
+		{
+			std::atomic<uint64_t> values[PROBE_COUNT][4];
+		};
+
+		// Holds counters of a thread while it runs, on exit they are added to the retired totals and the block is reused
+		struct thread_lease
+		{
+			thread_lease();
+			~thread_lease();
+
+			thread_lease(const thread_lease&) = delete;
+			thread_lease& operator=(const thread_lease&) = delete;
+
+			thread_counters* counters = nullptr;
+		};
+
+		// Only the outermost probe of a thread counts, so a call is counted once by the overload the caller picked
+		// even when it forwards to another overload or runs other tests internally
+		struct probe
+		{
+			constexpr probe(probe_id id);
+			constexpr ~probe();
+
+			constexpr bool result(bool hit);
+			constexpr bool early_out(bool hit);
+
+			probe_id id;
+			bool hit = false;
+			bool early = false;
+			bool outer = false;
+			uint64_t start = 0;
+		};
+
+		// Returns the overload name, e.g. "intersects(circle, rect)"
+		const char* name(probe_id id);
+
+		// Returns a timestamp in cycles (or nanoseconds where there is no cycle counter)
+		uint64_t now();
+
+		thread_counters& local();
+
+		// Number of probes alive on the calling thread
+		uint32_t& depth();
+
+		// Sums counters of all threads, result[i] belongs to probe_id(i)
+		void collect(std::vector<counters>& result);
+
+		// Zeroes counters of all threads, counts of concurrent calls may be lost
+		void reset();
+
+		std::string dump_text();
+		std::string dump_json();
+	}
+
+#define DEF_GEOMETRY2D_PROBE(id) def::instrument::probe probe_(def::instrument::id)
+#define DEF_GEOMETRY2D_RESULT(x) probe_.result(x)
+#define DEF_GEOMETRY2D_EARLY_OUT(x) probe_.early_out(x)
+#else
+#define DEF_GEOMETRY2D_PROBE(id)
+#define DEF_GEOMETRY2D_RESULT(x) (x)
+#define DEF_GEOMETRY2D_EARLY_OUT(x) (x)
+#endif
+
+#ifdef DEF_GEOMETRY2D_TRACE
+	namespace trace
+	{
+		struct event
+		{
+			const char* name;
+			const char* category;
+			uint64_t begin, end;
+			uint32_t thread;
+		};
+
+		// Single producer ring, only the owning thread pushes and only drain pops
+		struct ring
+		{
+			static constexpr size_t CAPACITY = 4096;
+
+			event events[CAPACITY];
+
+			std::atomic<uint64_t> head{ 0 }, tail{ 0 };
+			std::atomic<uint64_t> dropped{ 0 };
+
+			uint32_t thread = 0;
+		};
+
+		// Holds the ring of a thread while it runs, on exit the ring and its thread id are handed to the next new thread,
+		// events that weren't drained yet stay in the ring
+		struct ring_lease
+		{
+			ring_lease();
+			~ring_lease();
+
+			ring_lease(const ring_lease&) = delete;
+			ring_lease& operator=(const ring_lease&) = delete;
+
+			ring* owned = nullptr;
+		};
+
+		struct scope
+		{
+			scope(const char* name, const char* category);
+			~scope();
+
+			const char* name;
+			const char* category;
+			uint64_t begin;
+		};
+
+		// Returns a timestamp in nanoseconds
+		uint64_t now();
+
+		ring& local();
+
+		// Moves buffered events of all threads into out, should be called away from the hot path
+		void drain(std::vector<event>& out);
+
+		// Returns the number of events that didn't fit into the rings
+		uint64_t dropped();
+
+		// Formats events as Chrome trace JSON that can be opened in chrome://tracing or Perfetto
+		std::string to_chrome_json(const std::vector<event>& events);
 	}
 
+#define DEF_GEOMETRY2D_TRACE_CONCAT_IMPL(a, b) a##b
+#define DEF_GEOMETRY2D_TRACE_CONCAT(a, b) DEF_GEOMETRY2D_TRACE_CONCAT_IMPL(a, b)
+#define DEF_GEOMETRY2D_TRACE_SCOPE(name, category) def::trace::scope DEF_GEOMETRY2D_TRACE_CONCAT(trace_scope_, __LINE__)(name, category)
+#else
+#define DEF_GEOMETRY2D_TRACE_SCOPE(name, category)
+#endif
+
 	template <class T>
 	struct vec2d
 	{
@@ -78,6 +786,7 @@ namespace def
 		constexpr auto dot(const vec2d& v) const;
 		constexpr auto cross(const vec2d& v) const;
 
+		template <class M = math_policy_t<T>>
 		constexpr auto angle(const vec2d& v) const;
 		constexpr auto length() const;
 
@@ -91,13 +800,18 @@ namespace def
 
 		constexpr void swap(vec2d& v);
 
+		template <class M = math_policy_t<T>>
 		constexpr vec2d norm() const;
 		constexpr vec2d abs() const;
 		constexpr vec2d perp() const;
 		constexpr vec2d floor() const;
 		constexpr vec2d ceil() const;
 		constexpr vec2d round() const;
+
+		template <class M = math_policy_t<T>>
 		constexpr vec2d cart() const;
+
+		template <class M = math_policy_t<T>>
 		constexpr vec2d polar() const;
 
 		std::string str() const;
@@ -269,977 +983,11685 @@ namespace def
 		static constexpr uint8_t SIDES = 4;
 	};
 
-	// point contains point
-	// rectangle contains point
-	// rectangle contains rectangle
-	// rectangle contains line
-	// rectangle contains circle
-	// line contains point
-	// line contains line
-	// circle contains point
-	// circle contains circle
-	// circle contains line
-	// circle contains rectangle
-	// point intersects point
-	// point intersects circle
-	// point intersects rectangle
-	// point intersects line
-	// rectangle intersects point
-	// rectangle intersects line
-	// rectangle intersects rectangle
-	// rectangle intersects circle
-	// line intersects point
-	// line intersects line
-	// line intersects rectangle
-	// line intersects circle
-	// circle intersects point
-	// circle intersects line
-	// circle intersects rectangle
-	// circle intersects circle
+	template <class T>
+	struct polygon
+	{
+		constexpr polygon() = default;
+		constexpr polygon(const std::vector<vec2d<T>>& vertices);
+		constexpr polygon(std::initializer_list<vec2d<T>> vertices);
 
-	// Checks if p1 and p2 have the same coordinates
-	template <class T1, class T2>
-	constexpr bool contains(const vec2d<T1>& p1, const vec2d<T2>& p2);
+		constexpr T area() const;
+		constexpr T signed_area() const;
+		constexpr T perimeter() const;
 
-	// Checks if r contains p
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const vec2d<T2>& p);
+		constexpr line<T> side(uint32_t i) const;
 
-	// Checks if r1 contains r2
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r1, const rect<T2>& r2);
+		std::vector<vec2d<T>> vertices;
+	};
 
-	// Checks if r contains l
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const line<T2>& l);
+	template <class T>
+	struct capsule
+	{
+		constexpr capsule() = default;
+		constexpr capsule(const vec2d<T>& start, const vec2d<T>& end, float radius);
 
-	// Checks if r contains с
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const circle<T2>& c);
+		constexpr T area() const;
+		constexpr T perimeter() const;
 
-	// Checks if l1 contains l2
-	template <class T1, class T2>
-	constexpr bool contains(const line<T1>& l1, const line<T2>& l2);
+		constexpr line<T> axis() const;
 
-	// Checks if l contains p
-	template <class T1, class T2>
-	constexpr bool contains(const line<T1>& l, const vec2d<T2>& p);
+		vec2d<T> start, end;
+		float radius = 0.0f;
+	};
 
-	// Checks if c contains p
-	template <class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const vec2d<T2>& p);
+	// Stores capsules column by column so batch tests stream over each component
+	template <class T>
+	struct capsule_buffer
+	{
+		void clear();
+		size_t size() const;
 
-	// Checks if c contains l
-	template <class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const line<T2>& l);
+		void push(const capsule<T>& c);
+		capsule<T> at(size_t i) const;
 
-	// Checks if c contains r
-	template <class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const rect<T2>& r);
+		std::vector<T> start_x, start_y;
+		std::vector<T> end_x, end_y;
+		std::vector<float> radius;
+	};
 
-	// Checks if c1 contains c2
-	template <class T1, class T2>
-	constexpr bool contains(const circle<T1>& c1, const circle<T2>& c2);
+	template <class T>
+	struct triangle
+	{
+		constexpr triangle() = default;
+		constexpr triangle(const vec2d<T>& a, const vec2d<T>& b, const vec2d<T>& c);
 
-	// Checks if p1 and p2 have the same coordinates
-	template <class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p1, const vec2d<T2>& p2, std::vector<vec2d<T2>>& intersections);
+		constexpr T area() const;
+		constexpr T signed_area() const;
+		constexpr T perimeter() const;
 
-	// Checks if p intersects l
-	template <class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const line<T2>& l, std::vector<vec2d<T2>>& intersections);
+		constexpr line<T> side(uint32_t i) const;
+
+		// Checks if a, b and c are collinear, such triangles contain and intersect nothing
+		constexpr bool degenerate() const;
+
+		// Calculates weights u, v and w of a, b and c so that p = a * u + b * v + c * w, returns false if the triangle is degenerate
+		template <class T1>
+		constexpr bool barycentric(const vec2d<T1>& p, double& u, double& v, double& w) const;
+
+		vec2d<T> a, b, c;
+
+		static constexpr uint8_t SIDES = 3;
+	};
+
+	// Stores triangles column by column so batch tests stream over each component
+	template <class T>
+	struct triangle_buffer
+	{
+		void clear();
+		size_t size() const;
+
+		void push(const triangle<T>& t);
+		triangle<T> at(size_t i) const;
+
+		std::vector<T> ax, ay;
+		std::vector<T> bx, by;
+		std::vector<T> cx, cy;
+	};
+
+	template <class T>
+	struct quadratic_bezier
+	{
+		constexpr quadratic_bezier() = default;
+		constexpr quadratic_bezier(const vec2d<T>& p0, const vec2d<T>& p1, const vec2d<T>& p2);
+
+		constexpr vec2d<T> point(double t) const;
+		constexpr rect<T> bounds() const;
+
+		constexpr void split(double t, quadratic_bezier& left, quadratic_bezier& right) const;
+
+		uint32_t segments(double tolerance) const;
+
+		template <class F>
+		void flatten(double tolerance, F&& func) const;
+
+		vec2d<T> p0, p1, p2;
+	};
+
+	template <class T>
+	struct cubic_bezier
+	{
+		constexpr cubic_bezier() = default;
+		constexpr cubic_bezier(const vec2d<T>& p0, const vec2d<T>& p1, const vec2d<T>& p2, const vec2d<T>& p3);
+
+		constexpr vec2d<T> point(double t) const;
+		constexpr rect<T> bounds() const;
+
+		constexpr void split(double t, cubic_bezier& left, cubic_bezier& right) const;
+
+		uint32_t segments(double tolerance) const;
+
+		template <class F>
+		void flatten(double tolerance, F&& func) const;
+
+		vec2d<T> p0, p1, p2, p3;
+	};
+
+	// Angles are in radians, a positive sweep turns from +x axis towards +y axis
+	template <class T>
+	struct arc
+	{
+		constexpr arc() = default;
+		constexpr arc(const vec2d<T>& center, float radius, double start_angle, double sweep);
+
+		constexpr vec2d<T> point(double t) const;
+		constexpr rect<T> bounds() const;
+
+		constexpr void split(double t, arc& left, arc& right) const;
+
+		uint32_t segments(double tolerance) const;
+
+		template <class F>
+		void flatten(double tolerance, F&& func) const;
+
+		vec2d<T> center;
+		float radius = 0.0f;
+		double start_angle = 0.0;
+		double sweep = 0.0;
+	};
+
+	namespace utils
+	{
+		// Checks if both components of the vectors are equal within EPSILON
+		template <class T1, class T2>
+		constexpr bool equal(const vec2d<T1>& lhs, const vec2d<T2>& rhs);
+
+		// Copies curves in double precision for intersect_curves, lines become straight quadratic curves with the control point in the middle
+		template <class T>
+		constexpr quadratic_bezier<double> to_double(const quadratic_bezier<T>& c);
+
+		template <class T>
+		constexpr cubic_bezier<double> to_double(const cubic_bezier<T>& c);
+
+		template <class T>
+		constexpr arc<double> to_double(const arc<T>& a);
+
+		template <class T>
+		constexpr quadratic_bezier<double> to_double(const line<T>& l);
+
+		// Calls func with each curve that makes up s in double precision, rectangles are made of their 4 sides
+		template <class S, class F>
+		void for_each_curve(const S& s, F&& func);
+
+		template <class T, class F>
+		void for_each_curve(const rect<T>& r, F&& func);
+
+		// Curves are quadratic and cubic bezier curves and arcs, intersects takes pairs of a curve and a curve, a line or a rectangle
+		template <class S>
+		constexpr bool is_curve = false;
+
+		template <class T>
+		constexpr bool is_curve<quadratic_bezier<T>> = true;
+
+		template <class T>
+		constexpr bool is_curve<cubic_bezier<T>> = true;
+
+		template <class T>
+		constexpr bool is_curve<arc<T>> = true;
+
+		template <class S>
+		constexpr bool is_curve_operand = is_curve<S>;
+
+		template <class T>
+		constexpr bool is_curve_operand<line<T>> = true;
+
+		template <class T>
+		constexpr bool is_curve_operand<rect<T>> = true;
+
+		template <class S1, class S2>
+		concept curve_pair = is_curve_operand<S1> && is_curve_operand<S2> && (is_curve<S1> || is_curve<S2>);
+
+		// Appends points where curves a and b cross, the larger piece is split in halves until both are within tolerance of their chords,
+		// pieces wait on a fixed stack so nothing is allocated except for the intersections,
+		// chords that lie on one line within tolerance are points where the curves touch if they only share an end,
+		// returns false if such chords share a stretch, the curves have infinitely many common points then and the search stops,
+		// or if the search stopped after CURVE_STEPS pairs of pieces
+		template <class C1, class C2, class T, class A>
+		bool intersect_curves(const C1& a, const C2& b, double tolerance, std::vector<vec2d<T>, A>& intersections);
+
+		// Largest number of pairs of pieces intersect_curves tests
+		constexpr uint32_t CURVE_STEPS = 1 << 14;
+
+		// Returns a point that stands for the shape when it is sorted along a space-filling curve
+		template <class T>
+		constexpr vec2d<double> key_point(const vec2d<T>& p);
+
+		template <class T>
+		constexpr vec2d<double> key_point(const circle<T>& c);
+
+		template <class T>
+		constexpr vec2d<double> key_point(const rect<T>& r);
+
+		template <class T>
+		constexpr vec2d<double> key_point(const line<T>& l);
+
+		template <class T>
+		constexpr vec2d<double> key_point(const capsule<T>& c);
+
+		template <class T>
+		constexpr vec2d<double> key_point(const triangle<T>& t);
+	}
+
+	// Columns (a, b) and (c, d) are images of the axes and (tx, ty) is the translation
+	template <class T>
+	struct affine
+	{
+		constexpr affine() = default;
+		constexpr affine(T a, T b, T c, T d, T tx, T ty);
+
+		static constexpr affine translation(const vec2d<T>& offset);
+		static affine rotation(double angle);
+		static constexpr affine scale(const vec2d<T>& factor);
+		static constexpr affine shear(T factor);
+
+		// Returns a transform that applies m first and then this
+		constexpr affine operator*(const affine& m) const;
+
+		constexpr vec2d<T> apply(const vec2d<T>& p) const;
+		constexpr vec2d<T> apply_vector(const vec2d<T>& v) const;
+
+		constexpr T determinant() const;
+
+		// Writes the inverse transform into result, returns false if the transform is singular
+		constexpr bool invert(affine& result) const;
+
+		// Finds parts so that translation(offset) * rotation(angle) * shear(skew) * scale(factor) gives this,
+		// factor.y is negative for a reflection, returns false if the transform is singular
+		bool decompose(vec2d<T>& offset, double& angle, T& skew, vec2d<T>& factor) const;
+
+		T a = 1, b = 0;
+		T c = 0, d = 1;
+		T tx = 0, ty = 0;
+
+		// Spans with at least so many elements are split over all cores
+		static constexpr size_t PARALLEL_THRESHOLD = 1 << 15;
+	};
+
+	enum space_curve : uint8_t
+	{
+		CURVE_MORTON,
+		CURVE_HILBERT
+	};
+
+	// Splits bounds into a grid of 2^bits x 2^bits cells, points outside of bounds go to the nearest border cell
+	struct key_grid
+	{
+		key_grid() = default;
+
+		template <class T>
+		explicit key_grid(const rect<T>& bounds, uint32_t bits = 16);
+
+		template <class T>
+		void quantize(const vec2d<T>& p, uint32_t& x, uint32_t& y) const;
+
+		template <class T>
+		uint64_t key(const vec2d<T>& p, space_curve curve) const;
+
+		// Returns the center of the cell with the key
+		vec2d<double> point(uint64_t key, space_curve curve) const;
+
+		vec2d<double> origin;
+
+		// Number of cells per unit along each axis
+		vec2d<double> scale{ 1.0, 1.0 };
+
+		uint32_t bits = 16;
+	};
+
+	// Stable LSD radix sort of 64-bit keys with 8-bit digits, each pass counts digits per chunk and scatters chunks on all cores,
+	// keeps its scratch buffers between calls so reusing it doesn't allocate
+	struct key_sorter
+	{
+		// Writes indices of keys in sorted order into order, sorted keys are left in this->keys
+		void sort(std::span<const uint64_t> input, std::vector<uint32_t>& order);
+
+		std::vector<uint64_t> keys, keys_swap;
+		std::vector<uint32_t> order_swap;
+
+		// Counts of the digits of one chunk, each chunk counts into its own cache lines
+		struct alignas(64) histogram
+		{
+			size_t counts[256];
+		};
+
+		std::vector<histogram> histograms;
+
+		// Sorting is split into chunks of at least so many keys, shorter inputs are sorted on the calling thread
+		static constexpr size_t PARALLEL_THRESHOLD = 1 << 16;
+	};
+
+	// Static R-tree packed bottom-up from boxes sorted along the Hilbert curve of their centers, each node has up to NODE_SIZE children,
+	// keeps its buffers between builds so rebuilding doesn't allocate
+	struct packed_rtree
+	{
+		// Items are indices of bounds
+		void build(std::span<const rect<double>> bounds);
+
+		// Calls func(item) for each item whose bounds overlap r, bounds that only touch r overlap it
+		template <class F>
+		void query(const rect<double>& r, F&& func);
+
+		// Calls func(item, distance) in order of growing distance from p to bounds of items until func returns false
+		template <class F>
+		void nearest(const vec2d<double>& p, F&& func);
+
+		// Returns the first and one past the last child of node
+		void children(uint32_t node, uint32_t& first, uint32_t& last) const;
+
+		static double distance(const rect<double>& r, const vec2d<double>& p);
+
+		static constexpr uint32_t NODE_SIZE = 16;
+
+		// Leaves in the tree order followed by each level of parents up to the root
+		std::vector<rect<double>> nodes;
+
+		// First node of each level, the last value is nodes.size()
+		std::vector<uint32_t> levels;
+
+		// Item of each leaf
+		std::vector<uint32_t> items;
+
+		std::vector<uint64_t> keys;
+		key_sorter sorter;
+
+		std::vector<uint32_t> stack;
+		std::vector<std::pair<double, uint32_t>> queue;
+	};
+
+	template <class T>
+	struct triangulator
+	{
+		triangulator() = default;
+		explicit triangulator(std::pmr::memory_resource* resource);
+
+		// Triangulates p with holes, returns false if there is nothing to triangulate
+		template <class A>
+		bool triangulate(const polygon<T>& p, std::span<const polygon<T>> holes, std::vector<uint32_t, A>& indices);
+
+		enum vertex_type : uint8_t
+		{
+			VERTEX_START,
+			VERTEX_END,
+			VERTEX_SPLIT,
+			VERTEX_MERGE,
+			VERTEX_REGULAR
+		};
+
+		struct sweep_key
+		{
+			vec2d<double> pos;
+		};
+
+		struct edge_order
+		{
+			using is_transparent = void;
+
+			bool operator()(uint32_t lhs, uint32_t rhs) const;
+			bool operator()(uint32_t lhs, const sweep_key& rhs) const;
+			bool operator()(const sweep_key& lhs, uint32_t rhs) const;
+
+			double x_at_sweep(uint32_t e) const;
+
+			const triangulator* owner = nullptr;
+		};
+
+		using status_set = std::pmr::set<uint32_t, edge_order>;
+
+		bool below(uint32_t lhs, uint32_t rhs) const;
+		void add_ring(const std::vector<vec2d<T>>& ring, bool counter_clockwise);
+
+		template <class A>
+		void triangulate_monotone(std::vector<uint32_t, A>& indices);
+
+		template <class A>
+		void add_triangle(uint32_t a, uint32_t b, uint32_t c, std::vector<uint32_t, A>& indices) const;
+
+		// All scratch buffers take memory from the resource
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+		std::pmr::vector<vec2d<double>> points{ resource };
+		std::pmr::vector<uint32_t> next{ resource }, prev{ resource }, order{ resource }, helper{ resource };
+		std::pmr::vector<vertex_type> types{ resource };
+		std::pmr::vector<std::pair<uint32_t, uint32_t>> diagonals{ resource };
+		std::pmr::vector<typename status_set::iterator> status_pos{ resource };
+
+		std::pmr::vector<uint32_t> edge_from{ resource }, edge_to{ resource }, out_offset{ resource }, out_edges{ resource };
+		std::pmr::vector<double> out_angle{ resource };
+		std::pmr::vector<bool> visited = std::pmr::vector<bool>(resource);
+		std::pmr::vector<uint32_t> face{ resource }, face_order{ resource }, stack{ resource };
+		std::pmr::vector<bool> left_chain = std::pmr::vector<bool>(resource);
+
+		vec2d<double> sweep;
+	};
+
+	enum clip_operation : uint8_t
+	{
+		CLIP_INTERSECTION,
+		CLIP_UNION,
+		CLIP_DIFFERENCE,
+		CLIP_XOR
+	};
+
+	template <class T>
+	struct clipper
+	{
+		clipper() = default;
+		explicit clipper(std::pmr::memory_resource* resource);
+
+		// Performs op on a and b, outer rings of the result are counter-clockwise and holes are clockwise,
+		// returns false if the result is empty or if pieces of the rings don't chain into closed rings
+		// (a or b intersects itself), result is left empty then,
+		// pairs of edges are found in O(n log n + p) for p pairs whose bounds overlap and each piece of a ring
+		// between 2 intersections is classified against the other ring in O(n), so it is O(n * k) for k intersections
+		bool clip(const polygon<T>& a, const polygon<T>& b, clip_operation op, std::vector<polygon<T>>& result);
+
+		// Clips p by r using Sutherland-Hodgman algorithm
+		bool clip(const polygon<T>& p, const rect<T>& r, polygon<T>& result);
+
+		enum piece_type : uint8_t
+		{
+			PIECE_OUTSIDE,
+			PIECE_INSIDE,
+			PIECE_SHARED_SAME,
+			PIECE_SHARED_OPPOSITE
+		};
+
+		struct split
+		{
+			uint32_t edge;
+			double t;
+			uint32_t id;
+		};
+
+		struct sweep_edge
+		{
+			double min_x, max_x;
+			uint32_t edge;
+		};
+
+		void add_ring(const std::vector<vec2d<T>>& ring);
+		uint32_t next_vertex(uint32_t i) const;
+		uint32_t find(uint32_t id);
+		void intersect_edges(uint32_t ea, uint32_t eb);
+		piece_type classify(const vec2d<double>& p, const vec2d<double>& dir, uint32_t other) const;
+
+		template <class In, class Out>
+		static void clip_plane(const In& in, Out& out, bool vertical, T bound, bool keep_greater);
+
+		// All scratch buffers take memory from the resource
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+		std::pmr::vector<vec2d<double>> points{ resource };
+		uint32_t ring_begin[3];
+
+		std::pmr::vector<split> splits{ resource };
+		std::pmr::vector<sweep_edge> sweep{ resource };
+		std::pmr::vector<uint32_t> active[2] = { std::pmr::vector<uint32_t>(resource), std::pmr::vector<uint32_t>(resource) };
+		std::pmr::vector<uint32_t> parent{ resource }, sorted{ resource };
+		std::pmr::vector<uint32_t> rings[2] = { std::pmr::vector<uint32_t>(resource), std::pmr::vector<uint32_t>(resource) };
+		std::pmr::vector<uint8_t> owners{ resource };
+
+		std::pmr::vector<uint32_t> edge_from{ resource }, edge_to{ resource }, out_offset{ resource }, out_edges{ resource };
+		std::pmr::vector<bool> used = std::pmr::vector<bool>(resource);
+
+		std::pmr::vector<vec2d<T>> clip_buffer{ resource };
+
+		double tolerance = 0.0;
+	};
+
+	// Each cell (x, y) of a mask covers [x, x + 1) x [y, y + 1) area
+	struct coverage_mask
+	{
+		coverage_mask() = default;
+		coverage_mask(uint32_t width, uint32_t height);
+
+		void resize(uint32_t width, uint32_t height);
+		void clear();
+
+		void fill(uint32_t y, uint32_t x0, uint32_t x1);
+		void blend(uint32_t y, uint32_t x, uint8_t coverage);
+
+		uint8_t at(uint32_t x, uint32_t y) const;
+
+		uint32_t width = 0, height = 0;
+		std::vector<uint8_t> cells;
+	};
+
+	struct bit_mask
+	{
+		bit_mask() = default;
+		bit_mask(uint32_t width, uint32_t height);
+
+		void resize(uint32_t width, uint32_t height);
+		void clear();
+
+		void fill(uint32_t y, uint32_t x0, uint32_t x1);
+		void blend(uint32_t y, uint32_t x, uint8_t coverage);
+
+		bool at(uint32_t x, uint32_t y) const;
+
+		uint32_t width = 0, height = 0, words_per_row = 0;
+		std::vector<uint64_t> words;
+	};
+
+	struct rasterizer
+	{
+		// Only rows in [y_begin, y_end) are touched
+		template <class T, class M>
+		void draw(const circle<T>& c, M& mask, bool antialias = false, uint32_t y_begin = 0, uint32_t y_end = UINT32_MAX);
+
+		template <class T, class M>
+		void draw(const rect<T>& r, M& mask, bool antialias = false, uint32_t y_begin = 0, uint32_t y_end = UINT32_MAX);
+
+		template <class T, class M>
+		void draw(const polygon<T>& p, M& mask, bool antialias = false, uint32_t y_begin = 0, uint32_t y_end = UINT32_MAX);
+
+		// Lines are always drawn as all cells they pass through
+		template <class T, class M>
+		void draw(const line<T>& l, M& mask, bool antialias = false, uint32_t y_begin = 0, uint32_t y_end = UINT32_MAX);
+
+		template <class M, class F>
+		void draw_spans(M& mask, double top, double bottom, bool antialias, uint32_t y_begin, uint32_t y_end, F&& spans);
+
+		rasterizer() = default;
+		explicit rasterizer(std::pmr::memory_resource* resource);
+
+		static constexpr uint32_t SAMPLES = 4;
+
+		// All scratch buffers take memory from the resource
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+		std::pmr::vector<double> crossings{ resource };
+		std::pmr::vector<float> row{ resource };
+	};
+
+	// Cell (x, y) stores the distance at origin + (x + 0.5, y + 0.5) * cell_size
+	struct distance_field
+	{
+		distance_field() = default;
+		distance_field(uint32_t width, uint32_t height, const vec2d<double>& origin = {}, double cell_size = 1.0);
+
+		void resize(uint32_t width, uint32_t height);
+
+		float at(uint32_t x, uint32_t y) const;
+
+		// Bilinearly interpolates the distance at p
+		float sample(const vec2d<double>& p) const;
+
+		// Computes squared Euclidean distance transform of the grid in place, it runs in double so squared distances stay exact
+		static void transform(std::vector<double>& grid, uint32_t width, uint32_t height);
+
+		uint32_t width = 0, height = 0;
+		vec2d<double> origin;
+		double cell_size = 1.0;
+
+		std::vector<float> values;
+	};
+
+	enum contact_event : uint8_t
+	{
+		CONTACT_BEGIN,
+		CONTACT_PERSIST,
+		CONTACT_END
+	};
+
+	// Remembers results of pair tests between frames, a pair is only tested again when a version of either shape changes
+	template <class T>
+	struct pair_cache
+	{
+		struct entry
+		{
+			// Versions of the smaller and the larger id
+			uint32_t version_a = 0, version_b = 0;
+			uint32_t frame = 0;
+			bool touching = false;
+
+			std::vector<vec2d<T>> intersections;
+		};
+
+		struct event
+		{
+			uint32_t a, b;
+			contact_event type;
+		};
+
+		// Clears events of the previous frame
+		void begin_frame();
+
+		// Calls test(intersections) only if (a, b) is new or any version differs from the cached one,
+		// (a, b) and (b, a) are the same pair, events of a tested pair keep the order of the call
+		// and CONTACT_END of a pair that wasn't tested lists the smaller id first
+		template <class F>
+		bool test(uint32_t a, uint32_t version_a, uint32_t b, uint32_t version_b, F&& test);
+
+		// Tests s1 and s2 with def::intersects through the cache
+		template <class S1, class S2>
+		bool intersects(uint32_t a, uint32_t version_a, const S1& s1, uint32_t b, uint32_t version_b, const S2& s2);
+
+		// Ends contacts of pairs that weren't tested during this frame and forgets them
+		void end_frame();
+
+		// Returns cached intersections of (a, b) or nullptr if the pair is unknown
+		const std::vector<vec2d<T>>* intersections(uint32_t a, uint32_t b) const;
+
+		// The smaller id goes to the high half, so the key doesn't depend on the order of a and b
+		static uint64_t key(uint32_t a, uint32_t b);
+
+		std::unordered_map<uint64_t, entry> entries;
+		std::vector<event> events;
+
+		uint32_t frame = 0;
+
+		size_t reused = 0;
+		size_t recomputed = 0;
+	};
+
+	enum shape_kind : uint8_t
+	{
+		SHAPE_CIRCLE,
+		SHAPE_RECT,
+		SHAPE_LINE
+	};
+
+	struct shape_handle
+	{
+		uint32_t index = UINT32_MAX;
+		uint32_t generation = 0;
+	};
+
+	// Owns shapes by handle and remembers which of them changed since the last commit
+	template <class T>
+	struct shape_store
+	{
+		using shape = std::variant<circle<T>, rect<T>, line<T>>;
+
+		struct slot
+		{
+			shape value;
+
+			// Bounds at the last commit, only meaningful if the shape existed then
+			rect<double> committed;
+
+			uint32_t generation = 0;
+			uint32_t version = 0;
+
+			bool alive = false;
+			bool dirty = false;
+			bool existed = false;
+		};
+
+		template <class S>
+		shape_handle add(const S& s);
+
+		// Returns false if the handle is stale
+		template <class S>
+		bool update(shape_handle h, const S& s);
+
+		bool remove(shape_handle h);
+
+		bool valid(shape_handle h) const;
+
+		// Returns nullptr if the handle is stale or the shape has another type
+		template <class S>
+		const S* get(shape_handle h) const;
+
+		// Version grows with every update so it can be used as a key in pair_cache
+		uint32_t version(shape_handle h) const;
+
+		// Forgets changes and lets removed slots be reused
+		void commit();
+
+		// Appends shapes added, updated or removed since the last commit that overlap r now or overlapped r at the last commit,
+		// removed shapes are reported with their old handle (valid returns false for it),
+		// the dirty shapes are indexed with a packed_rtree that is rebuilt on the first call after a change
+		void dirty_in(const rect<T>& r, std::vector<shape_handle>& out);
+
+		// Calls func(handle, shape) for each shape added, updated or removed since the last commit,
+		// removed shapes come with their old handle and their last value
+		template <class F>
+		void for_each_dirty(F&& func) const;
+
+		// Calls func(handle, shape) for each alive shape
+		template <class F>
+		void for_each(F&& func) const;
+
+		// Checks if the shape overlaps r
+		static bool overlaps(const shape& s, const rect<T>& r);
+
+		static rect<double> bounds(const shape& s);
+
+		// Call it before the slot changes, so the bounds at the last commit are still there
+		void mark_dirty(uint32_t index);
+
+		// Handle of the shape in the slot, or the handle it had before it was removed
+		shape_handle handle(uint32_t index) const;
+
+		std::vector<slot> slots;
+		std::vector<uint32_t> free_slots;
+
+		// Slots changed since the last commit, including removed ones
+		std::vector<uint32_t> dirty;
+
+		// Index over bounds of the dirty slots, dirty_bounds[i] belongs to dirty[i]
+		packed_rtree dirty_index;
+		std::vector<rect<double>> dirty_bounds;
+		bool index_stale = true;
+	};
+
+#ifdef DEF_GEOMETRY2D_COROUTINES
+	// Receives a coroutine that is ready to continue, an empty scheduler resumes it right away on the calling thread
+	using async_scheduler = std::function<void(std::coroutine_handle<>)>;
+
+	// Runs the job on the shared thread pool once awaited, its result or exception is returned by co_await,
+	// a job that blocks (a shard query waiting for workers) holds a pool thread until it returns
+	template <class R>
+	struct async_task
+	{
+		using value_type = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+		explicit async_task(utils::unique_function<R> job, async_scheduler scheduler = {});
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> awaiting);
+		R await_resume();
+
+		utils::unique_function<R> job;
+		async_scheduler scheduler;
+
+		std::optional<value_type> result;
+		std::exception_ptr error;
+	};
+
+	// Values are pushed by producer jobs on the shared thread pool and popped in order of arrival by a single consumer,
+	// a job never waits for the consumer: when the stream is full it parks itself and the consumer resubmits it
+	// after taking a value, the consumer is resumed by the job that pushed the value it waits for
+	template <class V>
+	struct async_stream
+	{
+		struct state
+		{
+			std::mutex lock;
+			std::condition_variable idle;
+
+			std::deque<V> values;
+
+			// Producer jobs that stopped because the stream was full
+			std::vector<utils::unique_function<void>> parked;
+
+			// The consumer suspended in next()
+			std::coroutine_handle<> waiting;
+
+			// Thread of the job that is resuming the consumer, the stream destroyed by the consumer there doesn't wait for that job
+			std::thread::id resuming;
+
+			size_t capacity = 0;
+
+			// Producer jobs that haven't ended yet and those running right now
+			size_t producers = 0;
+			size_t active = 0;
+
+			bool done = false;
+			bool cancelled = false;
+
+			async_scheduler scheduler;
+			std::exception_ptr error;
+
+			// Called when a producer job starts, returns false once the stream was dropped or failed,
+			// the job must not read its input then
+			bool enter();
+
+			// Ends a producer job for good, the first exception is rethrown by next() after the last job ended
+			void leave(std::exception_ptr e = {});
+
+			// Ends a producer job until the consumer makes room, the job continues where it stopped
+			void park(utils::unique_function<void> job);
+
+			// Adds a value and resumes the consumer if it waits, returns false once producers should stop
+			bool push(V value);
+
+			bool full();
+
+			// Resumes the waiting consumer or hands it to the scheduler, unlocks guard meanwhile
+			void wake(std::unique_lock<std::mutex>& guard);
+
+			// Ends the stream once no producer job is left
+			void retire(std::unique_lock<std::mutex>& guard);
+		};
+
+		struct next_awaiter
+		{
+			bool await_ready() const noexcept;
+			bool await_suspend(std::coroutine_handle<> awaiting);
+
+			// Returns std::nullopt when the producer has finished and all values were taken
+			std::optional<V> await_resume();
+
+			state* s;
+		};
+
+		async_stream() = default;
+		async_stream(async_stream&&) = default;
+		async_stream& operator=(async_stream&&) = delete;
+		~async_stream();
+
+		next_awaiter next();
+
+		std::shared_ptr<state> shared;
+	};
+#endif
+
+	template <class T>
+	struct intersection_hit
+	{
+		uint32_t first = 0;
+		uint32_t second = 0;
+		vec2d<T> point;
+	};
+
+#if defined(DEF_GEOMETRY2D_SHARDING) && defined(__linux__)
+	// Serves queries from worker processes, one per tile of the world, shapes that overlap several tiles are copied to each of them
+	template <class T>
+	struct shard_service
+	{
+		using shape = typename shape_store<T>::shape;
+
+		struct entry
+		{
+			uint32_t id = 0;
+			shape value;
+		};
+
+		struct hit
+		{
+			uint32_t id = 0;
+			double distance = 0.0;
+		};
+
+		// Shapes of a tile sorted along the Hilbert curve, each block of BLOCK_SIZE shapes keeps its bounds
+		// and a packed R-tree over the blocks finds the ones a query touches in O(log n) per block
+		struct shard
+		{
+			void build(std::vector<entry>&& shapes, const rect<T>& tile);
+
+			// Appends hits with zero distance for shapes that overlap r
+			void query(const rect<T>& r, std::vector<hit>& out);
+
+			// Appends up to k hits nearest to p sorted by distance, blocks are visited from the closest one
+			void nearest(const vec2d<T>& p, uint32_t k, std::vector<hit>& out);
+
+			static constexpr size_t BLOCK_SIZE = 16;
+
+			std::vector<entry> entries;
+			std::vector<rect<double>> blocks;
+
+			// Items are indices of blocks
+			packed_rtree index;
+
+			std::vector<hit> heap;
+		};
+
+		struct worker
+		{
+			pid_t pid = -1;
+			int socket = -1;
+		};
+
+		enum op_code : uint32_t
+		{
+			OP_QUERY,
+			OP_NEAREST,
+			OP_STOP
+		};
+
+		struct request_header
+		{
+			uint32_t op = OP_STOP;
+			uint32_t k = 0;
+			uint64_t count = 0;
+		};
+
+		shard_service() = default;
+		~shard_service();
+
+		shard_service(const shard_service&) = delete;
+		shard_service& operator=(const shard_service&) = delete;
+
+		// Forks a worker for each of columns x rows tiles, shapes outside of world go to border tiles,
+		// call it before the process starts other threads because only the calling thread is copied by fork
+		bool start(const rect<T>& world, uint32_t columns, uint32_t rows, std::span<const entry> entries);
+
+		// Asks workers to exit and waits for them
+		void stop();
+
+		// Closes sockets of all workers without sending anything and waits for them, workers exit when they see the socket closed
+		void close_workers();
+
+		// Writes sorted ids of shapes that contain points[i] into results[i]
+		bool query(std::span<const vec2d<T>> points, std::vector<std::vector<uint32_t>>& results);
+
+		// Writes sorted ids of shapes that overlap rects[i] into results[i]
+		bool query(std::span<const rect<T>> rects, std::vector<std::vector<uint32_t>>& results);
+
+		// Writes up to k shapes nearest to points[i] sorted by distance into results[i], the tile of each point is asked first
+		// and other tiles only if they are closer than the k-th hit found there
+		bool nearest(std::span<const vec2d<T>> points, uint32_t k, std::vector<std::vector<hit>>& results);
+
+		// Run queries on a thread of their own, the service and the spans must outlive the task and only one query may run at a time
+#ifdef DEF_GEOMETRY2D_COROUTINES
+		async_task<bool> query_async(std::span<const vec2d<T>> points, std::vector<std::vector<uint32_t>>& results, async_scheduler scheduler = {});
+		async_task<bool> query_async(std::span<const rect<T>> rects, std::vector<std::vector<uint32_t>>& results, async_scheduler scheduler = {});
+		async_task<bool> nearest_async(std::span<const vec2d<T>> points, uint32_t k, std::vector<std::vector<hit>>& results, async_scheduler scheduler = {});
+#endif
+
+		// Finds the range of tiles that bounds overlap, coordinates outside of the world are clamped to border tiles
+		void tile_range(const rect<double>& bounds, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) const;
+
+		// Distance from p to the tile where border tiles stretch to infinity outwards
+		double tile_distance(const vec2d<T>& p, uint32_t tile) const;
+
+		// Sends queries[routes[w]] to each worker w and appends their hits to hits of the queries,
+		// a failed request or reply leaves other replies unread, so all workers are closed
+		bool dispatch(op_code op, uint32_t k, std::span<const rect<T>> queries, const std::vector<std::vector<uint32_t>>& routes, std::vector<std::vector<hit>>& hits);
+
+		static double distance(const shape& s, const vec2d<T>& p);
+
+		// Answers requests until the socket is closed or OP_STOP arrives
+		static void serve(int socket, shard& s);
+
+		static bool write_all(int socket, const void* data, size_t size);
+		static bool read_all(int socket, void* data, size_t size);
+
+		rect<double> world;
+		uint32_t columns = 0, rows = 0;
+
+		std::vector<worker> workers;
+
+		std::vector<double> send_buffer;
+		std::vector<uint32_t> hit_counts;
+
+		// Replies send ids and distances of hits as separate arrays so padding of hit never goes over the socket
+		std::vector<uint32_t> reply_ids;
+		std::vector<double> reply_distances;
+	};
+#endif
+
+	enum feature_type : uint8_t
+	{
+		FEATURE_VERTEX,
+		FEATURE_EDGE
+	};
+
+	// Contact point of the manifold, the normal points from the first shape to the second one
+	struct contact_manifold
+	{
+		// Swaps roles of the shapes
+		void flip();
+
+		vec2d<double> normal;
+
+		vec2d<double> points[2];
+		double depths[2] = {};
+		uint32_t features[2] = {};
+
+		uint8_t count = 0;
+	};
+
+	// Stores manifolds column by column so a solver can stream over each component,
+	// unused second points have zero depth and zero feature
+	struct contact_buffer
+	{
+		void clear();
+		size_t size() const;
+
+		void push(uint32_t a, uint32_t b, const contact_manifold& m);
+
+		std::vector<uint32_t> body_a, body_b;
+		std::vector<double> normal_x, normal_y;
+		std::vector<uint8_t> count;
+
+		std::vector<double> point_x[2], point_y[2];
+		std::vector<double> depth[2];
+		std::vector<uint32_t> feature[2];
+	};
+
+	enum cell_state : uint8_t
+	{
+		CELL_OUTSIDE,
+		CELL_INSIDE,
+		CELL_BOUNDARY
+	};
+
+	// Polygon with a grid of cells classified as inside, outside or boundary, boundary cells keep the edges that cross them
+	template <class T>
+	struct prepared_polygon
+	{
+		prepared_polygon() = default;
+		explicit prepared_polygon(const polygon<T>& p, uint32_t resolution = 0);
+
+		// Builds the grid, resolution is the number of cells along the longer side of the bounds, zero picks it from the vertex count
+		void prepare(const polygon<T>& p, uint32_t resolution = 0);
+
+		// Checks if p is inside using even-odd rule, only edges of the cell of p are tested
+		template <class T1>
+		bool contains(const vec2d<T1>& p) const;
+
+		std::vector<vec2d<double>> vertices;
+
+		vec2d<double> origin;
+		double cell_size = 1.0;
+		uint32_t width = 0, height = 0;
+
+		std::vector<uint8_t> states;
+
+		// Tells if the reference point of the cell is inside, points of boundary cells are traced from it
+		std::vector<uint8_t> centers;
+
+		// The reference point is slightly off the center of the cell so it doesn't land on grid-aligned vertices
+		static constexpr double REFERENCE_X = 0.4381966011250105;
+		static constexpr double REFERENCE_Y = 0.5527864045000421;
+
+		// Edge i goes from vertices[i] to the next vertex, edges of cell c are cell_edges[cell_offsets[c]..cell_offsets[c + 1])
+		std::vector<uint32_t> cell_offsets, cell_edges;
+	};
+
+	// Delaunay triangulation built by sweeping a hull over points sorted by distance from a seed triangle and flipping illegal edges,
+	// keeps its scratch buffers between calls so rebuilding doesn't allocate
+	template <class T>
+	struct delaunay
+	{
+		// Triangulates points, returns false if there are less than 3 unique points or all of them are collinear
+		bool build(std::span<const vec2d<T>> points);
+
+		// Returns an index of the point nearest to p by walking from start to closer neighbours
+		template <class T1>
+		uint32_t nearest(std::span<const vec2d<T>> points, const vec2d<T1>& p, uint32_t start = 0) const;
+
+		// Calls func(j) for each neighbour j of point i
+		template <class F>
+		void for_each_neighbour(uint32_t i, F&& func) const;
+
+		static uint32_t next(uint32_t e);
+		static uint32_t prev(uint32_t e);
+
+		uint32_t add_triangle(uint32_t i0, uint32_t i1, uint32_t i2, uint32_t a, uint32_t b, uint32_t c);
+		uint32_t legalize(uint32_t a, std::span<const vec2d<T>> points);
+		void link(uint32_t a, uint32_t b);
+		uint32_t hash_key(double x, double y) const;
+
+		static constexpr uint32_t NONE = UINT32_MAX;
+
+		// Half-edge e goes from triangles[e] to triangles[next(e)], each triangle is counter-clockwise (positive signed area)
+		std::vector<uint32_t> triangles;
+
+		// Opposite half-edge of e in the neighbouring triangle or NONE if e lies on the hull
+		std::vector<uint32_t> halfedges;
+
+		// Counter-clockwise convex hull
+		std::vector<uint32_t> hull;
+
+		// A half-edge that ends at each point, hull points get their incoming hull edge and skipped duplicates get NONE
+		std::vector<uint32_t> inedges;
+
+		std::vector<uint32_t> ids;
+		std::vector<double> dists;
+		std::vector<uint32_t> hull_prev, hull_next, hull_tri, hull_hash;
+		std::vector<uint32_t> edge_stack;
+
+		uint32_t hull_start = 0;
+		uint32_t triangles_size = 0;
+		vec2d<double> center;
+	};
+
+	enum join_type : uint8_t
+	{
+		JOIN_MITER,
+		JOIN_ROUND,
+		JOIN_BEVEL
+	};
+
+	// Offsets polygons and removes self-intersections of the offset ring with positive fill rule,
+	// keeps its scratch buffers between calls so reusing it doesn't allocate
+	template <class T>
+	struct offsetter
+	{
+		offsetter() = default;
+		explicit offsetter(std::pmr::memory_resource* resource);
+
+		// Moves edges of p outwards by delta (inwards if delta is negative), outer rings of the result are counter-clockwise and holes are clockwise,
+		// miter_limit is the largest ratio of a miter length to delta, arc_tolerance is the largest deviation of round joins (zero picks delta / 200)
+		template <class A>
+		bool offset(const polygon<T>& p, double delta, join_type join, std::vector<polygon<T>, A>& result, double miter_limit = 2.0, double arc_tolerance = 0.0);
+
+		// Copies p into input counter-clockwise without repeated vertices
+		void set_input(const polygon<T>& p);
+
+		// Writes the raw offset ring of input into points, it's only free of self-intersections for convex input and outer joins
+		void build_ring(double delta, join_type join, double miter_limit, double arc_tolerance);
+
+		// Splits the raw ring at its self-intersections and keeps pieces that have zero winding on their right side
+		template <class A>
+		void resolve(std::vector<polygon<T>, A>& result);
+
+		void intersect_edges(uint32_t ea, uint32_t eb);
+		uint32_t find(uint32_t id);
+
+		// Returns winding number of the raw ring at p ignoring edges in skip, the ray goes along +y if vertical is true and along +x otherwise
+		int32_t winding(const vec2d<double>& p, std::span<const uint32_t> skip, bool vertical) const;
+
+		struct split
+		{
+			uint32_t edge;
+			double t;
+			uint32_t id;
+		};
+
+		struct sweep_edge
+		{
+			double min_x, max_x;
+			uint32_t edge;
+		};
+
+		struct piece
+		{
+			uint32_t first, last;
+			uint32_t from, to;
+		};
+
+		// All scratch buffers take memory from the resource
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+		std::pmr::vector<vec2d<double>> input{ resource };
+
+		// Vertices of the raw ring go first, intersection points are appended after them
+		std::pmr::vector<vec2d<double>> points{ resource };
+		uint32_t ring_size = 0;
+
+		std::pmr::vector<split> splits{ resource };
+		std::pmr::vector<sweep_edge> sweep{ resource };
+		std::pmr::vector<uint32_t> active{ resource }, parent{ resource }, sorted{ resource };
+
+		std::pmr::vector<uint32_t> nodes{ resource }, node_edges{ resource }, occurrences{ resource };
+		std::pmr::vector<piece> pieces{ resource };
+		std::pmr::vector<std::pair<uint64_t, uint32_t>> overlaps{ resource };
+		std::pmr::vector<uint32_t> skipped{ resource };
+		std::pmr::vector<bool> kept = std::pmr::vector<bool>(resource);
+		std::pmr::vector<uint32_t> out_offset{ resource }, out_pieces{ resource };
+		std::pmr::vector<bool> used = std::pmr::vector<bool>(resource);
+	};
+
+	enum simplify_method : uint8_t
+	{
+		SIMPLIFY_DOUGLAS_PEUCKER,
+		SIMPLIFY_VISVALINGAM
+	};
+
+	// Simplifies polylines, keeps its scratch buffers between calls so reusing it doesn't allocate
+	template <class T>
+	struct simplifier
+	{
+		// Writes ascending indices of kept points into kept, the first and the last points are always kept,
+		// tolerance is the largest distance of a dropped point for Douglas-Peucker and the smallest kept triangle area for Visvalingam-Whyatt
+		template <class A>
+		void simplify(std::span<const vec2d<T>> points, double tolerance, simplify_method method, std::vector<uint32_t, A>& kept);
+
+		// Splits ranges at the farthest point with an explicit stack instead of recursion
+		void douglas_peucker(std::span<const vec2d<T>> points, double tolerance);
+
+		// Removes the point with the smallest triangle area taken from a heap until every area reaches tolerance
+		void visvalingam(std::span<const vec2d<T>> points, double tolerance);
+
+		// Returns squared distance from p to the segment from a to b
+		static double sqr_segment_distance(const vec2d<T>& a, const vec2d<T>& b, const vec2d<T>& p);
+
+		static double triangle_area(const vec2d<T>& a, const vec2d<T>& b, const vec2d<T>& c);
+
+		std::vector<uint8_t> keep;
+		std::vector<std::pair<uint32_t, uint32_t>> ranges;
+
+		std::vector<uint32_t> prev, next;
+		std::vector<double> areas;
+		std::vector<std::pair<double, uint32_t>> heap;
+	};
+
+	// Simplifies a polyline that arrives point by point, Douglas-Peucker runs over windows of at most capacity points
+	// so memory stays bounded, the last kept point of each window starts the next one
+	template <class T>
+	struct stream_simplifier
+	{
+		explicit stream_simplifier(double tolerance, size_t capacity = 1024);
+
+		// Adds p and calls emit(point) for each point that is final
+		template <class F>
+		void push(const vec2d<T>& p, F&& emit);
+
+		// Simplifies the rest of the window, calls emit(point) for each kept point and starts a new polyline
+		template <class F>
+		void finish(F&& emit);
+
+		double tolerance;
+		size_t capacity;
+
+		std::vector<vec2d<T>> window;
+		std::vector<uint32_t> kept;
+
+		simplifier<T> work;
+	};
+
+	// Body that only translates, there is no orientation, angular velocity or inertia since rectangles are axis-aligned,
+	// so contact points only match impulses between steps and never apply torque
+	template <class T>
+	struct rigid_body
+	{
+		using shape = std::variant<circle<T>, rect<T>, polygon<T>>;
+
+		// Polygons must be convex
+		shape value;
+
+		vec2d<double> velocity;
+
+		// Zero inverse mass makes the body static
+		double inv_mass = 0.0;
+
+		double friction = 0.5;
+		double restitution = 0.0;
+	};
+
+	// Steps bodies with sort-and-sweep broad phase, contact manifolds, a sequential impulse solver for velocities
+	// and a separate solver for positions, contacts are greedily colored so contacts of one color share no dynamic body and are solved on all cores
+	template <class T>
+	struct physics_world
+	{
+		using body = rigid_body<T>;
+
+		// Adds a body, zero mass makes it static
+		template <class S>
+		uint32_t add(const S& s, double mass, const vec2d<double>& velocity = {});
+
+		// Advances the world by dt seconds
+		void step(double dt);
+
+		void broad_phase();
+		void narrow_phase();
+		void color_contacts();
+		void prepare();
+		void solve();
+
+		// Sets displacements to velocity * dt and pushes bodies out of each other in position_iterations passes
+		void solve_positions(double dt);
+
+		// Moves contacts and their impulses to the previous step so the next step can warm start from them
+		void keep_impulses();
+
+		// Moves bodies by their displacements
+		void integrate();
+
+		// Calls func(contact) for all contacts color by color, passes times, each color goes to the thread pool
+		// and the overflow color is solved serially at the end of each pass
+		template <class F>
+		void for_each_color(uint32_t passes, F&& func);
+
+		static rect<double> bounds(const typename body::shape& s);
+		static void translate(typename body::shape& s, const vec2d<double>& offset);
+
+		std::vector<body> bodies;
+
+		vec2d<double> gravity;
+
+		uint32_t iterations = 8;
+		uint32_t position_iterations = 3;
+
+		// Fraction of penetration beyond slop that each position iteration removes, it moves bodies without
+		// changing their velocities (split impulses) so resolving penetration doesn't add energy
+		double baumgarte = 0.2;
+		double slop = 0.01;
+
+		// Largest correction of one contact in one position iteration
+		double max_correction = 0.2;
+
+		// Relative normal speed below which bodies don't bounce
+		double restitution_threshold = 1.0;
+
+		contact_buffer contacts;
+
+		// Solver state of each contact in contacts, bias only holds the restitution target
+		std::vector<double> mass, friction;
+		std::vector<double> bias[2];
+		std::vector<double> normal_impulse[2], tangent_impulse[2];
+
+		// Translation of each body in this step, the position solver adds corrections to it
+		std::vector<vec2d<double>> displacement;
+
+		// Contacts sorted by color, the last color holds contacts that didn't fit into 64 colors and is solved serially
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> color_offsets;
+
+		static constexpr uint32_t COLORS = 64;
+		static constexpr size_t BLOCK = 1024;
+
+		std::vector<rect<double>> aabbs;
+		std::vector<uint32_t> sorted;
+		std::vector<std::vector<uint64_t>> block_pairs;
+		std::vector<uint64_t> pairs;
+		std::vector<contact_manifold> manifolds;
+		std::vector<uint8_t> hits;
+		std::vector<uint64_t> body_colors;
+		std::vector<uint8_t> colors;
+
+		// Impulses of the previous step are matched by body pair and feature to warm start the solver
+		std::unordered_map<uint64_t, uint32_t> previous;
+		contact_buffer previous_contacts;
+		std::vector<double> previous_normal[2], previous_tangent[2];
+	};
+
+	// point contains point
+	// rectangle contains point
+	// rectangle contains rectangle
+	// rectangle contains line
+	// rectangle contains circle
+	// line contains point
+	// line contains line
+	// circle contains point
+	// circle contains circle
+	// circle contains line
+	// circle contains rectangle
+	// point intersects point
+	// point intersects circle
+	// point intersects rectangle
+	// point intersects line
+	// rectangle intersects point
+	// rectangle intersects line
+	// rectangle intersects rectangle
+	// rectangle intersects circle
+	// line intersects point
+	// line intersects line
+	// line intersects rectangle
+	// line intersects circle
+	// circle intersects point
+	// circle intersects line
+	// circle intersects rectangle
+	// circle intersects circle
+
+	// Checks if p1 and p2 have the same coordinates
+	template <class T1, class T2>
+	constexpr bool contains(const vec2d<T1>& p1, const vec2d<T2>& p2);
+
+	// Checks if r contains p
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const vec2d<T2>& p);
+
+	// Checks if r1 contains r2
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r1, const rect<T2>& r2);
+
+	// Checks if r contains l
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const line<T2>& l);
+
+	// Checks if r contains с
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const circle<T2>& c);
+
+	// Checks if l1 contains l2
+	template <class T1, class T2>
+	constexpr bool contains(const line<T1>& l1, const line<T2>& l2);
+
+	// Checks if l contains p
+	template <class T1, class T2>
+	constexpr bool contains(const line<T1>& l, const vec2d<T2>& p);
+
+	// Checks if c contains p
+	template <class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const vec2d<T2>& p);
+
+	// Checks if c contains l
+	template <class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const line<T2>& l);
+
+	// Checks if c contains r
+	template <class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const rect<T2>& r);
+
+	// Checks if c1 contains c2
+	template <class T1, class T2>
+	constexpr bool contains(const circle<T1>& c1, const circle<T2>& c2);
+
+	// Checks if pp contains p
+	template <class T1, class T2>
+	bool contains(const prepared_polygon<T1>& pp, const vec2d<T2>& p);
+
+	// Checks each point on all cores, results[i] receives 1 if pp contains points[i] and 0 otherwise
+	template <class T1, class T2>
+	void contains(const prepared_polygon<T1>& pp, std::span<const vec2d<T2>> points, std::span<uint8_t> results);
+
+	// Checks if t contains p, points on the edges are inside and degenerate triangles contain nothing
+	template <class T1, class T2>
+	constexpr bool contains(const triangle<T1>& t, const vec2d<T2>& p);
+
+	// Checks each point against t on all cores, results[i] receives 1 if t contains points[i] and 0 otherwise
+	template <class T1, class T2>
+	void contains(const triangle<T1>& t, std::span<const vec2d<T2>> points, std::span<uint8_t> results);
+
+	// Checks p against each triangle on all cores, results[i] receives 1 if triangles[i] contains p and 0 otherwise
+	template <class T1, class T2>
+	void contains(const triangle_buffer<T1>& triangles, const vec2d<T2>& p, std::span<uint8_t> results);
+
+	// Checks if p1 and p2 have the same coordinates
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p1, const vec2d<T2>& p2, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if p intersects l
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if p intersects r
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, side* s = nullptr);
+
+	// Checks if p intersects circle
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if c intersects p
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if r intersects p
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const rect<T1>& r, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections, side* s = nullptr);
+
+	// Checks if r1 intersects r2
+	template <class T1, class T2, class A, class SA = std::allocator<side>>
+	constexpr bool intersects(const rect<T1>& r1, const rect<T2>& r2, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s = nullptr);
+
+	// Checks if r intersects c
+	template <class T1, class T2, class A, class SA = std::allocator<side>>
+	constexpr bool intersects(const rect<T1>& r, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s = nullptr);
+
+	// Checks if l1 intersects l2
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l1, const line<T2>& l2, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if l intersects r
+	template <class T1, class T2, class A, class SA = std::allocator<side>>
+	constexpr bool intersects(const line<T1>& l, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s = nullptr);
+
+	// Checks if l intersects c
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if r intersects l
+	template <class T1, class T2, class A, class SA = std::allocator<side>>
+	constexpr bool intersects(const rect<T1>& r, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s = nullptr);
+
+	// Checks if l intersects p
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if c1 intersects c2
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c1, const circle<T2>& c2, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if c intersects l
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections);
+
+	// Checks if c intersects r
+	template <class T1, class T2, class A, class SA = std::allocator<side>>
+	constexpr bool intersects(const circle<T1>& c, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s = nullptr);
+
+	// Checks if t overlaps r
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const rect<T2>& r);
+
+	// Checks if r overlaps t
+	template <class T1, class T2>
+	constexpr bool intersects(const rect<T1>& r, const triangle<T2>& t);
+
+	// Checks if t overlaps c
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const circle<T2>& c);
+
+	// Checks if c overlaps t
+	template <class T1, class T2>
+	constexpr bool intersects(const circle<T1>& c, const triangle<T2>& t);
+
+	// Checks if t overlaps l
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const line<T2>& l);
+
+	// Checks if l overlaps t
+	template <class T1, class T2>
+	constexpr bool intersects(const line<T1>& l, const triangle<T2>& t);
+
+	// Finds parameters s and t of the closest points of l1 and l2, returns the squared distance between the points
+	template <class T1, class T2>
+	constexpr double closest_points(const line<T1>& l1, const line<T2>& l2, double& s, double& t);
+
+	// Writes points of a polyline that approximates c within tolerance into points, the first and the last points are ends of c
+	template <class T, class A>
+	void flatten(const quadratic_bezier<T>& c, double tolerance, std::vector<vec2d<T>, A>& points);
+
+	// Writes points of a polyline that approximates c within tolerance into points, the first and the last points are ends of c
+	template <class T, class A>
+	void flatten(const cubic_bezier<T>& c, double tolerance, std::vector<vec2d<T>, A>& points);
+
+	// Writes points of a polyline that approximates a within tolerance into points, the first and the last points are ends of a
+	template <class T, class A>
+	void flatten(const arc<T>& a, double tolerance, std::vector<vec2d<T>, A>& points);
+
+	// Writes segments that approximate c within tolerance into lines
+	template <class T, class A>
+	void flatten(const quadratic_bezier<T>& c, double tolerance, std::vector<line<T>, A>& lines);
+
+	// Writes segments that approximate c within tolerance into lines
+	template <class T, class A>
+	void flatten(const cubic_bezier<T>& c, double tolerance, std::vector<line<T>, A>& lines);
+
+	// Writes segments that approximate a within tolerance into lines
+	template <class T, class A>
+	void flatten(const arc<T>& a, double tolerance, std::vector<line<T>, A>& lines);
+
+	// Flattens each curve on all cores, results[i] receives points or lines of curves[i]
+	template <class C, class V, class A>
+	void flatten(std::span<const C> curves, double tolerance, std::vector<V, A>& results);
+
+	// Finds points where a crosses b, one of them is a quadratic or cubic bezier curve or an arc and the other one is a curve, a line or a rectangle,
+	// *complete* receives false if the search stopped early, see utils::intersect_curves, the points found until then are still returned
+	template <class S1, class S2, class T, class A> requires utils::curve_pair<S1, S2>
+	bool intersects(const S1& a, const S2& b, std::vector<vec2d<T>, A>& intersections, double tolerance = 1e-9, bool* complete = nullptr);
+
+	// Writes m applied to each point into out, out may be the same span as points
+	template <class T>
+	void transform(const affine<T>& m, std::span<const vec2d<T>> points, std::span<vec2d<T>> out);
+
+	// Moves centers of circles by m and scales their radii by sqrt(|det|), which is exact for similarity transforms
+	template <class T>
+	void transform(const affine<T>& m, std::span<circle<T>> circles);
+
+	// Replaces each rectangle with the bounds of its transformed corners
+	template <class T>
+	void transform(const affine<T>& m, std::span<rect<T>> rects);
+
+	// Moves ends of each line by m
+	template <class T>
+	void transform(const affine<T>& m, std::span<line<T>> lines);
+
+	// Writes a key of utils::key_point of each shape into keys on all cores
+	template <class S>
+	void spatial_keys(const key_grid& grid, std::span<const S> shapes, space_curve curve, std::span<uint64_t> keys);
+
+	// Reorders shapes by keys of their utils::key_point, shapes with equal keys keep their order
+	template <class S>
+	void spatial_sort(std::span<S> shapes, const key_grid& grid, space_curve curve, key_sorter& sorter);
+
+	// Reorders shapes along the curve over a 16-bit grid that covers key points of all shapes
+	template <class S>
+	void spatial_sort(std::span<S> shapes, space_curve curve = CURVE_HILBERT);
+
+	// Writes v.norm<M>() of each vector into out on all cores, out may be the same span as vectors,
+	// void M picks math_policy_t<T> like the method does
+	template <class M = void, class T>
+	void norm(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out);
+
+	// Writes v.polar<M>() of each vector into out on all cores, out may be the same span as vectors,
+	// void M picks math_policy_t<T> like the method does
+	template <class M = void, class T>
+	void polar(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out);
+
+	// Writes v.cart<M>() of each vector into out on all cores, out may be the same span as vectors,
+	// void M picks math_policy_t<T> like the method does
+	template <class M = void, class T>
+	void cart(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out);
+
+#ifdef DEF_GEOMETRY2D_COROUTINES
+	// Returns a task that calls func when awaited
+	template <class F>
+	async_task<std::invoke_result_t<F&>> run_async(F func, async_scheduler scheduler = {});
+
+	// Streams intersections of a[i] with b[j] for all pairs on all cores, a and b must outlive the stream,
+	// hits of different pairs may arrive in any order
+	template <template <class> class S1, template <class> class S2, class T1, class T2>
+	async_stream<intersection_hit<T2>> intersections_async(std::span<const S1<T1>> a, std::span<const S2<T2>> b,
+		size_t capacity = 1024, async_scheduler scheduler = {});
+#endif
+
+	// Returns squared distance between l and r, zero if l crosses r
+	template <class T1, class T2>
+	constexpr double sqr_distance(const line<T1>& l, const rect<T2>& r);
+
+	// Checks if cp overlaps c
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const circle<T2>& c);
+
+	// Checks if c overlaps cp
+	template <class T1, class T2>
+	constexpr bool intersects(const circle<T1>& c, const capsule<T2>& cp);
+
+	// Checks if cp overlaps r
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const rect<T2>& r);
+
+	// Checks if r overlaps cp
+	template <class T1, class T2>
+	constexpr bool intersects(const rect<T1>& r, const capsule<T2>& cp);
+
+	// Checks if cp overlaps l
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const line<T2>& l);
+
+	// Checks if l overlaps cp
+	template <class T1, class T2>
+	constexpr bool intersects(const line<T1>& l, const capsule<T2>& cp);
+
+	// Checks if cp1 overlaps cp2
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp1, const capsule<T2>& cp2);
+
+	// Returns distance between cp and c, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const circle<T2>& c);
+
+	// Returns distance between c and cp, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const circle<T1>& c, const capsule<T2>& cp);
+
+	// Returns distance between cp and r, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const rect<T2>& r);
+
+	// Returns distance between r and cp, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const rect<T1>& r, const capsule<T2>& cp);
+
+	// Returns distance between cp and l, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const line<T2>& l);
+
+	// Returns distance between l and cp, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const line<T1>& l, const capsule<T2>& cp);
+
+	// Returns distance between cp1 and cp2, zero if they overlap
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp1, const capsule<T2>& cp2);
+
+	// Checks each capsule against c on all cores, results[i] receives 1 if capsules[i] overlaps c and 0 otherwise
+	template <class T1, class T2>
+	void intersects(const capsule_buffer<T1>& capsules, const circle<T2>& c, std::span<uint8_t> results);
+
+	// Checks each capsule against shape on all cores, results[i] receives 1 if capsules[i] overlaps shape and 0 otherwise
+	template <class T, class S>
+	void intersects(const capsule_buffer<T>& capsules, const S& shape, std::span<uint8_t> results);
+
+	// Computes distance between each capsule and c on all cores
+	template <class T1, class T2>
+	void distance(const capsule_buffer<T1>& capsules, const circle<T2>& c, std::span<double> results);
+
+	// Computes distance between each capsule and shape on all cores
+	template <class T, class S>
+	void distance(const capsule_buffer<T>& capsules, const S& shape, std::span<double> results);
+
+	// Triangulates p and writes 3 vertex indices per triangle into indices
+	template <class T, class A>
+	bool triangulate(const polygon<T>& p, std::vector<uint32_t, A>& indices);
+
+	// Triangulates p with holes, indices of the holes go after the vertices of p
+	template <class T, class A>
+	bool triangulate(const polygon<T>& p, std::span<const polygon<T>> holes, std::vector<uint32_t, A>& indices);
+
+	// Triangulates each polygon on all cores, indices[i] receives the triangles of polygons[i]
+	template <class T, class V, class A>
+	void triangulate(std::span<const polygon<T>> polygons, std::vector<V, A>& indices);
+
+	// Performs op on a and b, outer rings of the result are counter-clockwise and holes are clockwise,
+	// returns false if the result is empty or if a or b intersects itself so the pieces don't chain into closed rings,
+	// scratch buffers are taken from resource
+	template <class T>
+	bool clip(const polygon<T>& a, const polygon<T>& b, clip_operation op, std::vector<polygon<T>>& result, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Clips p by r, scratch buffers are taken from resource
+	template <class T>
+	bool clip(const polygon<T>& p, const rect<T>& r, polygon<T>& result, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Clips l by r, the part of l inside r goes from t0 to t1, s0 and s1 receive crossed sides or SIDE_NONE
+	template <class T1, class T2>
+	constexpr bool clip(const line<T1>& l, const rect<T2>& r, double& t0, double& t1, side* s0 = nullptr, side* s1 = nullptr);
+
+	// Clips each line by r, params[i] receives t0 and t1 of lines[i] (t0 > t1 if the line misses r)
+	template <class T1, class T2>
+	void clip(std::span<const line<T1>> lines, const rect<T2>& r, std::span<vec2d<double>> params);
+
+	// Draws c into mask, the antialiasing row is taken from resource
+	template <class T, class M>
+	void rasterize(const circle<T>& c, M& mask, bool antialias = false, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Draws r into mask, the antialiasing row is taken from resource
+	template <class T, class M>
+	void rasterize(const rect<T>& r, M& mask, bool antialias = false, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Draws p into mask using even-odd rule, the antialiasing row is taken from resource
+	template <class T, class M>
+	void rasterize(const polygon<T>& p, M& mask, bool antialias = false, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Draws l into mask, the antialiasing row is taken from resource
+	template <class T, class M>
+	void rasterize(const line<T>& l, M& mask, bool antialias = false, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Draws every shape into mask, rows of the mask are split into tiles that are drawn on all cores,
+	// each thread gets enough tiles to draw at least a few thousand rows of shapes so small jobs stay on the caller
+	template <class S, class M>
+	void rasterize(std::span<const S> shapes, M& mask, bool antialias = false);
+
+	// Returns signed distance from p to c, it's negative inside
+	template <class T1, class T2>
+	constexpr double signed_distance(const circle<T1>& c, const vec2d<T2>& p);
+
+	// Returns signed distance from p to r, it's negative inside
+	template <class T1, class T2>
+	constexpr double signed_distance(const rect<T1>& r, const vec2d<T2>& p);
+
+	// Returns signed distance from p to a capsule around l, it's negative inside
+	template <class T1, class T2>
+	constexpr double signed_distance(const line<T1>& l, const vec2d<T2>& p, double radius = 0.0);
+
+	// Returns signed distance from p to pl, it's negative inside
+	template <class T1, class T2>
+	constexpr double signed_distance(const polygon<T1>& pl, const vec2d<T2>& p);
+
+	// Evaluates the union of shapes at each cell on all cores, field gets width x height cells and keeps its origin and cell size
+	template <class S>
+	void build_distance_field(std::span<const S> shapes, uint32_t width, uint32_t height, distance_field& field);
+
+	// Computes signed distance to the boundary between set and unset cells with two-pass Euclidean transform,
+	// the boundary lies half a cell away from centers of the cells next to it, field gets the size of mask
+	void build_distance_field(const bit_mask& mask, distance_field& field);
+
+	// Offsets p by delta with the join, see offsetter::offset, scratch buffers are taken from the resource of result's allocator
+	template <class T, class A>
+	bool offset(const polygon<T>& p, double delta, join_type join, std::vector<polygon<T>, A>& result, double miter_limit = 2.0, double arc_tolerance = 0.0);
+
+	// Offsets each polygon on all cores, results[i] receives rings of polygons[i]
+	template <class T>
+	void offset(std::span<const polygon<T>> polygons, double delta, join_type join, std::vector<std::vector<polygon<T>>>& results, double miter_limit = 2.0, double arc_tolerance = 0.0);
+
+	// Writes Minkowski sum of convex polygons a and b into result by merging their edges sorted by angle in O(n + m)
+	template <class T>
+	void minkowski_sum(const polygon<T>& a, const polygon<T>& b, polygon<T>& result);
+
+	// Writes Minkowski sum of convex polygon p and r into result
+	template <class T>
+	void minkowski_sum(const polygon<T>& p, const rect<T>& r, polygon<T>& result);
+
+	// Writes Minkowski sum of convex polygon p and c into result, corners become arcs that deviate by at most arc_tolerance (zero picks radius / 200)
+	template <class T>
+	void minkowski_sum(const polygon<T>& p, const circle<T>& c, polygon<T>& result, double arc_tolerance = 0.0);
+
+	// Adds shape to each convex polygon on all cores, results[i] receives the sum with polygons[i]
+	template <class T, class S>
+	void minkowski_sum(std::span<const polygon<T>> polygons, const S& shape, std::vector<polygon<T>>& results);
+
+	// Writes kept points of points into result, see simplifier::simplify for the meaning of tolerance
+	template <class T, class A>
+	void simplify(std::span<const vec2d<T>> points, double tolerance, std::vector<vec2d<T>, A>& result, simplify_method method = SIMPLIFY_DOUGLAS_PEUCKER);
+
+	// Simplifies each polyline on all cores, results[i] receives kept points of lines[i]
+	template <class T>
+	void simplify(std::span<const std::vector<vec2d<T>>> lines, double tolerance, std::vector<std::vector<vec2d<T>>>& results, simplify_method method = SIMPLIFY_DOUGLAS_PEUCKER);
+
+	// Writes the Voronoi cell of each point clipped by bounds into cells, cells of skipped duplicate points are empty,
+	// vertices are circumcenters of triangles of d and unbounded cells of hull points are closed far outside bounds before clipping
+	template <class T>
+	void voronoi(std::span<const vec2d<T>> points, const delaunay<T>& d, const rect<double>& bounds, std::vector<polygon<double>>& cells);
+
+	// Packs features of both shapes that produced a contact point so a solver can match points between frames,
+	// sides of rectangles are numbered by the side enum and corner i of a rectangle is where side i starts going clockwise
+	// (bottom_left, top_left, top_right, bottom_right)
+	constexpr uint32_t contact_feature(uint32_t index_a, feature_type type_a, uint32_t index_b, feature_type type_b);
+
+	// Builds a manifold of c1 and c2, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c1, const circle<T2>& c2, contact_manifold& m);
+
+	// Builds a manifold of c and r, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const rect<T2>& r, contact_manifold& m);
+
+	// Builds a manifold of r and c, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r, const circle<T2>& c, contact_manifold& m);
+
+	// Builds a manifold of r1 and r2, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r1, const rect<T2>& r2, contact_manifold& m);
+
+	// Builds a manifold of c and l, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const line<T2>& l, contact_manifold& m);
+
+	// Builds a manifold of l and c, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const line<T1>& l, const circle<T2>& c, contact_manifold& m);
+
+	// Builds a manifold of convex rings a and b with separating axes and clipping of the incident edge
+	template <class T1, class T2>
+	bool collide(std::span<const vec2d<T1>> a, std::span<const vec2d<T2>> b, contact_manifold& m);
+
+	// Builds a manifold of convex ring a and c, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(std::span<const vec2d<T1>> a, const circle<T2>& c, contact_manifold& m);
+
+	// Builds a manifold of convex polygons p1 and p2, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p1, const polygon<T2>& p2, contact_manifold& m);
+
+	// Builds a manifold of convex polygon p and c, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p, const circle<T2>& c, contact_manifold& m);
+
+	// Builds a manifold of c and convex polygon p, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const polygon<T2>& p, contact_manifold& m);
+
+	// Builds a manifold of r and convex polygon p, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r, const polygon<T2>& p, contact_manifold& m);
+
+	// Builds a manifold of convex polygon p and r, returns false if they don't touch
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p, const rect<T2>& r, contact_manifold& m);
+
+	// Builds a manifold of s1 and s2 and appends it to contacts as a contact between bodies a and b
+	template <class S1, class S2>
+	bool collide(const S1& s1, const S2& s2, uint32_t a, uint32_t b, contact_buffer& contacts);
+
+#define DEF_GEOMETRY2D_IMPL
+
+#ifdef DEF_GEOMETRY2D_IMPL
+#undef DEF_GEOMETRY2D_IMPL
+
+	template <class T>
+	constexpr vec2d<T>::vec2d(const T& x, const T& y) : x(x), y(y)
+	{
+
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator+=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		v1.x += v2.x;
+		v1.y += v2.y;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator-=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		v1.x -= v2.x;
+		v1.y -= v2.y;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator*=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		v1.x *= v2.x;
+		v1.y *= v2.y;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator/=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		v1.x /= v2.x;
+		v1.y /= v2.y;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator%=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		v1.x %= v2.x;
+		v1.y %= v2.y;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator+=(vec2d<T1>& v1, const T2& v2)
+	{
+		v1.x += v2;
+		v1.y += v2;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator-=(vec2d<T1>& v1, const T2& v2)
+	{
+		v1.x -= v2;
+		v1.y -= v2;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator*=(vec2d<T1>& v1, const T2& v2)
+	{
+		v1.x *= v2;
+		v1.y *= v2;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator/=(vec2d<T1>& v1, const T2& v2)
+	{
+		v1.x /= v2;
+		v1.y /= v2;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<T1>& operator%=(vec2d<T1>& v1, const T2& v2)
+	{
+		v1.x %= v2;
+		v1.y %= v2;
+		return v1;
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1.x + v2.x, v1.y + v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1.x - v2.x, v1.y - v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1.x * v2.x, v1.y * v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1.x / v2.x, v1.y / v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator%(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1.x % v2.x, v1.y % v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const vec2d<T1>& v1, const T2& v2)
+	{
+		return vec2d(v1.x + v2, v1.y + v2);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const vec2d<T1>& v1, const T2& v2)
+	{
+		return vec2d(v1.x - v2, v1.y - v2);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const vec2d<T1>& v1, const T2& v2)
+	{
+		return vec2d(v1.x * v2, v1.y * v2);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const vec2d<T1>& v1, const T2& v2)
+	{
+		return vec2d(v1.x / v2, v1.y / v2);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const T1& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1 + v2.x, v1 + v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const T1& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1 - v2.x, v1 - v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const T1& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1 * v2.x, v1 * v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const T1& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1 / v2.x, v1 / v2.y);
+	}
+
+	template <class T1, class T2>
+	constexpr vec2d<decltype(T1(1) + T2(1))> operator%(const T1& v1, const vec2d<T2>& v2)
+	{
+		return vec2d(v1 % v2.x, v1 % v2.y);
+	}
+
+	template <class T>
+	constexpr vec2d<T> operator-(const vec2d<T>& v)
+	{
+		return vec2d(-v.x, -v.y);
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator==(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x == v2.x && v1.y == v2.y;
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator<=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x <= v2.x && v1.y <= v2.y;
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator>=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x >= v2.x && v1.y >= v2.y;
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator<(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x < v2.x && v1.y < v2.y;
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator>(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x > v2.x && v1.y > v2.y;
+	}
+
+	template <class T1, class T2>
+	constexpr bool operator!=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	{
+		return v1.x != v2.x || v1.y != v2.y;
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::clamp(const vec2d& start, const vec2d& end) const
+	{
+		return { std::clamp(x, start.x, end.x), std::clamp(y, start.y, end.y) };
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::lerp(const vec2d& v, const double t) const
+	{
+		return { (T)std::lerp(x, v.x, t), (T)std::lerp(y, v.y, t) };
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::dist(const vec2d<T>& v) const
+	{
+		return (*this - v).length();
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::dot(const vec2d& v) const
+	{
+		return x * v.x + y * v.y;
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::cross(const vec2d& v) const
+	{
+		return x * v.y - y * v.x;
+	}
+
+	template <class T>
+	template <class M>
+	constexpr auto vec2d<T>::angle(const vec2d& v) const
+	{
+		return M::acos(dot(v) / (static_cast<T>(M::sqrt(x * x + y * y)) + static_cast<T>(M::sqrt(v.x * v.x + v.y * v.y))));
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::length() const
+	{
+		return mag();
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::mag() const
+	{
+		return static_cast<T>(utils::sqrt(x * x + y * y));
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::mag2() const
+	{
+		return static_cast<T>(x * x + y * y);
+	}
+
+	template <class T>
+	constexpr auto vec2d<T>::man(const vec2d& v) const
+	{
+		return utils::abs(x - v.x) + utils::abs(y - v.y);
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::max(const vec2d& v) const
+	{
+		return vec2d(std::max(x, v.x), std::max(y, v.y));
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::min(const vec2d& v) const
+	{
+		return vec2d(std::min(x, v.x), std::min(y, v.y));
+	}
+
+	template <class T>
+	constexpr void vec2d<T>::swap(vec2d& v)
+	{
+		std::swap(x, v.x);
+		std::swap(y, v.y);
+	}
+
+	template <class T>
+	template <class M>
+	constexpr vec2d<T> vec2d<T>::norm() const
+	{
+		auto n = static_cast<T>(M::rsqrt(x * x + y * y));
+		return vec2d(x * n, y * n);
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::abs() const
+	{
+		return vec2d(utils::abs(x), utils::abs(y));
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::perp() const
+	{
+		return vec2d(-y, x);
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::floor() const
+	{
+		return vec2d(std::floor(x), std::floor(y));
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::ceil() const
+	{
+		return vec2d(std::ceil(x), std::ceil(y));
+	}
+
+	template <class T>
+	constexpr vec2d<T> vec2d<T>::round() const
+	{
+		return vec2d(std::round(x), std::round(y));
+	}
+
+	template <class T>
+	template <class M>
+	constexpr vec2d<T> vec2d<T>::cart() const
+	{
+		return vec2d(M::cos(y) * x, M::sin(y) * x);
+	}
+
+	template <class T>
+	template <class M>
+	constexpr vec2d<T> vec2d<T>::polar() const
+	{
+		return vec2d(static_cast<T>(M::sqrt(x * x + y * y)), M::atan2(y, x));
+	}
+
+	template <class F>
+	constexpr auto exact_math::sqrt(F x)
+	{
+		return utils::sqrt(x);
+	}
+
+	template <class F>
+	constexpr auto exact_math::rsqrt(F x)
+	{
+		return F(1) / utils::sqrt(x);
+	}
+
+	template <class F>
+	constexpr auto exact_math::sin(F x)
+	{
+		return utils::sin(x);
+	}
+
+	template <class F>
+	constexpr auto exact_math::cos(F x)
+	{
+		return utils::cos(x);
+	}
+
+	template <class F>
+	constexpr auto exact_math::atan2(F y, F x)
+	{
+		return utils::atan2(y, x);
+	}
+
+	template <class F>
+	constexpr auto exact_math::acos(F x)
+	{
+		return utils::acos(x);
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::rsqrt(F value)
+	{
+		using R = real<F>;
+		using U = std::conditional_t<std::is_same_v<R, float>, uint32_t, uint64_t>;
+
+		constexpr U MAGIC = std::is_same_v<R, float> ? U(0x5F375A86u) : U(0x5FE6EB50C7B537A9ull);
+
+		const R x = R(value);
+		R y = std::bit_cast<R>(U(MAGIC - (std::bit_cast<U>(x) >> 1)));
+
+		// Each step squares the relative error of the initial guess which is below 3.5e-2
+		for (int i = 0; i < 3; i++)
+			y = y * (R(1.5) - R(0.5) * x * y * y);
+
+		return y;
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::sqrt(F value)
+	{
+		using R = real<F>;
+
+		// rsqrt(0) is finite so this gives zero for zero
+		const R x = R(value);
+		return x * rsqrt(x);
+	}
+
+	template <class F>
+	constexpr F fast_math::sin_cos(F x, uint32_t offset)
+	{
+		// Rounds to the nearest integer by pushing the fraction out of the mantissa, low bits of the mantissa are the quadrant
+		constexpr double SHIFTER = 6755399441055744.0;
+
+		constexpr double TWO_OVER_PI = 0.6366197723675814;
+		constexpr double PI_2_HI = 1.5707963267948966;
+		constexpr double PI_2_LO = 6.123233995736766e-17;
+
+		// Floats are reduced in double too, in float the product q * PI_2_HI loses the whole result for large angles
+		const double shifted = double(x) * TWO_OVER_PI + SHIFTER;
+		const double q = shifted - SHIFTER;
+		const uint32_t quadrant = uint32_t(std::bit_cast<uint64_t>(shifted)) + offset;
+
+		const F r = F((double(x) - q * PI_2_HI) - q * PI_2_LO);
+		const F s = r * r;
+
+		const F sin = r * (F(0.9999999967617981) + s * (F(-0.16666650224239676) + s * (F(0.008332016453060568) + s * F(-0.00019501822012998654))));
+		const F cos = F(0.9999999999526005) + s * (F(-0.49999999615433466) + s * (F(0.04166661673920769) + s * (F(-0.001388661921028824) + s * F(2.4379929380482588e-05))));
+
+		const F v = (quadrant & 1) ? cos : sin;
+		return (quadrant & 2) ? -v : v;
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::sin(F x)
+	{
+		return sin_cos(real<F>(x), 0);
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::cos(F x)
+	{
+		return sin_cos(real<F>(x), 1);
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::atan2(F y_, F x_)
+	{
+		using R = real<F>;
+
+		const R x = R(x_), y = R(y_);
+		const R ax = copy_sign(x, R(1));
+		const R ay = copy_sign(y, R(1));
+
+		const R hi = ax > ay ? ax : ay;
+		const R lo = ax > ay ? ay : ax;
+
+		// Dividing by a selected value instead of selecting the quotient keeps the loop free of branches
+		const R t = lo / select(hi > R(0), hi, R(1));
+		const R s = t * t;
+
+		R a = t * (R(0.9999999009903452) + s * (R(-0.3333199074657113) + s * (R(0.19969723901842065) + s * (R(-0.14019480932740128)
+			+ s * (R(0.09914292886189319) + s * (R(-0.05948639388171867) + s * (R(0.024252403582024122) + s * R(-0.004693276142404666))))))));
+
+		a = select(ay > ax, R(PI * 0.5) - a, a);
+		a = select(copy_sign(R(1), x) < R(0), R(PI) - a, a);
+
+		return copy_sign(a, y);
+	}
+
+	template <class F>
+	constexpr F fast_math::copy_sign(F magnitude, F sign)
+	{
+		using U = std::conditional_t<std::is_same_v<F, float>, uint32_t, uint64_t>;
+
+		constexpr U SIGN = U(1) << (sizeof(U) * 8 - 1);
+
+		return std::bit_cast<F>(U((std::bit_cast<U>(magnitude) & ~SIGN) | (std::bit_cast<U>(sign) & SIGN)));
+	}
+
+	template <class F>
+	constexpr F fast_math::select(bool condition, F a, F b)
+	{
+		using U = std::conditional_t<std::is_same_v<F, float>, uint32_t, uint64_t>;
+
+		const U mask = U(0) - U(condition);
+
+		return std::bit_cast<F>(U((std::bit_cast<U>(a) & mask) | (std::bit_cast<U>(b) & ~mask)));
+	}
+
+	template <class F>
+	constexpr fast_math::real<F> fast_math::acos(F x_)
+	{
+		using R = real<F>;
+
+		const R x = x_ < F(-1) ? R(-1) : (x_ > F(1) ? R(1) : R(x_));
+		return atan2(sqrt(R(1) - x * x), x);
+	}
+
+	template <class T>
+	std::string vec2d<T>::str() const
+	{
+		return "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
+	}
+
+	template <class F>
+	constexpr auto utils::sqrt(F x)
+	{
+		using R = decltype(std::sqrt(x));
+
+		if (std::is_constant_evaluated())
+		{
+			const R v = R(x);
+
+			if (!(v >= R(0)))
+				return std::numeric_limits<R>::quiet_NaN();
+
+			if (v == R(0) || v == std::numeric_limits<R>::infinity())
+				return v;
+
+			// Newton steps from above decrease until the root stops changing
+			R r = v > R(1) ? v : R(1);
+
+			while (true)
+			{
+				const R next = R(0.5) * (r + v / r);
+
+				if (next >= r)
+					return r;
+
+				r = next;
+			}
+		}
+
+		return std::sqrt(x);
+	}
+
+	template <class F>
+	constexpr auto utils::abs(F x)
+	{
+		if (std::is_constant_evaluated())
+		{
+			using R = decltype(std::abs(x));
+			return x < F(0) ? R(-x) : R(x);
+		}
+
+		return std::abs(x);
+	}
+
+	constexpr double utils::sin_cos_series(double x, uint32_t offset)
+	{
+		// Pi / 2 split into 33-bit parts so their products with quadrant numbers below 2^20 are exact
+		constexpr double PI_2_1 = 1.57079632673412561417e+00;
+		constexpr double PI_2_2 = 6.07710050630396597660e-11;
+		constexpr double PI_2_3 = 2.02226624871116645580e-21;
+
+		if (!(x - x == 0.0))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		// Adding and subtracting 1.5 * 2^52 rounds to the nearest integer, larger quotients are integers already,
+		// the quadrant number stays a double because converting one above 2^63 to an integer is undefined
+		const double q = x * (2.0 / PI);
+		const double n = q > -0x1p51 && q < 0x1p51 ? (q + 0x1.8p52) - 0x1.8p52 : q;
+
+		// Past 2^62 every double is a multiple of 4
+		const uint32_t quadrant = uint32_t(n > -0x1p62 && n < 0x1p62 ? int64_t(n) & 3 : 0) + offset;
+
+		// Products with n aren't exact past 2^20, far past it the remainder is meaningless, so it is kept in range
+		const double r = std::clamp(((x - n * PI_2_1) - n * PI_2_2) - n * PI_2_3, -PI * 0.25, PI * 0.25);
+
+		// Odd quadrants take the cosine series, it starts from 1 instead of r
+		double term = (quadrant & 1) ? 1.0 : r;
+		double sum = term;
+
+		for (int k = (quadrant & 1) ? 1 : 2; k < 40; k += 2)
+		{
+			term *= -r * r / double(k * (k + 1));
+
+			if (sum + term == sum)
+				break;
+
+			sum += term;
+		}
+
+		return (quadrant & 2) ? -sum : sum;
+	}
+
+	constexpr double utils::atan_series(double t)
+	{
+		// atan(t) = 2 * atan(t / (1 + sqrt(1 + t * t))), after 2 halvings t is below tan(pi / 16)
+		for (int i = 0; i < 2; i++)
+			t /= 1.0 + utils::sqrt(1.0 + t * t);
+
+		double power = t, sum = t;
+
+		for (int k = 3; k < 80; k += 2)
+		{
+			power *= -t * t;
+
+			const double term = power / double(k);
+
+			if (sum + term == sum)
+				break;
+
+			sum += term;
+		}
+
+		return 4.0 * sum;
+	}
+
+	template <class F>
+	constexpr auto utils::sin(F x)
+	{
+		using R = decltype(std::sin(x));
+
+		if (std::is_constant_evaluated())
+			return R(sin_cos_series(double(x), 0));
+
+		return std::sin(x);
+	}
+
+	template <class F>
+	constexpr auto utils::cos(F x)
+	{
+		using R = decltype(std::cos(x));
+
+		if (std::is_constant_evaluated())
+			return R(sin_cos_series(double(x), 1));
+
+		return std::cos(x);
+	}
+
+	template <class F>
+	constexpr auto utils::atan2(F y, F x)
+	{
+		using R = decltype(std::atan2(y, x));
+
+		if (std::is_constant_evaluated())
+		{
+			const double dy = double(y), dx = double(x);
+
+			if (dy != dy || dx != dx)
+				return std::numeric_limits<R>::quiet_NaN();
+
+			// Signs of zeros pick the half plane like std::atan2 does
+			const bool negative_x = std::bit_cast<uint64_t>(dx) >> 63;
+			const bool negative_y = std::bit_cast<uint64_t>(dy) >> 63;
+
+			const double ax = negative_x ? -dx : dx;
+			const double ay = negative_y ? -dy : dy;
+
+			double a = 0.0;
+
+			if (ay > ax)
+				a = PI * 0.5 - atan_series(ax / ay);
+			else if (ax > 0.0)
+				a = ay == std::numeric_limits<double>::infinity() ? PI * 0.25 : atan_series(ay / ax);
+
+			if (negative_x)
+				a = PI - a;
+
+			return R(negative_y ? -a : a);
+		}
+
+		return std::atan2(y, x);
+	}
+
+	template <class F>
+	constexpr auto utils::acos(F x)
+	{
+		using R = decltype(std::acos(x));
+
+		if (std::is_constant_evaluated())
+		{
+			const double v = double(x);
+
+			if (!(v >= -1.0 && v <= 1.0))
+				return std::numeric_limits<R>::quiet_NaN();
+
+			return R(utils::atan2(utils::sqrt((1.0 - v) * (1.0 + v)), v));
+		}
+
+		return std::acos(x);
+	}
+
+	template <class T1, class T2>
+	constexpr auto utils::equal(T1 lhs, T2 rhs)
+	{
+		return utils::abs(lhs - rhs) <= EPSILON;
+	}
+
+	template <class T1, class T2>
+	constexpr bool utils::equal(const vec2d<T1>& lhs, const vec2d<T2>& rhs)
+	{
+		return equal(lhs.x, rhs.x) && equal(lhs.y, rhs.y);
+	}
+
+	template <class T>
+	constexpr rect<T>::rect(const vec2d<T>& p, const vec2d<T>& s)
+	{
+		pos = p;
+		size = s;
+	}
+
+	template <class T>
+	constexpr T rect<T>::area() const
+	{
+		return size.x * size.y;
+	}
+
+	template <class T>
+	constexpr T rect<T>::perimeter() const
+	{
+		return 2 * (size.x + size.y);
+	}
+
+	template <class T>
+	constexpr line<T> rect<T>::left() const
+	{
+		return { pos, { pos.x, pos.y + size.y } };
+	}
+
+	template <class T>
+	constexpr line<T> rect<T>::top() const
+	{
+		return { pos, { pos.x + size.x, pos.y } };
+	}
+
+	template <class T>
+	constexpr line<T> rect<T>::right() const
+	{
+		return { { pos.x + size.x, pos.y }, bottom_right() };
+	}
+
+	template <class T>
+	constexpr line<T> rect<T>::bottom() const
+	{
+		return { { pos.x, pos.y + size.y }, bottom_right() };
+	}
+
+	template<class T>
+	constexpr vec2d<T> rect<T>::top_left() const
+	{
+		return pos;
+	}
+
+	template<class T>
+	constexpr vec2d<T> rect<T>::top_right() const
+	{
+		return { pos.x + size.x, pos.y };
+	}
+
+	template<class T>
+	constexpr vec2d<T> rect<T>::bottom_left() const
+	{
+		return { pos.x, pos.y + size.y };;
+	}
+
+	template<class T>
+	constexpr vec2d<T> rect<T>::bottom_right() const
+	{
+		return pos + size;
+	}
+
+	template<class T>
+	constexpr line<T> rect<T>::side(uint32_t i) const
+	{
+		switch (i)
+		{
+		case SIDE_LEFT: return left();
+		case SIDE_TOP: return top();
+		case SIDE_RIGHT: return right();
+		case SIDE_BOTTOM: return bottom();
+		}
+
+		return {};
+	}
+
+	template <class T>
+	constexpr circle<T>::circle(const vec2d<T>& p, float r)
+	{
+		pos = p;
+		radius = r;
+	}
+
+	template <class T>
+	constexpr T circle<T>::area() const
+	{
+		return PI * double(radius * radius);
+	}
+
+	template <class T>
+	constexpr T circle<T>::circumference() const
+	{
+		return 2.0 * PI * (double)radius;
+	}
+
+	template <class T>
+	constexpr line<T>::line(const vec2d<T>& s, const vec2d<T>& e)
+	{
+		start = s;
+		end = e;
+	}
+
+	template <class T>
+	constexpr vec2d<T> line<T>::vector() const
+	{
+		return end - start;
+	}
+
+	template <class T>
+	constexpr capsule<T>::capsule(const vec2d<T>& s, const vec2d<T>& e, float r)
+	{
+		start = s;
+		end = e;
+		radius = r;
+	}
+
+	template <class T>
+	constexpr T capsule<T>::area() const
+	{
+		return PI * double(radius * radius) + 2.0 * double(radius) * double(start.dist(end));
+	}
+
+	template <class T>
+	constexpr T capsule<T>::perimeter() const
+	{
+		return 2.0 * PI * (double)radius + 2.0 * double(start.dist(end));
+	}
+
+	template <class T>
+	constexpr line<T> capsule<T>::axis() const
+	{
+		return line<T>(start, end);
+	}
+
+	template <class T>
+	constexpr triangle<T>::triangle(const vec2d<T>& v1, const vec2d<T>& v2, const vec2d<T>& v3)
+	{
+		a = v1;
+		b = v2;
+		c = v3;
+	}
+
+	template <class T>
+	constexpr T triangle<T>::area() const
+	{
+		return utils::abs(signed_area());
+	}
+
+	template <class T>
+	constexpr T triangle<T>::signed_area() const
+	{
+		return static_cast<T>(0.5 * ((double(b.x) - double(a.x)) * (double(c.y) - double(a.y)) - (double(c.x) - double(a.x)) * (double(b.y) - double(a.y))));
+	}
+
+	template <class T>
+	constexpr T triangle<T>::perimeter() const
+	{
+		return a.dist(b) + b.dist(c) + c.dist(a);
+	}
+
+	template <class T>
+	constexpr bool triangle<T>::degenerate() const
+	{
+		return (double(b.x) - double(a.x)) * (double(c.y) - double(a.y)) - (double(c.x) - double(a.x)) * (double(b.y) - double(a.y)) == 0.0;
+	}
+
+	template <class T>
+	constexpr line<T> triangle<T>::side(uint32_t i) const
+	{
+		switch (i)
+		{
+		case 0: return line<T>(a, b);
+		case 1: return line<T>(b, c);
+		case 2: return line<T>(c, a);
+		}
+
+		return line<T>();
+	}
+
+	template <class T>
+	template <class T1>
+	constexpr bool triangle<T>::barycentric(const vec2d<T1>& p, double& u, double& v, double& w) const
+	{
+		const double v0x = double(b.x) - double(a.x), v0y = double(b.y) - double(a.y);
+		const double v1x = double(c.x) - double(a.x), v1y = double(c.y) - double(a.y);
+		const double v2x = double(p.x) - double(a.x), v2y = double(p.y) - double(a.y);
+
+		const double denom = v0x * v1y - v1x * v0y;
+
+		if (denom == 0.0)
+			return false;
+
+		v = (v2x * v1y - v1x * v2y) / denom;
+		w = (v0x * v2y - v2x * v0y) / denom;
+		u = 1.0 - v - w;
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const vec2d<T1>& p1, const vec2d<T2>& p2)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_POINT_POINT);
+
+		return DEF_GEOMETRY2D_RESULT(utils::equal(p1.x, p2.x) && utils::equal(p1.y, p2.y));
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const vec2d<T2>& p)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_CIRCLE_POINT);
+
+		auto sqr_radius = c.radius * c.radius;
+		auto sqr_dist = (c.pos - p).mag2();
+
+		return DEF_GEOMETRY2D_RESULT(sqr_dist < sqr_radius || utils::equal(sqr_dist, sqr_radius));
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const vec2d<T2>& p)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_RECT_POINT);
+
+		return DEF_GEOMETRY2D_RESULT(p >= r.pos && p <= r.bottom_right());
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r1, const rect<T2>& r2)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_RECT_RECT);
+
+		return DEF_GEOMETRY2D_RESULT(r1.pos <= r2.pos && r1.bottom_right() >= r2.bottom_right());
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const line<T2>& l)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_RECT_LINE);
+
+		return DEF_GEOMETRY2D_RESULT(l.start >= r.pos && l.end >= r.pos && l.start <= r.bottom_right() && l.end <= r.bottom_right());
+	}
+
+	template<class T1, class T2>
+	constexpr bool contains(const rect<T1>& r, const circle<T2>& c)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_RECT_CIRCLE);
+
+		rect<T2> rect_circle(c.pos - c.radius, vec2d<T2>(c.radius * 2));
+		return DEF_GEOMETRY2D_RESULT(contains(r, rect_circle));
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const line<T1>& l1, const line<T2>& l2)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_LINE_LINE);
+
+		return DEF_GEOMETRY2D_RESULT((contains(l1.start, l2.start) && contains(l1.end, l2.end)) || (contains(l1.start, l2.end) && contains(l1.end, l2.start)));
+	}
+
+	template<class T1, class T2>
+	constexpr bool contains(const line<T1>& l, const vec2d<T2>& p)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_LINE_POINT);
+
+		vec2d<T1> vec = l.vector();
+
+		auto dp = vec.dot(p - l.start) / vec.mag2();
+
+		if (dp < 0 || dp > 1)
+			return DEF_GEOMETRY2D_EARLY_OUT(false);
+
+		vec2d<T2> proj = l.start.lerp(l.end, dp);
+
+		// We need to find a proper epsilon value
+		return DEF_GEOMETRY2D_RESULT(p.dist(proj) < EPSILON);
+	}
+
+	template<class T1, class T2>
+	constexpr bool contains(const circle<T1>& c1, const circle<T2>& c2)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_CIRCLE_CIRCLE);
+
+		return DEF_GEOMETRY2D_RESULT(c1.radius >= c1.pos.dist(c2.pos) + c2.radius);
+	}
+
+	template<class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const line<T2>& l)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_CIRCLE_LINE);
+
+		return DEF_GEOMETRY2D_RESULT(contains(c, l.start) && contains(c, l.end));
+	}
+
+	template<class T1, class T2>
+	constexpr bool contains(const circle<T1>& c, const rect<T2>& r)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_CIRCLE_RECT);
+
+		auto radius2 = c.radius * c.radius;
+
+		auto check_dist = [&](const vec2d<T2>& edge)
+			{
+				const auto diff = edge - c.pos;
+				return diff.dot(diff) <= radius2;
+			};
+
+		return DEF_GEOMETRY2D_RESULT(check_dist(r.pos) && check_dist(r.top_right()) && check_dist(r.bottom_left()) && check_dist(r.bottom_right()));
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p1, const vec2d<T2>& p2, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_POINT_POINT);
+
+		if (contains(p1, p2))
+		{
+			intersections.push_back(p2);
+			return DEF_GEOMETRY2D_RESULT(true);
+		}
+
+		return DEF_GEOMETRY2D_RESULT(false);
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_POINT_LINE);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(l, p, intersections));
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, side* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_POINT_RECT);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(r, p, intersections, s));
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const vec2d<T1>& p, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_POINT_CIRCLE);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(c, p, intersections));
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_CIRCLE_POINT);
+
+		if (utils::equal((c.pos - p).mag2(), c.radius * c.radius))
+		{
+			intersections.push_back(p);
+			return DEF_GEOMETRY2D_RESULT(true);
+		}
+
+		return DEF_GEOMETRY2D_RESULT(false);
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const rect<T1>& r, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections, side* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_RECT_POINT);
+
+		for (uint8_t i = 0; i < r.SIDES; i++)
+		{
+			if (contains(r.side(i), p))
+			{
+				if (s) *s = i;
+				intersections.push_back(p);
+				return DEF_GEOMETRY2D_RESULT(true);
+			}
+		}
+
+		return DEF_GEOMETRY2D_RESULT(false);
+	}
+
+	template<class T1, class T2, class A, class SA>
+	constexpr bool intersects(const rect<T1>& r1, const rect<T2>& r2, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_RECT_RECT);
+
+		intersections.clear();
+
+		for (uint8_t i = 0; i < r1.SIDES; i++)
+		{
+			line<T1> side = r1.side(i);
+			bool intersected = false;
+
+			for (uint8_t j = 0; j < r2.SIDES; j++)
+			{
+				std::vector<vec2d<T2>, A> points(intersections.get_allocator());
+				intersects(side, r2.side(j), points);
+
+				if (!points.empty())
+				{
+					intersections.push_back(points[0]);
+					intersected = true;
+				}
+			}
+
+			if (intersected)
+				if (s) s->push_back(def::side(i));
+		}
+
+		return DEF_GEOMETRY2D_RESULT(!intersections.empty());
+	}
+
+	template<class T1, class T2, class A, class SA>
+	constexpr bool intersects(const rect<T1>& r, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_RECT_CIRCLE);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(c, r, intersections, s));
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l1, const line<T2>& l2, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_LINE_LINE);
+
+		// l1: a1 * x + b1 * y = -c1
+		// l2: a2 * x + b2 * y = -c2
+
+		const auto a1 = l1.start.y - l1.end.y;
+		const auto b1 = l1.end.x - l1.start.x;
+
+		const auto a2 = l2.start.y - l2.end.y;
+		const auto b2 = l2.end.x - l2.start.x;
+
+		const auto det = a1 * b2 - b1 * a2;
+
+		if (det == 0)
+		{
+			// Determinant is 0 so the lines are collinear
+
+			// one line is inside another line so there are infinite
+			// number of solutions or no solutions at all
+			return DEF_GEOMETRY2D_RESULT(contains(l2, l1.start) || contains(l1, l2.start));
+		}
+
+		const auto c1 = l1.start.x * l1.end.y - l1.end.x * l1.start.y;
+		const auto c2 = l2.start.x * l2.end.y - l2.end.x * l2.start.y;
+
+		const vec2d<T2> point = { (b1 * c2 - b2 * c1) / det, (a2 * c1 - a1 * c2) / det };
+
+		if (contains(l1, point) && contains(l2, point))
+		{
+			intersections.resize(1);
+			intersections[0] = point;
+			return DEF_GEOMETRY2D_RESULT(true);
+		}
+
+		return DEF_GEOMETRY2D_RESULT(false);
+	}
+
+	template <class T1, class T2, class A, class SA>
+	constexpr bool intersects(const line<T1>& l, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_LINE_RECT);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(r, l, intersections, s));
+	}
+
+	template <class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l, const circle<T2>& c, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_LINE_CIRCLE);
+
+		return DEF_GEOMETRY2D_RESULT(intersects(c, l, intersections));
+	}
+
+	template<class T1, class T2, class A, class SA>
+	constexpr bool intersects(const rect<T1>& r, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_RECT_LINE);
+
+		intersections.clear();
+
+		double t0, t1;
+		side s0, s1;
+
+		if (!clip(l, r, t0, t1, &s0, &s1))
+			return DEF_GEOMETRY2D_EARLY_OUT(false);
+
+		const auto d = l.vector();
+
+		if (s0 != SIDE_NONE)
+		{
+			if (s) s->push_back(s0);
+			intersections.push_back(vec2d<T2>(l.start.x + d.x * t0, l.start.y + d.y * t0));
+		}
+
+		if (s1 != SIDE_NONE && (s0 == SIDE_NONE || t1 > t0))
+		{
+			if (s) s->push_back(s1);
+			intersections.push_back(vec2d<T2>(l.start.x + d.x * t1, l.start.y + d.y * t1));
+		}
+
+		return DEF_GEOMETRY2D_RESULT(!intersections.empty());
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const line<T1>& l, const vec2d<T2>& p, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_LINE_POINT);
+
+		if (contains(l, p))
+		{
+			intersections.push_back(p);
+			return DEF_GEOMETRY2D_RESULT(true);
+		}
+
+		return DEF_GEOMETRY2D_RESULT(false);
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c1, const circle<T2>& c2, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_CIRCLE_CIRCLE);
+
+		intersections.clear();
+
+		const auto sqr_r1 = c1.radius * c1.radius;
+		const auto sqr_r2 = c2.radius * c2.radius;
+
+		const auto dist = c1.pos.dist(c2.pos);
+		const auto adj = (sqr_r1 - sqr_r2 + dist * dist) / (2 * dist);
+		const auto sqr_hyp = sqr_r1 - adj * adj;
+
+		if (sqr_hyp < 0)
+			return DEF_GEOMETRY2D_EARLY_OUT(false);
+
+		const auto hyp = sqrt(sqr_hyp);
+
+		vec2d<T2> p = (c2.pos - c1.pos) * (adj / dist) + c1.pos;
+		vec2d<T2> inter1, inter2;
+
+		inter1.x = p.x + hyp * (c2.pos.y - c1.pos.y) / dist;
+		inter1.y = p.y - hyp * (c2.pos.x - c1.pos.x) / dist;
+
+		inter2.x = p.x - hyp * (c2.pos.y - c1.pos.y) / dist;
+		inter2.y = p.y + hyp * (c2.pos.x - c1.pos.x) / dist;
+
+		intersections.push_back(inter1);
+
+		if (!utils::equal(inter1, inter2))
+			intersections.push_back(inter2);
+
+		return DEF_GEOMETRY2D_RESULT(true);
+	}
+
+	template<class T1, class T2, class A>
+	constexpr bool intersects(const circle<T1>& c, const line<T2>& l, std::vector<vec2d<T2>, A>& intersections)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_CIRCLE_LINE);
+
+		intersections.clear();
+
+		const auto dist = l.dist(c.pos);
+
+		if (utils::equal(dist, c.radius))
+		{
+			// No intersection at all
+			return DEF_GEOMETRY2D_EARLY_OUT(false);
+		}
+
+		// Compute point closest to the circle on the line
+		const auto d = l.vector();
+		const auto uLine = d.dot(c.pos - l.start) / d.mag2();
+		const auto closestPointToLine = l.start + uLine * d;
+		const auto distToLine = (c.pos - closestPointToLine).mag2();
+
+		if (utils::equal(distToLine, c.radius * c.radius))
+		{
+			// Only one intersection point
+			intersections.push_back(closestPointToLine);
+			return DEF_GEOMETRY2D_RESULT(true);
+		}
+
+		// Circle intersects the line
+		const auto length = sqrt(c.radius * c.radius - distToLine);
+		const auto p1 = closestPointToLine + d.norm() * length;
+		const auto p2 = closestPointToLine - d.norm() * length;
+
+		if (contains(l, p1)) intersections.push_back(p1);
+		if (contains(l, p2)) intersections.push_back(p2);
+
+		return DEF_GEOMETRY2D_RESULT(!intersections.empty());
+	}
+
+	template<class T1, class T2, class A, class SA>
+	constexpr bool intersects(const circle<T1>& c, const rect<T2>& r, std::vector<vec2d<T2>, A>& intersections, std::vector<side, SA>* s)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_INTERSECTS_CIRCLE_RECT);
+
+		intersections.clear();
+
+		std::vector<vec2d<T2>, A> points(intersections.get_allocator());
+
+		for (uint8_t i = 0; i < r.SIDES; i++)
+		{
+			intersects(c, r.side(i), points);
+
+			for (const auto& p : points)
+			{
+				if (s) s->push_back(def::side(i));
+				intersections.push_back(p);
+			}
+		}
+
+		return DEF_GEOMETRY2D_RESULT(!intersections.empty());
+	}
+
+	template<class T>
+	template<class T1>
+	constexpr T line<T>::dist(const vec2d<T1>& v) const
+	{
+		auto a = end.y - start.y;
+		auto b = start.x - end.x;
+
+		if (a == 0 && b == 0)
+			return v.dist(start);
+
+		auto c = end.x * start.y - start.x * end.y;
+
+		return utils::abs(a * v.x + b * v.y + c) / utils::sqrt(a * a + b * b);
+	}
+
+	template <class F>
+	void utils::parallel_for(size_t count, F&& func, size_t grain)
+	{
+		if (count == 0)
+			return;
+
+		grain = std::max<size_t>(grain, 1);
+
+		const size_t threads = std::min(concurrency(), (count + grain - 1) / grain);
+
+		if (threads <= 1)
+		{
+			func(size_t(0), count);
+			return;
+		}
+
+#ifdef DEF_GEOMETRY2D_THREADS
+		struct progress
+		{
+			std::atomic<size_t> next{ 0 }, finished{ 0 };
+			std::atomic<bool> failed{ false };
+
+			std::mutex lock;
+			std::condition_variable done;
+			std::exception_ptr error;
+		};
+
+		const size_t chunk = (count + threads - 1) / threads;
+		const size_t chunks = (count + chunk - 1) / chunk;
+
+		// Helpers that start after all chunks were taken only touch the shared progress, never func
+		auto state = std::make_shared<progress>();
+		auto* body = &func;
+
+		auto run = [state, body, count, chunk, chunks]()
+			{
+				for (size_t c = state->next++; c < chunks; c = state->next++)
+				{
+					if (!state->failed)
+					{
+						try
+						{
+							(*body)(c * chunk, std::min(count, (c + 1) * chunk));
+						}
+						catch (...)
+						{
+							std::lock_guard guard(state->lock);
+
+							if (!state->error)
+								state->error = std::current_exception();
+
+							state->failed = true;
+						}
+					}
+
+					if (++state->finished == chunks)
+					{
+						std::lock_guard guard(state->lock);
+						state->done.notify_all();
+					}
+				}
+			};
+
+		thread_pool& pool = thread_pool::shared();
+
+		for (size_t i = 1; i < threads; i++)
+			pool.submit(run);
+
+		// The caller takes chunks as well, so nested calls from pool workers finish even when no worker is free
+		run();
+
+		{
+			std::unique_lock guard(state->lock);
+			state->done.wait(guard, [&]() { return state->finished == chunks; });
+		}
+
+		if (state->error)
+			std::rethrow_exception(state->error);
+#endif
+	}
+
+	inline size_t utils::concurrency()
+	{
+#ifdef DEF_GEOMETRY2D_THREADS
+		return std::max(1u, std::thread::hardware_concurrency());
+#else
+		return 1;
+#endif
+	}
+
+#ifdef DEF_GEOMETRY2D_THREADS
+	template <class R>
+	template <class F>
+	utils::unique_function<R>::unique_function(F func) : impl(std::make_unique<holder<F>>(std::move(func)))
+	{
+
+	}
+
+	template <class R>
+	R utils::unique_function<R>::operator()()
+	{
+		return impl->call();
+	}
+
+	template <class R>
+	utils::unique_function<R>::operator bool() const
+	{
+		return impl != nullptr;
+	}
+
+	template <class R>
+	template <class F>
+	utils::unique_function<R>::holder<F>::holder(F f) : func(std::move(f))
+	{
+
+	}
+
+	template <class R>
+	template <class F>
+	R utils::unique_function<R>::holder<F>::call()
+	{
+		return func();
+	}
+
+	inline utils::thread_pool::thread_pool(size_t threads)
+	{
+		workers.reserve(threads);
+
+		for (size_t i = 0; i < threads; i++)
+			workers.emplace_back([this]() { work(); });
+	}
+
+	inline utils::thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard guard(lock);
+			stopping = true;
+		}
+
+		wake.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	inline void utils::thread_pool::submit(unique_function<void> job)
+	{
+		{
+			std::lock_guard guard(lock);
+			jobs.push_back(std::move(job));
+		}
+
+		wake.notify_one();
+	}
+
+	inline size_t utils::thread_pool::size() const
+	{
+		return workers.size();
+	}
+
+	inline utils::thread_pool& utils::thread_pool::shared()
+	{
+		static thread_pool pool(std::max<size_t>(concurrency(), 2) - 1);
+		return pool;
+	}
+
+	inline void utils::thread_pool::work()
+	{
+		for (;;)
+		{
+			unique_function<void> job;
+
+			{
+				std::unique_lock guard(lock);
+				wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+
+				// Queued jobs still run when the pool stops, so nobody waits for a job that was dropped
+				if (jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+#endif
+
+	template <class T>
+	constexpr polygon<T>::polygon(const std::vector<vec2d<T>>& v) : vertices(v)
+	{
+
+	}
+
+	template <class T>
+	constexpr polygon<T>::polygon(std::initializer_list<vec2d<T>> v) : vertices(v)
+	{
+
+	}
+
+	template <class T>
+	constexpr T polygon<T>::area() const
+	{
+		const T a = signed_area();
+		return a < 0 ? -a : a;
+	}
+
+	template <class T>
+	constexpr T polygon<T>::signed_area() const
+	{
+		const size_t n = vertices.size();
+		decltype(T(1) * T(1)) sum = 0;
+
+		for (size_t i = 0, j = n - 1; i < n; j = i++)
+			sum += vertices[j].cross(vertices[i]);
+
+		return static_cast<T>(sum / 2);
+	}
+
+	template <class T>
+	constexpr T polygon<T>::perimeter() const
+	{
+		T sum = 0;
+
+		for (uint32_t i = 0; i < vertices.size(); i++)
+			sum += side(i).vector().length();
+
+		return sum;
+	}
+
+	template <class T>
+	constexpr line<T> polygon<T>::side(uint32_t i) const
+	{
+		return { vertices[i], vertices[(i + 1) % vertices.size()] };
+	}
+
+	template <class T>
+	double triangulator<T>::edge_order::x_at_sweep(uint32_t e) const
+	{
+		const auto& a = owner->points[e];
+		const auto& b = owner->points[owner->next[e]];
+		const auto& s = owner->sweep;
+
+		// Horizontal edges are treated as if the plane was slightly rotated
+		// so they cross the sweep line right where the sweep point is
+		if (a.y == b.y)
+			return std::clamp(s.x, std::min(a.x, b.x), std::max(a.x, b.x));
+
+		return a.x + (s.y - a.y) * (b.x - a.x) / (b.y - a.y);
+	}
+
+	template <class T>
+	bool triangulator<T>::edge_order::operator()(uint32_t lhs, uint32_t rhs) const
+	{
+		const double x1 = x_at_sweep(lhs);
+		const double x2 = x_at_sweep(rhs);
+
+		if (x1 != x2)
+			return x1 < x2;
+
+		return lhs < rhs;
+	}
+
+	template <class T>
+	bool triangulator<T>::edge_order::operator()(uint32_t lhs, const sweep_key& rhs) const
+	{
+		return x_at_sweep(lhs) < rhs.pos.x;
+	}
+
+	template <class T>
+	bool triangulator<T>::edge_order::operator()(const sweep_key& lhs, uint32_t rhs) const
+	{
+		return lhs.pos.x < x_at_sweep(rhs);
+	}
+
+	template <class T>
+	bool triangulator<T>::below(uint32_t lhs, uint32_t rhs) const
+	{
+		const auto& a = points[lhs];
+		const auto& b = points[rhs];
+
+		if (a.y != b.y) return a.y < b.y;
+		if (a.x != b.x) return a.x > b.x;
+
+		return lhs > rhs;
+	}
+
+	template <class T>
+	void triangulator<T>::add_ring(const std::vector<vec2d<T>>& ring, bool counter_clockwise)
+	{
+		const uint32_t first = (uint32_t)points.size();
+		const uint32_t n = (uint32_t)ring.size();
+
+		double sum = 0.0;
+
+		for (uint32_t i = 0, j = n - 1; i < n; j = i++)
+			sum += double(ring[j].x) * double(ring[i].y) - double(ring[i].x) * double(ring[j].y);
+
+		const bool reverse = (sum > 0.0) != counter_clockwise;
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			points.push_back({ double(ring[i].x), double(ring[i].y) });
+
+			const uint32_t forward = first + (i + 1) % n;
+			const uint32_t backward = first + (i + n - 1) % n;
+
+			next.push_back(reverse ? backward : forward);
+			prev.push_back(reverse ? forward : backward);
+		}
+	}
+
+	template <class T>
+	template <class A>
+	void triangulator<T>::add_triangle(uint32_t a, uint32_t b, uint32_t c, std::vector<uint32_t, A>& indices) const
+	{
+		const double area = (points[b] - points[a]).cross(points[c] - points[a]);
+
+		// Collinear vertices don't produce anything visible
+		if (area == 0.0)
+			return;
+
+		if (area < 0.0)
+			std::swap(b, c);
+
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	template <class T>
+	template <class A>
+	void triangulator<T>::triangulate_monotone(std::vector<uint32_t, A>& indices)
+	{
+		const size_t k = face.size();
+
+		if (k < 3)
+			return;
+
+		if (k == 3)
+		{
+			add_triangle(face[0], face[1], face[2], indices);
+			return;
+		}
+
+		size_t top = 0, bottom = 0;
+
+		for (size_t i = 1; i < k; i++)
+		{
+			if (below(face[top], face[i])) top = i;
+			if (below(face[i], face[bottom])) bottom = i;
+		}
+
+		// The face is counter-clockwise so walking forward from the top vertex goes down the left chain
+		for (size_t i = top; i != bottom; i = (i + 1) % k)
+			left_chain[face[i]] = true;
+
+		for (size_t i = bottom; i != top; i = (i + 1) % k)
+			left_chain[face[i]] = false;
+
+		face_order.assign(face.begin(), face.end());
+		std::sort(face_order.begin(), face_order.end(), [this](uint32_t a, uint32_t b) { return below(b, a); });
+
+		stack.clear();
+		stack.push_back(face_order[0]);
+		stack.push_back(face_order[1]);
+
+		for (size_t j = 2; j < k - 1; j++)
+		{
+			const uint32_t u = face_order[j];
+
+			if (left_chain[u] != left_chain[stack.back()])
+			{
+				for (size_t i = 0; i + 1 < stack.size(); i++)
+					add_triangle(u, stack[i], stack[i + 1], indices);
+
+				const uint32_t last = stack.back();
+
+				stack.clear();
+				stack.push_back(last);
+				stack.push_back(u);
+			}
+			else
+			{
+				uint32_t last = stack.back();
+				stack.pop_back();
+
+				while (!stack.empty())
+				{
+					const double turn = (points[stack.back()] - points[u]).cross(points[last] - points[u]);
+
+					if (left_chain[u] ? turn <= 0.0 : turn >= 0.0)
+						break;
+
+					add_triangle(u, last, stack.back(), indices);
+
+					last = stack.back();
+					stack.pop_back();
+				}
+
+				stack.push_back(last);
+				stack.push_back(u);
+			}
+		}
+
+		for (size_t i = 0; i + 1 < stack.size(); i++)
+			add_triangle(face_order[k - 1], stack[i], stack[i + 1], indices);
+	}
+
+	template <class T>
+	triangulator<T>::triangulator(std::pmr::memory_resource* r) : resource(r)
+	{
+
+	}
+
+	template <class T>
+	template <class A>
+	bool triangulator<T>::triangulate(const polygon<T>& p, std::span<const polygon<T>> holes, std::vector<uint32_t, A>& indices)
+	{
+		indices.clear();
+
+		if (p.vertices.size() < 3)
+			return false;
+
+		points.clear();
+		next.clear();
+		prev.clear();
+
+		add_ring(p.vertices, true);
+
+		for (const auto& hole : holes)
+		{
+			if (hole.vertices.size() >= 3)
+				add_ring(hole.vertices, false);
+			else
+			{
+				// Keep the indices of the following holes in place
+				for (const auto& v : hole.vertices)
+				{
+					const uint32_t i = (uint32_t)points.size();
+
+					points.push_back({ double(v.x), double(v.y) });
+					next.push_back(i);
+					prev.push_back(i);
+				}
+			}
+		}
+
+		const uint32_t n = (uint32_t)points.size();
+
+		types.resize(n);
+		helper.assign(n, UINT32_MAX);
+		status_pos.resize(n);
+		order.clear();
+		diagonals.clear();
+
+		for (uint32_t v = 0; v < n; v++)
+		{
+			if (next[v] == v)
+				continue;
+
+			const uint32_t a = prev[v];
+			const uint32_t b = next[v];
+
+			const bool convex = (points[v] - points[a]).cross(points[b] - points[v]) > 0.0;
+
+			if (below(a, v) && below(b, v))
+				types[v] = convex ? VERTEX_START : VERTEX_SPLIT;
+			else if (below(v, a) && below(v, b))
+				types[v] = convex ? VERTEX_END : VERTEX_MERGE;
+			else
+				types[v] = VERTEX_REGULAR;
+
+			order.push_back(v);
+		}
+
+		std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return below(b, a); });
+
+		status_set status(edge_order{ this }, resource);
+
+		auto insert_edge = [&](uint32_t e, uint32_t v)
+			{
+				status_pos[e] = status.insert(e).first;
+				helper[e] = v;
+			};
+
+		auto remove_edge = [&](uint32_t e, uint32_t v)
+			{
+				// Only happens for degenerate input
+				if (helper[e] == UINT32_MAX)
+					return;
+
+				if (types[helper[e]] == VERTEX_MERGE)
+					diagonals.push_back({ v, helper[e] });
+
+				status.erase(status_pos[e]);
+				helper[e] = UINT32_MAX;
+			};
+
+		auto left_of = [&](uint32_t v) -> uint32_t
+			{
+				auto it = status.lower_bound(sweep_key{ points[v] });
+				return it == status.begin() ? UINT32_MAX : *std::prev(it);
+			};
+
+		auto connect_left = [&](uint32_t v, bool always)
+			{
+				const uint32_t e = left_of(v);
+
+				if (e == UINT32_MAX)
+					return;
+
+				if (always || types[helper[e]] == VERTEX_MERGE)
+					diagonals.push_back({ v, helper[e] });
+
+				helper[e] = v;
+			};
+
+		for (uint32_t v : order)
+		{
+			sweep = points[v];
+
+			switch (types[v])
+			{
+			case VERTEX_START:
+				insert_edge(v, v);
+			break;
+
+			case VERTEX_END:
+				remove_edge(prev[v], v);
+			break;
+
+			case VERTEX_SPLIT:
+				connect_left(v, true);
+				insert_edge(v, v);
+			break;
+
+			case VERTEX_MERGE:
+				remove_edge(prev[v], v);
+				connect_left(v, false);
+			break;
+
+			case VERTEX_REGULAR:
+			{
+				// The interior lies to the right when the boundary goes down
+				if (below(next[v], v))
+				{
+					remove_edge(prev[v], v);
+					insert_edge(v, v);
+				}
+				else
+					connect_left(v, false);
+			}
+			break;
+
+			}
+		}
+
+		// Split the polygon into monotone faces by walking the boundary
+		// together with the diagonals in both directions
+
+		edge_from.clear();
+		edge_to.clear();
+
+		for (uint32_t v : order)
+		{
+			edge_from.push_back(v);
+			edge_to.push_back(next[v]);
+		}
+
+		for (const auto& [a, b] : diagonals)
+		{
+			edge_from.push_back(a);
+			edge_to.push_back(b);
+			edge_from.push_back(b);
+			edge_to.push_back(a);
+		}
+
+		const uint32_t edges = (uint32_t)edge_from.size();
+
+		// Diamond angle grows monotonically with the real angle and doesn't need any trigonometry
+		auto pseudo_angle = [](const vec2d<double>& d)
+			{
+				const double p = d.x / (std::abs(d.x) + std::abs(d.y));
+				return d.y < 0.0 ? 3.0 + p : 1.0 - p;
+			};
+
+		out_offset.assign(n + 1, 0);
+
+		for (uint32_t e = 0; e < edges; e++)
+			out_offset[edge_from[e] + 1]++;
+
+		for (uint32_t v = 0; v < n; v++)
+			out_offset[v + 1] += out_offset[v];
+
+		out_edges.resize(edges);
+		out_angle.resize(edges);
+		face_order.assign(out_offset.begin(), out_offset.end() - 1);
+
+		for (uint32_t e = 0; e < edges; e++)
+			out_edges[face_order[edge_from[e]]++] = e;
+
+		for (uint32_t v = 0; v < n; v++)
+		{
+			auto first = out_edges.begin() + out_offset[v];
+			auto last = out_edges.begin() + out_offset[v + 1];
+
+			for (auto it = first; it != last; ++it)
+				out_angle[*it] = pseudo_angle(points[edge_to[*it]] - points[v]);
+
+			std::sort(first, last, [this](uint32_t a, uint32_t b) { return out_angle[a] < out_angle[b]; });
+		}
+
+		visited.assign(edges, false);
+		left_chain.resize(n);
+
+		for (uint32_t start = 0; start < edges; start++)
+		{
+			if (visited[start])
+				continue;
+
+			face.clear();
+
+			for (uint32_t e = start; !visited[e];)
+			{
+				visited[e] = true;
+				face.push_back(edge_from[e]);
+
+				// Take the first outgoing edge clockwise from the way back
+				const uint32_t v = edge_to[e];
+				const double back = pseudo_angle(points[edge_from[e]] - points[v]);
+
+				auto first = out_edges.begin() + out_offset[v];
+				auto last = out_edges.begin() + out_offset[v + 1];
+
+				auto it = std::lower_bound(first, last, back, [this](uint32_t a, double angle) { return out_angle[a] < angle; });
+				e = it == first ? *(last - 1) : *(it - 1);
+			}
+
+			triangulate_monotone(indices);
+		}
+
+		return !indices.empty();
+	}
+
+	template <class T, class A>
+	bool triangulate(const polygon<T>& p, std::vector<uint32_t, A>& indices)
+	{
+		triangulator<T> t(utils::resource_of(indices.get_allocator()));
+		return t.triangulate(p, {}, indices);
+	}
+
+	template <class T, class A>
+	bool triangulate(const polygon<T>& p, std::span<const polygon<T>> holes, std::vector<uint32_t, A>& indices)
+	{
+		triangulator<T> t(utils::resource_of(indices.get_allocator()));
+		return t.triangulate(p, holes, indices);
+	}
+
+	template <class T, class V, class A>
+	void triangulate(std::span<const polygon<T>> polygons, std::vector<V, A>& indices)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("triangulate", "build");
+
+		indices.resize(polygons.size());
+
+		utils::parallel_for(polygons.size(), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("triangulate chunk", "build");
+
+				triangulator<T> t;
+
+				for (size_t i = begin; i < end; i++)
+					t.triangulate(polygons[i], {}, indices[i]);
+			}, 16);
+	}
+
+	template <class T>
+	clipper<T>::clipper(std::pmr::memory_resource* r) : resource(r)
+	{
+
+	}
+
+	template <class T>
+	void clipper<T>::add_ring(const std::vector<vec2d<T>>& ring)
+	{
+		const size_t n = ring.size();
+		double sum = 0.0;
+
+		for (size_t i = 0, j = n - 1; i < n; j = i++)
+			sum += double(ring[j].x) * double(ring[i].y) - double(ring[i].x) * double(ring[j].y);
+
+		// Both rings are stored counter-clockwise
+		for (size_t i = 0; i < n; i++)
+		{
+			const auto& v = ring[sum < 0.0 ? n - 1 - i : i];
+			points.push_back({ double(v.x), double(v.y) });
+		}
+	}
+
+	template <class T>
+	uint32_t clipper<T>::next_vertex(uint32_t i) const
+	{
+		if (i + 1 == ring_begin[1]) return ring_begin[0];
+		if (i + 1 == ring_begin[2]) return ring_begin[1];
+		return i + 1;
+	}
+
+	template <class T>
+	uint32_t clipper<T>::find(uint32_t id)
+	{
+		while (parent[id] != id)
+		{
+			parent[id] = parent[parent[id]];
+			id = parent[id];
+		}
+
+		return id;
+	}
+
+	template <class T>
+	void clipper<T>::intersect_edges(uint32_t ea, uint32_t eb)
+	{
+		constexpr double EPS = 1e-10;
+
+		const uint32_t na = next_vertex(ea);
+		const uint32_t nb = next_vertex(eb);
+
+		const auto p = points[ea];
+		const auto q = points[eb];
+		const auto r = points[na] - p;
+		const auto s = points[nb] - q;
+		const auto qp = q - p;
+
+		const double denom = r.cross(s);
+
+		if (std::abs(denom) <= EPS * r.mag() * s.mag())
+		{
+			// Parallel edges only matter when they overlap
+			if (std::abs(r.cross(qp)) > tolerance * r.mag())
+				return;
+
+			auto split_by = [&](uint32_t edge, const vec2d<double>& origin, const vec2d<double>& dir, uint32_t id)
+				{
+					const double t = (points[id] - origin).dot(dir) / dir.mag2();
+
+					if (t > EPS && t < 1.0 - EPS)
+						splits.push_back({ edge, t, id });
+					else if (std::abs(t) <= EPS || std::abs(t - 1.0) <= EPS)
+						parent[find(id)] = find(t < 0.5 ? edge : next_vertex(edge));
+				};
+
+			split_by(ea, p, r, eb);
+			split_by(ea, p, r, nb);
+			split_by(eb, q, s, ea);
+			split_by(eb, q, s, na);
+
+			return;
+		}
+
+		const double t = qp.cross(s) / denom;
+		const double u = qp.cross(r) / denom;
+
+		if (t < -EPS || t > 1.0 + EPS || u < -EPS || u > 1.0 + EPS)
+			return;
+
+		const uint32_t end_a = t <= EPS ? ea : (t >= 1.0 - EPS ? na : UINT32_MAX);
+		const uint32_t end_b = u <= EPS ? eb : (u >= 1.0 - EPS ? nb : UINT32_MAX);
+
+		if (end_a != UINT32_MAX && end_b != UINT32_MAX)
+			parent[find(end_b)] = find(end_a);
+		else if (end_a != UINT32_MAX)
+			splits.push_back({ eb, u, end_a });
+		else if (end_b != UINT32_MAX)
+			splits.push_back({ ea, t, end_b });
+		else
+		{
+			const uint32_t id = (uint32_t)points.size();
+
+			points.push_back(p + r * t);
+			parent.push_back(id);
+
+			splits.push_back({ ea, t, id });
+			splits.push_back({ eb, u, id });
+		}
+	}
+
+	template <class T>
+	typename clipper<T>::piece_type clipper<T>::classify(const vec2d<double>& p, const vec2d<double>& dir, uint32_t other) const
+	{
+		bool inside = false;
+
+		for (uint32_t i = ring_begin[other]; i < ring_begin[other + 1]; i++)
+		{
+			const auto& a = points[i];
+			const auto& b = points[next_vertex(i)];
+			const auto e = b - a;
+
+			const double len2 = e.mag2();
+			const double t = len2 > 0.0 ? std::clamp((p - a).dot(e) / len2, 0.0, 1.0) : 0.0;
+
+			if ((p - (a + e * t)).mag2() <= tolerance * tolerance)
+				return dir.dot(e) > 0.0 ? PIECE_SHARED_SAME : PIECE_SHARED_OPPOSITE;
+
+			if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * e.x / e.y)
+				inside = !inside;
+		}
+
+		return inside ? PIECE_INSIDE : PIECE_OUTSIDE;
+	}
+
+	template <class T>
+	bool clipper<T>::clip(const polygon<T>& a, const polygon<T>& b, clip_operation op, std::vector<polygon<T>>& result)
+	{
+		size_t rings_found = 0;
+
+		auto finish = [&]()
+			{
+				result.resize(rings_found);
+				return rings_found > 0;
+			};
+
+		auto emit_ring = [&](const auto& ring)
+			{
+				if (rings_found == result.size())
+					result.emplace_back();
+
+				result[rings_found++].vertices.assign(ring.begin(), ring.end());
+			};
+
+		const bool valid_a = a.vertices.size() >= 3;
+		const bool valid_b = b.vertices.size() >= 3;
+
+		if (!valid_a || !valid_b)
+		{
+			if (valid_a && op != CLIP_INTERSECTION) emit_ring(a.vertices);
+			if (valid_b && (op == CLIP_UNION || op == CLIP_XOR)) emit_ring(b.vertices);
+
+			return finish();
+		}
+
+		points.clear();
+		splits.clear();
+
+		ring_begin[0] = 0;
+		add_ring(a.vertices);
+		ring_begin[1] = (uint32_t)points.size();
+		add_ring(b.vertices);
+		ring_begin[2] = (uint32_t)points.size();
+
+		vec2d<double> lo = points[0], hi = points[0];
+
+		for (const auto& p : points)
+		{
+			lo = lo.min(p);
+			hi = hi.max(p);
+		}
+
+		tolerance = 1e-9 * std::max(1.0, (hi - lo).mag());
+
+		parent.resize(points.size());
+
+		for (uint32_t i = 0; i < parent.size(); i++)
+			parent[i] = i;
+
+		// Sweep along x so only edges with overlapping x ranges are tested against each other
+
+		sweep.clear();
+
+		for (uint32_t e = 0; e < ring_begin[2]; e++)
+		{
+			const double x1 = points[e].x;
+			const double x2 = points[next_vertex(e)].x;
+
+			sweep.push_back({ std::min(x1, x2), std::max(x1, x2), e });
+		}
+
+		std::sort(sweep.begin(), sweep.end(), [](const sweep_edge& lhs, const sweep_edge& rhs) { return lhs.min_x < rhs.min_x; });
+
+		active[0].clear();
+		active[1].clear();
+
+		for (uint32_t i = 0; i < sweep.size(); i++)
+		{
+			const auto& cur = sweep[i];
+			const uint32_t own = cur.edge < ring_begin[1] ? 0 : 1;
+
+			for (auto& list : active)
+			{
+				for (size_t j = 0; j < list.size();)
+				{
+					if (sweep[list[j]].max_x < cur.min_x)
+					{
+						list[j] = list.back();
+						list.pop_back();
+					}
+					else
+						j++;
+				}
+			}
+
+			const double y1 = points[cur.edge].y;
+			const double y2 = points[next_vertex(cur.edge)].y;
+
+			for (uint32_t j : active[1 - own])
+			{
+				const uint32_t other = sweep[j].edge;
+
+				const double y3 = points[other].y;
+				const double y4 = points[next_vertex(other)].y;
+
+				if (std::max(y1, y2) < std::min(y3, y4) || std::max(y3, y4) < std::min(y1, y2))
+					continue;
+
+				if (own == 0)
+					intersect_edges(cur.edge, other);
+				else
+					intersect_edges(other, cur.edge);
+			}
+
+			active[own].push_back(i);
+		}
+
+		// Vertices with the same coordinates become the same vertex
+
+		sorted.resize(points.size());
+
+		for (uint32_t i = 0; i < sorted.size(); i++)
+			sorted[i] = i;
+
+		std::sort(sorted.begin(), sorted.end(), [this](uint32_t lhs, uint32_t rhs)
+			{
+				return points[lhs].x < points[rhs].x || (points[lhs].x == points[rhs].x && points[lhs].y < points[rhs].y);
+			});
+
+		for (size_t i = 1; i < sorted.size(); i++)
+		{
+			if (points[sorted[i]] == points[sorted[i - 1]])
+				parent[find(sorted[i])] = find(sorted[i - 1]);
+		}
+
+		std::sort(splits.begin(), splits.end(), [](const split& lhs, const split& rhs)
+			{
+				return lhs.edge < rhs.edge || (lhs.edge == rhs.edge && lhs.t < rhs.t);
+			});
+
+		owners.assign(points.size(), 0);
+
+		size_t next_split = 0;
+
+		for (uint32_t r = 0; r < 2; r++)
+		{
+			auto& ring = rings[r];
+			ring.clear();
+
+			auto push = [&](uint32_t id)
+				{
+					id = find(id);
+
+					if (ring.empty() || ring.back() != id)
+						ring.push_back(id);
+				};
+
+			for (uint32_t e = ring_begin[r]; e < ring_begin[r + 1]; e++)
+			{
+				push(e);
+
+				for (; next_split < splits.size() && splits[next_split].edge == e; next_split++)
+					push(splits[next_split].id);
+			}
+
+			if (ring.size() > 1 && ring.front() == ring.back())
+				ring.pop_back();
+
+			for (uint32_t id : ring)
+				owners[id] |= 1 << r;
+		}
+
+		// Pick pieces of both rings depending on where they are relative to the other ring,
+		// the state can only change at vertices that belong to both rings
+
+		edge_from.clear();
+		edge_to.clear();
+
+		for (uint32_t r = 0; r < 2; r++)
+		{
+			const auto& ring = rings[r];
+			piece_type type = PIECE_OUTSIDE;
+
+			for (size_t i = 0; i < ring.size(); i++)
+			{
+				const uint32_t from = ring[i];
+				const uint32_t to = ring[(i + 1) % ring.size()];
+
+				if (i == 0 || owners[from] == 3)
+					type = classify((points[from] + points[to]) * 0.5, points[to] - points[from], 1 - r);
+
+				int direction = 0;
+
+				switch (op)
+				{
+				case CLIP_INTERSECTION:
+					if (type == PIECE_INSIDE || (type == PIECE_SHARED_SAME && r == 0)) direction = 1;
+				break;
+
+				case CLIP_UNION:
+					if (type == PIECE_OUTSIDE || (type == PIECE_SHARED_SAME && r == 0)) direction = 1;
+				break;
+
+				case CLIP_DIFFERENCE:
+				{
+					if (r == 0 && (type == PIECE_OUTSIDE || type == PIECE_SHARED_OPPOSITE)) direction = 1;
+					if (r == 1 && type == PIECE_INSIDE) direction = -1;
+				}
+				break;
+
+				case CLIP_XOR:
+				{
+					if (type == PIECE_OUTSIDE) direction = 1;
+					if (type == PIECE_INSIDE) direction = -1;
+				}
+				break;
+
+				}
+
+				if (direction != 0)
+				{
+					edge_from.push_back(direction > 0 ? from : to);
+					edge_to.push_back(direction > 0 ? to : from);
+				}
+			}
+		}
+
+		// Chain the pieces into rings
+
+		const uint32_t vertices = (uint32_t)points.size();
+		const uint32_t edges = (uint32_t)edge_from.size();
+
+		out_offset.assign(vertices + 1, 0);
+
+		for (uint32_t e = 0; e < edges; e++)
+			out_offset[edge_from[e] + 1]++;
+
+		for (uint32_t v = 0; v < vertices; v++)
+			out_offset[v + 1] += out_offset[v];
+
+		out_edges.resize(edges);
+		sorted.assign(out_offset.begin(), out_offset.end() - 1);
+
+		for (uint32_t e = 0; e < edges; e++)
+			out_edges[sorted[edge_from[e]]++] = e;
+
+		used.assign(edges, false);
+
+		for (uint32_t start = 0; start < edges; start++)
+		{
+			if (used[start])
+				continue;
+
+			clip_buffer.clear();
+
+			bool closed = false;
+
+			for (uint32_t e = start; e != UINT32_MAX;)
+			{
+				used[e] = true;
+
+				const auto& p = points[edge_from[e]];
+				clip_buffer.push_back({ static_cast<T>(p.x), static_cast<T>(p.y) });
+
+				const uint32_t v = edge_to[e];
+
+				if (v == edge_from[start])
+				{
+					closed = true;
+					break;
+				}
+
+				e = UINT32_MAX;
+
+				for (uint32_t i = out_offset[v]; i < out_offset[v + 1]; i++)
+				{
+					if (!used[out_edges[i]])
+					{
+						e = out_edges[i];
+						break;
+					}
+				}
+			}
+
+			// A chain that can't be closed means an input ring intersects itself, a partial result would be misleading
+			if (!closed)
+			{
+				rings_found = 0;
+				return finish();
+			}
+
+			if (clip_buffer.size() >= 3)
+				emit_ring(clip_buffer);
+		}
+
+		return finish();
+	}
+
+	template <class T>
+	template <class In, class Out>
+	void clipper<T>::clip_plane(const In& in, Out& out, bool vertical, T bound, bool keep_greater)
+	{
+		out.clear();
+
+		if (in.empty())
+			return;
+
+		auto coord = [vertical](const vec2d<T>& v) { return vertical ? v.y : v.x; };
+		auto inside = [&](const vec2d<T>& v) { return keep_greater ? coord(v) >= bound : coord(v) <= bound; };
+
+		vec2d<T> prev = in.back();
+		bool prev_inside = inside(prev);
+
+		for (const auto& cur : in)
+		{
+			const bool cur_inside = inside(cur);
+
+			if (cur_inside != prev_inside)
+			{
+				const double t = double(bound - coord(prev)) / double(coord(cur) - coord(prev));
+
+				if (vertical)
+					out.push_back({ static_cast<T>(prev.x + (cur.x - prev.x) * t), bound });
+				else
+					out.push_back({ bound, static_cast<T>(prev.y + (cur.y - prev.y) * t) });
+			}
+
+			if (cur_inside)
+				out.push_back(cur);
+
+			prev = cur;
+			prev_inside = cur_inside;
+		}
+	}
+
+	template <class T>
+	bool clipper<T>::clip(const polygon<T>& p, const rect<T>& r, polygon<T>& result)
+	{
+		result.vertices.clear();
+
+		if (p.vertices.size() < 3)
+			return false;
+
+		vec2d<T> lo = p.vertices[0], hi = p.vertices[0];
+
+		for (const auto& v : p.vertices)
+		{
+			lo = lo.min(v);
+			hi = hi.max(v);
+		}
+
+		const vec2d<T> br = r.bottom_right();
+
+		// Most polygons are either completely inside or outside of the window
+		if (hi.x < r.pos.x || hi.y < r.pos.y || lo.x > br.x || lo.y > br.y)
+			return false;
+
+		if (lo >= r.pos && hi <= br)
+		{
+			result.vertices.assign(p.vertices.begin(), p.vertices.end());
+			return true;
+		}
+
+		clip_plane(p.vertices, clip_buffer, false, r.pos.x, true);
+		clip_plane(clip_buffer, result.vertices, true, r.pos.y, true);
+		clip_plane(result.vertices, clip_buffer, false, br.x, false);
+		clip_plane(clip_buffer, result.vertices, true, br.y, false);
+
+		return result.vertices.size() >= 3;
+	}
+
+	template <class T>
+	bool clip(const polygon<T>& a, const polygon<T>& b, clip_operation op, std::vector<polygon<T>>& result, std::pmr::memory_resource* resource)
+	{
+		clipper<T> c(resource);
+		return c.clip(a, b, op, result);
+	}
+
+	template <class T>
+	bool clip(const polygon<T>& p, const rect<T>& r, polygon<T>& result, std::pmr::memory_resource* resource)
+	{
+		clipper<T> c(resource);
+		return c.clip(p, r, result);
+	}
+
+	template <class T1, class T2>
+	constexpr bool clip(const line<T1>& l, const rect<T2>& r, double& t0, double& t1, side* s0, side* s1)
+	{
+		const double dx = double(l.end.x) - double(l.start.x);
+		const double dy = double(l.end.y) - double(l.start.y);
+
+		// Each side is p * t <= q, entering when p < 0 and leaving when p > 0
+		const double p[4] = { -dx, -dy, dx, dy };
+		const double q[4] =
+		{
+			double(l.start.x) - double(r.pos.x),
+			double(l.start.y) - double(r.pos.y),
+			double(r.pos.x) + double(r.size.x) - double(l.start.x),
+			double(r.pos.y) + double(r.size.y) - double(l.start.y)
+		};
+
+		// The order matches the side enum
+		constexpr side SIDES[4] = { SIDE_LEFT, SIDE_TOP, SIDE_RIGHT, SIDE_BOTTOM };
+
+		side entry = SIDE_NONE, exit = SIDE_NONE;
+
+		t0 = 0.0;
+		t1 = 1.0;
+
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			if (p[i] == 0.0)
+			{
+				if (q[i] < 0.0)
+					return false;
+
+				continue;
+			}
+
+			const double t = q[i] / p[i];
+
+			if (p[i] < 0.0)
+			{
+				if (t >= t0 && (entry == SIDE_NONE || t > t0))
+				{
+					t0 = t;
+					entry = SIDES[i];
+				}
+			}
+			else
+			{
+				if (t <= t1 && (exit == SIDE_NONE || t < t1))
+				{
+					t1 = t;
+					exit = SIDES[i];
+				}
+			}
+		}
+
+		if (t0 > t1)
+			return false;
+
+		if (s0) *s0 = entry;
+		if (s1) *s1 = exit;
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	void clip(std::span<const line<T1>> lines, const rect<T2>& r, std::span<vec2d<double>> params)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("clip lines", "query");
+
+		utils::parallel_for(std::min(lines.size(), params.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("clip lines chunk", "query");
+
+				for (size_t i = begin; i < end; i++)
+				{
+					auto& t = params[i];
+
+					if (!clip(lines[i], r, t.x, t.y))
+					{
+						t.x = 1.0;
+						t.y = 0.0;
+					}
+				}
+			}, 16384);
+	}
+
+	inline coverage_mask::coverage_mask(uint32_t w, uint32_t h)
+	{
+		resize(w, h);
+	}
+
+	inline void coverage_mask::resize(uint32_t w, uint32_t h)
+	{
+		width = w;
+		height = h;
+		cells.assign(size_t(w) * h, 0);
+	}
+
+	inline void coverage_mask::clear()
+	{
+		std::fill(cells.begin(), cells.end(), 0);
+	}
+
+	inline void coverage_mask::fill(uint32_t y, uint32_t x0, uint32_t x1)
+	{
+		std::fill_n(cells.data() + size_t(y) * width + x0, x1 - x0, uint8_t(255));
+	}
+
+	inline void coverage_mask::blend(uint32_t y, uint32_t x, uint8_t coverage)
+	{
+		auto& cell = cells[size_t(y) * width + x];
+		cell = std::max(cell, coverage);
+	}
+
+	inline uint8_t coverage_mask::at(uint32_t x, uint32_t y) const
+	{
+		return cells[size_t(y) * width + x];
+	}
+
+	inline bit_mask::bit_mask(uint32_t w, uint32_t h)
+	{
+		resize(w, h);
+	}
+
+	inline void bit_mask::resize(uint32_t w, uint32_t h)
+	{
+		width = w;
+		height = h;
+		words_per_row = (w + 63) / 64;
+		words.assign(size_t(words_per_row) * h, 0);
+	}
+
+	inline void bit_mask::clear()
+	{
+		std::fill(words.begin(), words.end(), 0);
+	}
+
+	inline void bit_mask::fill(uint32_t y, uint32_t x0, uint32_t x1)
+	{
+		uint64_t* row = words.data() + size_t(y) * words_per_row;
+
+		const uint32_t first = x0 / 64;
+		const uint32_t last = (x1 - 1) / 64;
+
+		const uint64_t first_mask = ~uint64_t(0) << (x0 % 64);
+		const uint64_t last_mask = ~uint64_t(0) >> (63 - (x1 - 1) % 64);
+
+		if (first == last)
+		{
+			row[first] |= first_mask & last_mask;
+			return;
+		}
+
+		row[first] |= first_mask;
+		std::fill(row + first + 1, row + last, ~uint64_t(0));
+		row[last] |= last_mask;
+	}
+
+	inline void bit_mask::blend(uint32_t y, uint32_t x, uint8_t coverage)
+	{
+		if (coverage >= 128)
+			words[size_t(y) * words_per_row + x / 64] |= uint64_t(1) << (x % 64);
+	}
+
+	inline bool bit_mask::at(uint32_t x, uint32_t y) const
+	{
+		return (words[size_t(y) * words_per_row + x / 64] >> (x % 64)) & 1;
+	}
+
+	inline rasterizer::rasterizer(std::pmr::memory_resource* r) : resource(r)
+	{
+
+	}
+
+	template <class M, class F>
+	void rasterizer::draw_spans(M& mask, double top, double bottom, bool antialias, uint32_t y_begin, uint32_t y_end, F&& spans)
+	{
+		const double width = double(mask.width);
+
+		const int64_t first = std::max<int64_t>(int64_t(std::floor(top)), y_begin);
+		const int64_t last = std::min<int64_t>(int64_t(std::ceil(bottom)), std::min(y_end, mask.height));
+
+		if (!antialias)
+		{
+			// A cell is covered when its center is covered
+			for (int64_t y = first; y < last; y++)
+			{
+				spans(double(y) + 0.5, [&](double x0, double x1)
+					{
+						const double a = std::clamp(std::ceil(x0 - 0.5), 0.0, width);
+						const double b = std::clamp(std::ceil(x1 - 0.5), 0.0, width);
+
+						if (a < b)
+							mask.fill(uint32_t(y), uint32_t(a), uint32_t(b));
+					});
+			}
+
+			return;
+		}
+
+		// Coverage is accumulated from several sub-rows with exact horizontal coverage
+		row.resize(mask.width, 0.0f);
+
+		constexpr float WEIGHT = 1.0f / SAMPLES;
+
+		for (int64_t y = first; y < last; y++)
+		{
+			uint32_t lo = mask.width, hi = 0;
+
+			for (uint32_t s = 0; s < SAMPLES; s++)
+			{
+				spans(double(y) + (s + 0.5) / SAMPLES, [&](double x0, double x1)
+					{
+						x0 = std::clamp(x0, 0.0, width);
+						x1 = std::clamp(x1, 0.0, width);
+
+						if (x0 >= x1)
+							return;
+
+						const uint32_t p0 = uint32_t(x0);
+						const uint32_t p1 = uint32_t(x1);
+
+						if (p0 == p1)
+							row[p0] += float(x1 - x0) * WEIGHT;
+						else
+						{
+							row[p0] += float(p0 + 1 - x0) * WEIGHT;
+
+							for (uint32_t x = p0 + 1; x < p1; x++)
+								row[x] += WEIGHT;
+
+							if (p1 < mask.width)
+								row[p1] += float(x1 - p1) * WEIGHT;
+						}
+
+						lo = std::min(lo, p0);
+						hi = std::max(hi, std::min(p1, mask.width - 1));
+					});
+			}
+
+			for (uint32_t x = lo; x <= hi && lo < mask.width; x++)
+			{
+				if (row[x] > 0.0f)
+				{
+					mask.blend(uint32_t(y), x, uint8_t(std::min(row[x], 1.0f) * 255.0f + 0.5f));
+					row[x] = 0.0f;
+				}
+			}
+		}
+	}
+
+	template <class T, class M>
+	void rasterizer::draw(const circle<T>& c, M& mask, bool antialias, uint32_t y_begin, uint32_t y_end)
+	{
+		const double cx = double(c.pos.x);
+		const double cy = double(c.pos.y);
+		const double r = double(c.radius);
+
+		draw_spans(mask, cy - r, cy + r, antialias, y_begin, y_end, [&](double y, auto&& emit)
+			{
+				const double dy = y - cy;
+				const double sqr_half = r * r - dy * dy;
+
+				if (sqr_half > 0.0)
+				{
+					const double half = std::sqrt(sqr_half);
+					emit(cx - half, cx + half);
+				}
+			});
+	}
+
+	template <class T, class M>
+	void rasterizer::draw(const rect<T>& r, M& mask, bool antialias, uint32_t y_begin, uint32_t y_end)
+	{
+		const double top = double(r.pos.y);
+		const double bottom = top + double(r.size.y);
+
+		draw_spans(mask, top, bottom, antialias, y_begin, y_end, [&](double y, auto&& emit)
+			{
+				if (y >= top && y < bottom)
+					emit(double(r.pos.x), double(r.pos.x) + double(r.size.x));
+			});
+	}
+
+	template <class T, class M>
+	void rasterizer::draw(const polygon<T>& p, M& mask, bool antialias, uint32_t y_begin, uint32_t y_end)
+	{
+		const auto& v = p.vertices;
+
+		if (v.size() < 3)
+			return;
+
+		double top = double(v[0].y), bottom = top;
+
+		for (const auto& vertex : v)
+		{
+			top = std::min(top, double(vertex.y));
+			bottom = std::max(bottom, double(vertex.y));
+		}
+
+		draw_spans(mask, top, bottom, antialias, y_begin, y_end, [&](double y, auto&& emit)
+			{
+				crossings.clear();
+
+				for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++)
+				{
+					const double y1 = double(v[j].y);
+					const double y2 = double(v[i].y);
+
+					if ((y1 <= y) != (y2 <= y))
+						crossings.push_back(double(v[j].x) + (y - y1) * (double(v[i].x) - double(v[j].x)) / (y2 - y1));
+				}
+
+				std::sort(crossings.begin(), crossings.end());
+
+				for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+					emit(crossings[i], crossings[i + 1]);
+			});
+	}
+
+	template <class T, class M>
+	void rasterizer::draw(const line<T>& l, M& mask, bool, uint32_t y_begin, uint32_t y_end)
+	{
+		const double x0 = double(l.start.x), y0 = double(l.start.y);
+		const double x1 = double(l.end.x), y1 = double(l.end.y);
+
+		const double width = double(mask.width);
+
+		const int64_t first = std::max<int64_t>(int64_t(std::floor(std::min(y0, y1))), y_begin);
+		const int64_t last = std::min<int64_t>(int64_t(std::floor(std::max(y0, y1))) + 1, std::min(y_end, mask.height));
+
+		for (int64_t y = first; y < last; y++)
+		{
+			double xa = std::min(x0, x1), xb = std::max(x0, x1);
+
+			if (y0 != y1)
+			{
+				// Part of the line inside [y, y + 1) band
+				const double ta = std::clamp((double(y) - y0) / (y1 - y0), 0.0, 1.0);
+				const double tb = std::clamp((double(y) + 1.0 - y0) / (y1 - y0), 0.0, 1.0);
+
+				xa = x0 + (x1 - x0) * ta;
+				xb = x0 + (x1 - x0) * tb;
+
+				if (xa > xb)
+					std::swap(xa, xb);
+			}
+
+			const double a = std::clamp(std::floor(xa), 0.0, width);
+			const double b = std::clamp(std::floor(xb) + 1.0, 0.0, width);
+
+			if (a < b)
+				mask.fill(uint32_t(y), uint32_t(a), uint32_t(b));
+		}
+	}
+
+	template <class T, class M>
+	void rasterize(const circle<T>& c, M& mask, bool antialias, std::pmr::memory_resource* resource)
+	{
+		rasterizer r(resource);
+		r.draw(c, mask, antialias);
+	}
+
+	template <class T, class M>
+	void rasterize(const rect<T>& rc, M& mask, bool antialias, std::pmr::memory_resource* resource)
+	{
+		rasterizer r(resource);
+		r.draw(rc, mask, antialias);
+	}
+
+	template <class T, class M>
+	void rasterize(const polygon<T>& p, M& mask, bool antialias, std::pmr::memory_resource* resource)
+	{
+		rasterizer r(resource);
+		r.draw(p, mask, antialias);
+	}
+
+	template <class T, class M>
+	void rasterize(const line<T>& l, M& mask, bool antialias, std::pmr::memory_resource* resource)
+	{
+		rasterizer r(resource);
+		r.draw(l, mask, antialias);
+	}
+
+	template <class S, class M>
+	void rasterize(std::span<const S> shapes, M& mask, bool antialias)
+	{
+		// Tiles own whole rows so threads never write the same cells
+		constexpr uint32_t TILE = 32;
+
+		// Rows of shapes drawn by one thread at least, smaller jobs aren't worth waking the pool
+		constexpr size_t GRAIN_ROWS = 4096;
+
+		const uint32_t tiles = (mask.height + TILE - 1) / TILE;
+		const size_t grain = std::max<size_t>(1, GRAIN_ROWS / std::max<size_t>(shapes.size() * TILE, 1));
+
+		DEF_GEOMETRY2D_TRACE_SCOPE("rasterize", "build");
+
+		utils::parallel_for(tiles, [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("rasterize tiles", "build");
+
+				rasterizer r;
+
+				for (size_t t = begin; t < end; t++)
+				{
+					for (const auto& shape : shapes)
+						r.draw(shape, mask, antialias, uint32_t(t * TILE), uint32_t((t + 1) * TILE));
+				}
+			}, grain);
+	}
+
+	template <class T1, class T2>
+	constexpr double signed_distance(const circle<T1>& c, const vec2d<T2>& p)
+	{
+		const double dx = double(p.x) - double(c.pos.x);
+		const double dy = double(p.y) - double(c.pos.y);
+
+		return utils::sqrt(dx * dx + dy * dy) - double(c.radius);
+	}
+
+	template <class T1, class T2>
+	constexpr double signed_distance(const rect<T1>& r, const vec2d<T2>& p)
+	{
+		const double hx = double(r.size.x) * 0.5;
+		const double hy = double(r.size.y) * 0.5;
+
+		const double dx = utils::abs(double(p.x) - double(r.pos.x) - hx) - hx;
+		const double dy = utils::abs(double(p.y) - double(r.pos.y) - hy) - hy;
+
+		const double ox = std::max(dx, 0.0);
+		const double oy = std::max(dy, 0.0);
+
+		return utils::sqrt(ox * ox + oy * oy) + std::min(std::max(dx, dy), 0.0);
+	}
+
+	template <class T1, class T2>
+	constexpr double signed_distance(const line<T1>& l, const vec2d<T2>& p, double radius)
+	{
+		const double dx = double(l.end.x) - double(l.start.x);
+		const double dy = double(l.end.y) - double(l.start.y);
+		const double px = double(p.x) - double(l.start.x);
+		const double py = double(p.y) - double(l.start.y);
+
+		const double len2 = dx * dx + dy * dy;
+		const double t = len2 > 0.0 ? std::clamp((px * dx + py * dy) / len2, 0.0, 1.0) : 0.0;
+
+		const double ex = px - dx * t;
+		const double ey = py - dy * t;
+
+		return utils::sqrt(ex * ex + ey * ey) - radius;
+	}
+
+	template <class T1, class T2>
+	constexpr double signed_distance(const polygon<T1>& pl, const vec2d<T2>& p)
+	{
+		const auto& v = pl.vertices;
+
+		if (v.empty())
+			return 0.0;
+
+		const double x = double(p.x), y = double(p.y);
+
+		double sqr_dist = std::numeric_limits<double>::max();
+		bool inside = false;
+
+		for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++)
+		{
+			const double ax = double(v[j].x), ay = double(v[j].y);
+			const double ex = double(v[i].x) - ax, ey = double(v[i].y) - ay;
+			const double wx = x - ax, wy = y - ay;
+
+			const double len2 = ex * ex + ey * ey;
+			const double t = len2 > 0.0 ? std::clamp((wx * ex + wy * ey) / len2, 0.0, 1.0) : 0.0;
+
+			const double bx = wx - ex * t;
+			const double by = wy - ey * t;
+
+			sqr_dist = std::min(sqr_dist, bx * bx + by * by);
+
+			if ((ay > y) != (double(v[i].y) > y) && x < ax + (y - ay) * ex / ey)
+				inside = !inside;
+		}
+
+		return inside ? -utils::sqrt(sqr_dist) : utils::sqrt(sqr_dist);
+	}
+
+	inline distance_field::distance_field(uint32_t w, uint32_t h, const vec2d<double>& o, double size) : origin(o), cell_size(size)
+	{
+		resize(w, h);
+	}
+
+	inline void distance_field::resize(uint32_t w, uint32_t h)
+	{
+		width = w;
+		height = h;
+		values.assign(size_t(w) * h, 0.0f);
+	}
+
+	inline float distance_field::at(uint32_t x, uint32_t y) const
+	{
+		return values[size_t(y) * width + x];
+	}
+
+	inline float distance_field::sample(const vec2d<double>& p) const
+	{
+		if (values.empty())
+			return 0.0f;
+
+		const double fx = std::clamp((p.x - origin.x) / cell_size - 0.5, 0.0, double(width - 1));
+		const double fy = std::clamp((p.y - origin.y) / cell_size - 0.5, 0.0, double(height - 1));
+
+		const uint32_t x0 = uint32_t(fx), y0 = uint32_t(fy);
+		const uint32_t x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+
+		const float tx = float(fx - x0), ty = float(fy - y0);
+
+		const float top = std::lerp(at(x0, y0), at(x1, y0), tx);
+		const float bottom = std::lerp(at(x0, y1), at(x1, y1), tx);
+
+		return std::lerp(top, bottom, ty);
+	}
+
+	inline void distance_field::transform(std::vector<double>& grid, uint32_t w, uint32_t h)
+	{
+		// Felzenszwalb-Huttenlocher lower envelope of parabolas along one axis
+		auto pass = [&](uint32_t lines, uint32_t count, size_t line_stride, size_t stride)
+			{
+				utils::parallel_for(lines, [&](size_t begin, size_t end)
+					{
+						DEF_GEOMETRY2D_TRACE_SCOPE("distance transform lines", "build");
+
+						std::vector<double> f(count), d(count);
+						std::vector<uint32_t> v(count);
+						std::vector<double> z(count + 1);
+
+						for (size_t l = begin; l < end; l++)
+						{
+							double* data = grid.data() + l * line_stride;
+
+							for (uint32_t i = 0; i < count; i++)
+								f[i] = data[i * stride];
+
+							uint32_t k = 0;
+
+							v[0] = 0;
+							z[0] = -std::numeric_limits<double>::infinity();
+							z[1] = std::numeric_limits<double>::infinity();
+
+							for (uint32_t q = 1; q < count; q++)
+							{
+								double s;
+
+								// z[0] is -infinity so the loop always stops at k == 0
+								while (true)
+								{
+									const uint32_t r = v[k];
+									s = ((f[q] + double(q) * q) - (f[r] + double(r) * r)) / (2.0 * (double(q) - double(r)));
+
+									if (s > z[k] || k == 0)
+										break;
+
+									k--;
+								}
+
+								k++;
+								v[k] = q;
+								z[k] = s;
+								z[k + 1] = std::numeric_limits<double>::infinity();
+							}
+
+							k = 0;
+
+							for (uint32_t q = 0; q < count; q++)
+							{
+								while (z[k + 1] < double(q))
+									k++;
+
+								const double diff = double(q) - double(v[k]);
+								d[q] = diff * diff + f[v[k]];
+							}
+
+							for (uint32_t i = 0; i < count; i++)
+								data[i * stride] = d[i];
+						}
+					}, 16);
+			};
+
+		pass(w, h, 1, w);
+		pass(h, w, w, 1);
+	}
+
+	template <class S>
+	void build_distance_field(std::span<const S> shapes, uint32_t width, uint32_t height, distance_field& field)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("build distance field", "build");
+
+		field.resize(width, height);
+
+		utils::parallel_for(field.height, [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("distance field rows", "build");
+
+				for (size_t y = begin; y < end; y++)
+				{
+					for (uint32_t x = 0; x < field.width; x++)
+					{
+						const vec2d<double> p = field.origin + vec2d<double>(x + 0.5, y + 0.5) * field.cell_size;
+
+						double dist = std::numeric_limits<double>::max();
+
+						for (const auto& shape : shapes)
+							dist = std::min(dist, signed_distance(shape, p));
+
+						field.values[y * field.width + x] = float(dist);
+					}
+				}
+			}, 8);
+	}
+
+	inline void build_distance_field(const bit_mask& mask, distance_field& field)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("build distance field", "build");
+
+		field.resize(mask.width, mask.height);
+
+		// Squared distances between centers to the closest set and the closest unset cell, the sentinel is larger than
+		// any squared distance within the grid and small enough to keep sums with squared offsets exact
+		const double far = double(mask.width) * mask.width + double(mask.height) * mask.height + 1.0;
+
+		std::vector<double> outside(field.values.size()), inside(field.values.size());
+
+		for (uint32_t y = 0; y < mask.height; y++)
+		{
+			for (uint32_t x = 0; x < mask.width; x++)
+			{
+				const bool set = mask.at(x, y);
+				const size_t i = size_t(y) * mask.width + x;
+
+				outside[i] = set ? 0.0 : far;
+				inside[i] = set ? far : 0.0;
+			}
+		}
+
+		distance_field::transform(outside, mask.width, mask.height);
+		distance_field::transform(inside, mask.width, mask.height);
+
+		// One of the distances is zero, the other one is at least a cell and the boundary is half a cell closer
+		for (size_t i = 0; i < field.values.size(); i++)
+		{
+			const double d = outside[i] > 0.0 ? std::sqrt(outside[i]) - 0.5 : 0.5 - std::sqrt(inside[i]);
+			field.values[i] = float(d * field.cell_size);
+		}
+	}
+
+#ifdef DEF_GEOMETRY2D_INSTRUMENT
+	constexpr instrument::probe::probe(probe_id i) : id(i)
+	{
+		if (std::is_constant_evaluated())
+			return;
+
+		outer = depth()++ == 0;
+
+		if (outer)
+			start = now();
+	}
+
+	constexpr instrument::probe::~probe()
+	{
+		if (std::is_constant_evaluated())
+			return;
+
+		depth()--;
+
+		if (!outer)
+			return;
+
+		const uint64_t cycles = now() - start;
+		auto& values = local().values[id];
+
+		auto add = [](std::atomic<uint64_t>& value, uint64_t amount)
+			{
+				// Only the owning thread writes so there is no need for a locked add
+				value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+			};
+
+		add(values[0], 1);
+		add(values[1], hit ? 1 : 0);
+		add(values[2], early ? 1 : 0);
+		add(values[3], cycles);
+	}
+
+	constexpr bool instrument::probe::result(bool h)
+	{
+		hit = h;
+		return h;
+	}
+
+	constexpr bool instrument::probe::early_out(bool h)
+	{
+		early = true;
+		return result(h);
+	}
+
+	inline const char* instrument::name(probe_id id)
+	{
+		static constexpr const char* NAMES[PROBE_COUNT] =
+		{
+				"contains(point, point)",
+				"contains(circle, point)",
+				"contains(rect, point)",
+				"contains(rect, rect)",
+				"contains(rect, line)",
+				"contains(rect, circle)",
+				"contains(line, line)",
+				"contains(line, point)",
+				"contains(circle, circle)",
+				"contains(circle, line)",
+				"contains(circle, rect)",
+				"intersects(point, point)",
+				"intersects(point, line)",
+				"intersects(point, rect)",
+				"intersects(point, circle)",
+				"intersects(circle, point)",
+				"intersects(rect, point)",
+				"intersects(rect, rect)",
+				"intersects(rect, circle)",
+				"intersects(line, line)",
+				"intersects(line, rect)",
+				"intersects(line, circle)",
+				"intersects(rect, line)",
+				"intersects(line, point)",
+				"intersects(circle, circle)",
+				"intersects(circle, line)",
+				"intersects(circle, rect)",
+				"contains(triangle, point)",
+		};
+
+		return id < PROBE_COUNT ? NAMES[id] : "unknown";
+	}
+
+	inline uint64_t instrument::now()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	namespace instrument
+	{
+		struct registry
+		{
+			std::mutex lock;
+
+			// Blocks are only added when no free block is left, so their number is the peak number of live threads
+			std::deque<thread_counters> threads;
+			std::vector<thread_counters*> free_blocks;
+
+			// Counts of threads that have exited
+			counters retired[PROBE_COUNT];
+		};
+
+		inline registry& get_registry()
+		{
+			static registry r;
+			return r;
+		}
+	}
+
+	inline instrument::thread_lease::thread_lease()
+	{
+		auto& r = get_registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+
+		if (r.free_blocks.empty())
+			counters = &r.threads.emplace_back();
+		else
+		{
+			counters = r.free_blocks.back();
+			r.free_blocks.pop_back();
+		}
+	}
+
+	inline instrument::thread_lease::~thread_lease()
+	{
+		auto& r = get_registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+
+		for (size_t i = 0; i < PROBE_COUNT; i++)
+		{
+			auto& values = counters->values[i];
+
+			r.retired[i].calls += values[0].exchange(0, std::memory_order_relaxed);
+			r.retired[i].hits += values[1].exchange(0, std::memory_order_relaxed);
+			r.retired[i].early_outs += values[2].exchange(0, std::memory_order_relaxed);
+			r.retired[i].cycles += values[3].exchange(0, std::memory_order_relaxed);
+		}
+
+		r.free_blocks.push_back(counters);
+	}
+
+	inline uint32_t& instrument::depth()
+	{
+		static thread_local uint32_t probes = 0;
+		return probes;
+	}
+
+	inline instrument::thread_counters& instrument::local()
+	{
+		// The registry is created before the first lease, so it is destroyed after the lease of the main thread
+		get_registry();
+
+		thread_local thread_lease lease;
+		return *lease.counters;
+	}
+
+	inline void instrument::collect(std::vector<counters>& result)
+	{
+		auto& r = get_registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+
+		result.assign(std::begin(r.retired), std::end(r.retired));
+
+		// Free blocks are zeroed when they are returned, so summing all blocks doesn't count anything twice
+		for (const auto& thread : r.threads)
+		{
+			for (size_t i = 0; i < PROBE_COUNT; i++)
+			{
+				result[i].calls += thread.values[i][0].load(std::memory_order_relaxed);
+				result[i].hits += thread.values[i][1].load(std::memory_order_relaxed);
+				result[i].early_outs += thread.values[i][2].load(std::memory_order_relaxed);
+				result[i].cycles += thread.values[i][3].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	inline void instrument::reset()
+	{
+		auto& r = get_registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+
+		for (auto& c : r.retired)
+			c = counters{};
+
+		for (auto& thread : r.threads)
+		{
+			for (auto& probe_values : thread.values)
+			{
+				for (auto& value : probe_values)
+					value.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	inline std::string instrument::dump_text()
+	{
+		std::vector<counters> result;
+		collect(result);
+
+		std::string text = "overload calls hits early_outs cycles\n";
+
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			const auto& c = result[i];
+
+			if (c.calls == 0)
+				continue;
+
+			text += std::string(name(probe_id(i))) + " " + std::to_string(c.calls) + " " + std::to_string(c.hits) + " " +
+				std::to_string(c.early_outs) + " " + std::to_string(c.cycles) + "\n";
+		}
+
+		return text;
+	}
+
+	inline std::string instrument::dump_json()
+	{
+		std::vector<counters> result;
+		collect(result);
+
+		std::string json = "{";
+		bool first = true;
+
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			const auto& c = result[i];
+
+			if (c.calls == 0)
+				continue;
+
+			if (!first)
+				json += ",";
+
+			json += "\"" + std::string(name(probe_id(i))) + "\":{\"calls\":" + std::to_string(c.calls) +
+				",\"hits\":" + std::to_string(c.hits) + ",\"early_outs\":" + std::to_string(c.early_outs) +
+				",\"cycles\":" + std::to_string(c.cycles) + "}";
+
+			first = false;
+		}
+
+		return json + "}";
+	}
+#endif
+
+#ifdef DEF_GEOMETRY2D_TRACE
+	inline trace::scope::scope(const char* n, const char* c) : name(n), category(c), begin(now())
+	{
+
+	}
+
+	inline trace::scope::~scope()
+	{
+		auto& r = local();
+
+		const uint64_t head = r.head.load(std::memory_order_relaxed);
+
+		if (head - r.tail.load(std::memory_order_acquire) >= ring::CAPACITY)
+		{
+			r.dropped.store(r.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+
+		r.events[head % ring::CAPACITY] = { name, category, begin, now(), r.thread };
+		r.head.store(head + 1, std::memory_order_release);
+	}
+
+	inline uint64_t trace::now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	namespace trace
+	{
+		struct registry
+		{
+			std::mutex lock;
+
+			// Rings are only added when no free ring is left, so their number is the peak number of live threads
+			std::deque<ring> rings;
+			std::vector<ring*> free_rings;
+		};
+
+		inline registry& get_registry()
+		{
+			static registry r;
+			return r;
+		}
+	}
+
+	inline trace::ring_lease::ring_lease()
+	{
+		auto& reg = get_registry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+
+		if (reg.free_rings.empty())
+		{
+			owned = &reg.rings.emplace_back();
+			owned->thread = uint32_t(reg.rings.size());
+		}
+		else
+		{
+			owned = reg.free_rings.back();
+			reg.free_rings.pop_back();
+		}
+	}
+
+	inline trace::ring_lease::~ring_lease()
+	{
+		auto& reg = get_registry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+
+		reg.free_rings.push_back(owned);
+	}
+
+	inline trace::ring& trace::local()
+	{
+		// The registry is created before the first lease, so it is destroyed after the lease of the main thread
+		get_registry();
+
+		thread_local ring_lease lease;
+		return *lease.owned;
+	}
+
+	inline void trace::drain(std::vector<event>& out)
+	{
+		auto& reg = get_registry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+
+		for (auto& r : reg.rings)
+		{
+			const uint64_t head = r.head.load(std::memory_order_acquire);
+			uint64_t tail = r.tail.load(std::memory_order_relaxed);
+
+			for (; tail != head; tail++)
+				out.push_back(r.events[tail % ring::CAPACITY]);
+
+			r.tail.store(tail, std::memory_order_release);
+		}
+	}
+
+	inline uint64_t trace::dropped()
+	{
+		auto& reg = get_registry();
+		std::lock_guard<std::mutex> guard(reg.lock);
+
+		uint64_t sum = 0;
+
+		for (const auto& r : reg.rings)
+			sum += r.dropped.load(std::memory_order_relaxed);
+
+		return sum;
+	}
+
+	inline std::string trace::to_chrome_json(const std::vector<event>& events)
+	{
+		std::string json = "{\"traceEvents\":[";
+
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const auto& e = events[i];
+
+			// Chrome expects microseconds
+			auto micros = [](uint64_t ns) { return std::to_string(ns / 1000) + "." + std::to_string(ns % 1000 / 100); };
+
+			if (i > 0)
+				json += ",";
+
+			json += "{\"name\":\"" + std::string(e.name) + "\",\"cat\":\"" + std::string(e.category) +
+				"\",\"ph\":\"X\",\"ts\":" + micros(e.begin) + ",\"dur\":" + micros(e.end - e.begin) +
+				",\"pid\":1,\"tid\":" + std::to_string(e.thread) + "}";
+		}
+
+		return json + "]}";
+	}
+#endif
+
+	template <class T>
+	uint64_t pair_cache<T>::key(uint32_t a, uint32_t b)
+	{
+		return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	template <class T>
+	void pair_cache<T>::begin_frame()
+	{
+		events.clear();
+		reused = 0;
+		recomputed = 0;
+		frame++;
+	}
+
+	template <class T>
+	template <class F>
+	bool pair_cache<T>::test(uint32_t a, uint32_t version_a, uint32_t b, uint32_t version_b, F&& test)
+	{
+		auto [it, created] = entries.try_emplace(key(a, b));
+		auto& e = it->second;
+
+		const bool was_touching = !created && e.touching;
+
+		const uint32_t low = a < b ? version_a : version_b;
+		const uint32_t high = a < b ? version_b : version_a;
+
+		if (created || e.version_a != low || e.version_b != high)
+		{
+			e.version_a = low;
+			e.version_b = high;
+			e.touching = test(e.intersections);
+
+			recomputed++;
+		}
+		else
+			reused++;
+
+		e.frame = frame;
+
+		if (e.touching)
+			events.push_back({ a, b, was_touching ? CONTACT_PERSIST : CONTACT_BEGIN });
+		else if (was_touching)
+			events.push_back({ a, b, CONTACT_END });
+
+		return e.touching;
+	}
+
+	template <class T>
+	template <class S1, class S2>
+	bool pair_cache<T>::intersects(uint32_t a, uint32_t version_a, const S1& s1, uint32_t b, uint32_t version_b, const S2& s2)
+	{
+		return test(a, version_a, b, version_b, [&](std::vector<vec2d<T>>& intersections)
+			{
+				return def::intersects(s1, s2, intersections);
+			});
+	}
+
+	template <class T>
+	void pair_cache<T>::end_frame()
+	{
+		for (auto it = entries.begin(); it != entries.end();)
+		{
+			if (it->second.frame == frame)
+			{
+				++it;
+				continue;
+			}
+
+			if (it->second.touching)
+				events.push_back({ uint32_t(it->first >> 32), uint32_t(it->first), CONTACT_END });
+
+			it = entries.erase(it);
+		}
+	}
+
+	template <class T>
+	const std::vector<vec2d<T>>* pair_cache<T>::intersections(uint32_t a, uint32_t b) const
+	{
+		auto it = entries.find(key(a, b));
+		return it == entries.end() ? nullptr : &it->second.intersections;
+	}
+
+	template <class T>
+	void shape_store<T>::mark_dirty(uint32_t index)
+	{
+		auto& s = slots[index];
+
+		s.version++;
+		index_stale = true;
+
+		if (!s.dirty)
+		{
+			s.dirty = true;
+			s.existed = s.alive;
+
+			if (s.alive)
+				s.committed = bounds(s.value);
+
+			dirty.push_back(index);
+		}
+	}
+
+	template <class T>
+	shape_handle shape_store<T>::handle(uint32_t index) const
+	{
+		const auto& s = slots[index];
+		return { index, s.alive ? s.generation : s.generation - 1 };
+	}
+
+	template <class T>
+	template <class S>
+	shape_handle shape_store<T>::add(const S& s)
+	{
+		uint32_t index;
+
+		if (free_slots.empty())
+		{
+			index = (uint32_t)slots.size();
+			slots.emplace_back();
+		}
+		else
+		{
+			index = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		mark_dirty(index);
+
+		auto& sl = slots[index];
+
+		sl.value = s;
+		sl.alive = true;
+
+		return { index, sl.generation };
+	}
+
+	template <class T>
+	template <class S>
+	bool shape_store<T>::update(shape_handle h, const S& s)
+	{
+		if (!valid(h))
+			return false;
+
+		mark_dirty(h.index);
+		slots[h.index].value = s;
+
+		return true;
+	}
+
+	template <class T>
+	bool shape_store<T>::remove(shape_handle h)
+	{
+		if (!valid(h))
+			return false;
+
+		mark_dirty(h.index);
+
+		// The value stays in the slot until the next commit so removed shapes can still be reported
+		auto& s = slots[h.index];
+
+		s.alive = false;
+		s.generation++;
+
+		return true;
+	}
+
+	template <class T>
+	bool shape_store<T>::valid(shape_handle h) const
+	{
+		return h.index < slots.size() && slots[h.index].alive && slots[h.index].generation == h.generation;
+	}
+
+	template <class T>
+	template <class S>
+	const S* shape_store<T>::get(shape_handle h) const
+	{
+		return valid(h) ? std::get_if<S>(&slots[h.index].value) : nullptr;
+	}
+
+	template <class T>
+	uint32_t shape_store<T>::version(shape_handle h) const
+	{
+		return valid(h) ? slots[h.index].version : 0;
+	}
+
+	template <class T>
+	void shape_store<T>::commit()
+	{
+		// Removed slots are reused only after a commit so handles of removed shapes stay unique until then
+		for (uint32_t index : dirty)
+		{
+			slots[index].dirty = false;
+
+			if (!slots[index].alive)
+				free_slots.push_back(index);
+		}
+
+		dirty.clear();
+		index_stale = true;
+	}
+
+	template <class T>
+	bool shape_store<T>::overlaps(const shape& s, const rect<T>& r)
+	{
+		if (auto c = std::get_if<circle<T>>(&s))
+		{
+			const auto p = c->pos.clamp(r.pos, r.bottom_right());
+			return (c->pos - p).mag2() <= c->radius * c->radius;
+		}
+
+		if (auto rc = std::get_if<rect<T>>(&s))
+		{
+			const auto a = rc->bottom_right();
+			const auto b = r.bottom_right();
+
+			return rc->pos.x <= b.x && r.pos.x <= a.x && rc->pos.y <= b.y && r.pos.y <= a.y;
+		}
+
+		double t0, t1;
+		return clip(std::get<line<T>>(s), r, t0, t1);
+	}
+
+	template <class T>
+	rect<double> shape_store<T>::bounds(const shape& s)
+	{
+		if (auto c = std::get_if<circle<T>>(&s))
+		{
+			const double r = double(c->radius);
+			return rect<double>({ double(c->pos.x) - r, double(c->pos.y) - r }, { r * 2.0, r * 2.0 });
+		}
+
+		if (auto r = std::get_if<rect<T>>(&s))
+			return rect<double>({ double(r->pos.x), double(r->pos.y) }, { double(r->size.x), double(r->size.y) });
+
+		const auto& l = std::get<line<T>>(s);
+
+		const vec2d<double> a(double(l.start.x), double(l.start.y));
+		const vec2d<double> b(double(l.end.x), double(l.end.y));
+
+		return rect<double>(a.min(b), a.max(b) - a.min(b));
+	}
+
+	template <class T>
+	void shape_store<T>::dirty_in(const rect<T>& r, std::vector<shape_handle>& out)
+	{
+		if (index_stale)
+		{
+			// A moved shape is indexed by the union of its old and new bounds
+			dirty_bounds.resize(dirty.size());
+
+			for (size_t i = 0; i < dirty.size(); i++)
+			{
+				const auto& s = slots[dirty[i]];
+
+				rect<double> b = s.existed ? s.committed : bounds(s.value);
+
+				if (s.existed && s.alive)
+				{
+					const rect<double> now = bounds(s.value);
+					const vec2d<double> lo = b.pos.min(now.pos);
+
+					b = rect<double>(lo, (b.pos + b.size).max(now.pos + now.size) - lo);
+				}
+
+				dirty_bounds[i] = b;
+			}
+
+			dirty_index.build(dirty_bounds);
+			index_stale = false;
+		}
+
+		const rect<double> area({ double(r.pos.x), double(r.pos.y) }, { double(r.size.x), double(r.size.y) });
+
+		dirty_index.query(area, [&](uint32_t i)
+			{
+				const uint32_t index = dirty[i];
+				const auto& s = slots[index];
+
+				bool hit = s.alive && overlaps(s.value, r);
+
+				// Only bounds of the old shape are kept, so where it was is tested with them
+				if (!hit && s.existed)
+				{
+					const rect<double>& b = s.committed;
+					hit = b.pos.x <= area.pos.x + area.size.x && area.pos.x <= b.pos.x + b.size.x &&
+						b.pos.y <= area.pos.y + area.size.y && area.pos.y <= b.pos.y + b.size.y;
+				}
+
+				if (hit)
+					out.push_back(handle(index));
+			});
+	}
+
+	template <class T>
+	template <class F>
+	void shape_store<T>::for_each_dirty(F&& func) const
+	{
+		for (uint32_t index : dirty)
+			func(handle(index), slots[index].value);
+	}
+
+	template <class T>
+	template <class F>
+	void shape_store<T>::for_each(F&& func) const
+	{
+		for (uint32_t index = 0; index < slots.size(); index++)
+		{
+			const auto& s = slots[index];
+
+			if (s.alive)
+				func(shape_handle{ index, s.generation }, s.value);
+		}
+	}
+
+	template <class A>
+	std::pmr::memory_resource* utils::resource_of(const A& alloc)
+	{
+		if constexpr (std::is_convertible_v<A, std::pmr::polymorphic_allocator<typename A::value_type>>)
+			return alloc.resource();
+		else
+			return std::pmr::get_default_resource();
+	}
+
+	inline frame_arena::frame_arena(size_t capacity, std::pmr::memory_resource* up) : size(capacity), owns_block(true), upstream(up)
+	{
+		block = static_cast<std::byte*>(::operator new(capacity, std::align_val_t(alignof(std::max_align_t))));
+	}
+
+	inline frame_arena::frame_arena(void* buffer, size_t capacity, std::pmr::memory_resource* up) : block(static_cast<std::byte*>(buffer)), size(capacity), upstream(up)
+	{
+
+	}
+
+	inline frame_arena::~frame_arena()
+	{
+		reset();
+
+		if (owns_block)
+			::operator delete(block, std::align_val_t(alignof(std::max_align_t)));
+	}
+
+	inline void frame_arena::reset()
+	{
+		while (overflow)
+		{
+			overflow_block* next = overflow->next;
+			upstream->deallocate(overflow, overflow->bytes, overflow->alignment);
+			overflow = next;
+		}
+
+		offset = 0;
+	}
+
+	inline size_t frame_arena::used() const
+	{
+		return offset;
+	}
+
+	inline size_t frame_arena::capacity() const
+	{
+		return size;
+	}
+
+	inline void* frame_arena::do_allocate(size_t bytes, size_t alignment)
+	{
+		const uintptr_t base = reinterpret_cast<uintptr_t>(block);
+		const uintptr_t aligned = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+
+		if (aligned + bytes <= base + size)
+		{
+			offset = aligned + bytes - base;
+			return reinterpret_cast<void*>(aligned);
+		}
+
+		// The header keeps the block in a list so reset can give it back
+		const size_t header = (sizeof(overflow_block) + alignment - 1) & ~(alignment - 1);
+		const size_t total = header + bytes;
+		const size_t block_alignment = std::max(alignment, alignof(overflow_block));
+
+		auto ptr = static_cast<std::byte*>(upstream->allocate(total, block_alignment));
+
+		overflow = new (ptr) overflow_block{ overflow, total, block_alignment };
+
+		return ptr + header;
+	}
+
+	inline void frame_arena::do_deallocate(void*, size_t, size_t)
+	{
+		// Memory is only released by reset
+	}
+
+	inline bool frame_arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+	{
+		return this == &other;
+	}
+
+	inline void contact_manifold::flip()
+	{
+		normal = { -normal.x, -normal.y };
+
+		for (uint8_t i = 0; i < count; i++)
+			features[i] = features[i] >> 16 | features[i] << 16;
+	}
+
+	inline void contact_buffer::clear()
+	{
+		body_a.clear();
+		body_b.clear();
+		normal_x.clear();
+		normal_y.clear();
+		count.clear();
+
+		for (uint8_t i = 0; i < 2; i++)
+		{
+			point_x[i].clear();
+			point_y[i].clear();
+			depth[i].clear();
+			feature[i].clear();
+		}
+	}
+
+	inline size_t contact_buffer::size() const
+	{
+		return body_a.size();
+	}
+
+	inline void contact_buffer::push(uint32_t a, uint32_t b, const contact_manifold& m)
+	{
+		body_a.push_back(a);
+		body_b.push_back(b);
+		normal_x.push_back(m.normal.x);
+		normal_y.push_back(m.normal.y);
+		count.push_back(m.count);
+
+		for (uint8_t i = 0; i < 2; i++)
+		{
+			const bool used = i < m.count;
+
+			point_x[i].push_back(used ? m.points[i].x : 0.0);
+			point_y[i].push_back(used ? m.points[i].y : 0.0);
+			depth[i].push_back(used ? m.depths[i] : 0.0);
+			feature[i].push_back(used ? m.features[i] : 0);
+		}
+	}
+
+	constexpr uint32_t contact_feature(uint32_t index_a, feature_type type_a, uint32_t index_b, feature_type type_b)
+	{
+		return (index_a & 0x7FFF) << 17 | uint32_t(type_a) << 16 | (index_b & 0x7FFF) << 1 | uint32_t(type_b);
+	}
+
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c1, const circle<T2>& c2, contact_manifold& m)
+	{
+		m.count = 0;
+
+		const double dx = double(c2.pos.x) - double(c1.pos.x);
+		const double dy = double(c2.pos.y) - double(c1.pos.y);
+		const double r1 = double(c1.radius), r2 = double(c2.radius);
+
+		const double sqr_dist = dx * dx + dy * dy;
+
+		if (sqr_dist > (r1 + r2) * (r1 + r2))
+			return false;
+
+		const double dist = std::sqrt(sqr_dist);
+
+		// Concentric circles are pushed apart along x
+		m.normal = dist > 0.0 ? vec2d<double>(dx / dist, dy / dist) : vec2d<double>(1.0, 0.0);
+
+		// The point lies halfway between the surfaces
+		const double offset = (r1 + dist - r2) * 0.5;
+
+		m.points[0] = { double(c1.pos.x) + m.normal.x * offset, double(c1.pos.y) + m.normal.y * offset };
+		m.depths[0] = r1 + r2 - dist;
+		m.features[0] = contact_feature(0, FEATURE_VERTEX, 0, FEATURE_VERTEX);
+		m.count = 1;
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const rect<T2>& r, contact_manifold& m)
+	{
+		m.count = 0;
+
+		const double cx = double(c.pos.x), cy = double(c.pos.y);
+		const double radius = double(c.radius);
+
+		const double x0 = double(r.pos.x), y0 = double(r.pos.y);
+		const double x1 = x0 + double(r.size.x), y1 = y0 + double(r.size.y);
+
+		const double qx = std::clamp(cx, x0, x1);
+		const double qy = std::clamp(cy, y0, y1);
+
+		if (qx == cx && qy == cy)
+		{
+			// The center is inside, so the circle leaves through the nearest side
+			// Indexed by side
+			const double dists[4] = { cx - x0, cy - y0, x1 - cx, y1 - cy };
+			const double outward[4][2] = { { -1.0, 0.0 }, { 0.0, -1.0 }, { 1.0, 0.0 }, { 0.0, 1.0 } };
+
+			uint32_t nearest = 0;
+
+			for (uint32_t i = 1; i < 4; i++)
+			{
+				if (dists[i] < dists[nearest])
+					nearest = i;
+			}
+
+			const double offset = (dists[nearest] - radius) * 0.5;
+
+			m.normal = { -outward[nearest][0], -outward[nearest][1] };
+			m.points[0] = { cx + outward[nearest][0] * offset, cy + outward[nearest][1] * offset };
+			m.depths[0] = radius + dists[nearest];
+			m.features[0] = contact_feature(0, FEATURE_VERTEX, nearest, FEATURE_EDGE);
+			m.count = 1;
+
+			return true;
+		}
+
+		const double dx = qx - cx, dy = qy - cy;
+		const double sqr_dist = dx * dx + dy * dy;
+
+		if (sqr_dist > radius * radius)
+			return false;
+
+		const double dist = std::sqrt(sqr_dist);
+		const double offset = (radius + dist) * 0.5;
+
+		m.normal = { dx / dist, dy / dist };
+		m.points[0] = { cx + m.normal.x * offset, cy + m.normal.y * offset };
+		m.depths[0] = radius - dist;
+
+		const bool clamped_x = qx != cx, clamped_y = qy != cy;
+
+		if (clamped_x && clamped_y)
+		{
+			const uint32_t corner = qy == y0 ? (qx == x0 ? 1 : 2) : (qx == x1 ? 3 : 0);
+			m.features[0] = contact_feature(0, FEATURE_VERTEX, corner, FEATURE_VERTEX);
+		}
+		else
+		{
+			const side s = clamped_y ? (qy == y0 ? SIDE_TOP : SIDE_BOTTOM) : (qx == x1 ? SIDE_RIGHT : SIDE_LEFT);
+			m.features[0] = contact_feature(0, FEATURE_VERTEX, s, FEATURE_EDGE);
+		}
+
+		m.count = 1;
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r, const circle<T2>& c, contact_manifold& m)
+	{
+		if (!collide(c, r, m))
+			return false;
+
+		m.flip();
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r1, const rect<T2>& r2, contact_manifold& m)
+	{
+		m.count = 0;
+
+		const double min1[2] = { double(r1.pos.x), double(r1.pos.y) };
+		const double max1[2] = { min1[0] + double(r1.size.x), min1[1] + double(r1.size.y) };
+		const double min2[2] = { double(r2.pos.x), double(r2.pos.y) };
+		const double max2[2] = { min2[0] + double(r2.size.x), min2[1] + double(r2.size.y) };
+
+		const double overlap_x = std::min(max1[0], max2[0]) - std::max(min1[0], min2[0]);
+		const double overlap_y = std::min(max1[1], max2[1]) - std::max(min1[1], min2[1]);
+
+		if (overlap_x < 0.0 || overlap_y < 0.0)
+			return false;
+
+		// The axis of the smallest overlap separates the rectangles
+		const uint32_t axis = overlap_x <= overlap_y ? 0 : 1;
+		const uint32_t other = 1 - axis;
+
+		const bool positive = min2[axis] + max2[axis] >= min1[axis] + max1[axis];
+
+		// Reference side of r1, incident side of r2 and corners at the low and high ends of the other axis
+		static constexpr uint32_t SIDES[2][2][2] =
+		{
+			{ { SIDE_LEFT, SIDE_RIGHT }, { SIDE_RIGHT, SIDE_LEFT } },
+			{ { SIDE_TOP, SIDE_BOTTOM }, { SIDE_BOTTOM, SIDE_TOP } }
+		};
+		static constexpr uint32_t CORNERS[2][2][2] = { { { 1, 0 }, { 2, 3 } }, { { 1, 2 }, { 0, 3 } } };
+
+		const uint32_t side1 = SIDES[axis][positive][0];
+		const uint32_t side2 = SIDES[axis][positive][1];
+
+		const double face = positive ? (max1[axis] + min2[axis]) * 0.5 : (min1[axis] + max2[axis]) * 0.5;
+
+		m.normal = axis == 0 ? vec2d<double>(positive ? 1.0 : -1.0, 0.0) : vec2d<double>(0.0, positive ? 1.0 : -1.0);
+
+		const double low = std::max(min1[other], min2[other]);
+		const double high = std::min(max1[other], max2[other]);
+
+		for (uint32_t end = 0; end < 2; end++)
+		{
+			const double t = end == 0 ? low : high;
+
+			if (end == 1 && high == low)
+				break;
+
+			// The end comes from a corner of r2 unless r1 is narrower there
+			const bool from2 = end == 0 ? min2[other] >= min1[other] : max2[other] <= max1[other];
+
+			m.points[end] = axis == 0 ? vec2d<double>(face, t) : vec2d<double>(t, face);
+			m.depths[end] = axis == 0 ? overlap_x : overlap_y;
+			m.features[end] = from2 ?
+				contact_feature(side1, FEATURE_EDGE, CORNERS[axis][positive ? 0 : 1][end], FEATURE_VERTEX) :
+				contact_feature(CORNERS[axis][positive ? 1 : 0][end], FEATURE_VERTEX, side2, FEATURE_EDGE);
+
+			m.count++;
+		}
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const line<T2>& l, contact_manifold& m)
+	{
+		m.count = 0;
+
+		const double cx = double(c.pos.x), cy = double(c.pos.y);
+		const double radius = double(c.radius);
+
+		const double ax = double(l.start.x), ay = double(l.start.y);
+		const double ex = double(l.end.x) - ax, ey = double(l.end.y) - ay;
+
+		const double len2 = ex * ex + ey * ey;
+		const double t = len2 > 0.0 ? std::clamp(((cx - ax) * ex + (cy - ay) * ey) / len2, 0.0, 1.0) : 0.0;
+
+		const double dx = ax + ex * t - cx;
+		const double dy = ay + ey * t - cy;
+		const double sqr_dist = dx * dx + dy * dy;
+
+		if (sqr_dist > radius * radius)
+			return false;
+
+		const double dist = std::sqrt(sqr_dist);
+
+		if (dist > 0.0)
+			m.normal = { dx / dist, dy / dist };
+		else if (len2 > 0.0)
+		{
+			const double len = std::sqrt(len2);
+			m.normal = { -ey / len, ex / len };
+		}
+		else
+			m.normal = { 1.0, 0.0 };
+
+		const double offset = (radius + dist) * 0.5;
+
+		m.points[0] = { cx + m.normal.x * offset, cy + m.normal.y * offset };
+		m.depths[0] = radius - dist;
+
+		if (t <= 0.0 || t >= 1.0)
+			m.features[0] = contact_feature(0, FEATURE_VERTEX, t <= 0.0 ? 0 : 1, FEATURE_VERTEX);
+		else
+			m.features[0] = contact_feature(0, FEATURE_VERTEX, 0, FEATURE_EDGE);
+
+		m.count = 1;
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const line<T1>& l, const circle<T2>& c, contact_manifold& m)
+	{
+		if (!collide(c, l, m))
+			return false;
+
+		m.flip();
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(std::span<const vec2d<T1>> a, std::span<const vec2d<T2>> b, contact_manifold& m)
+	{
+		m.count = 0;
+
+		if (a.size() < 3 || b.size() < 3)
+			return false;
+
+		// Outward normals depend on the winding of the ring
+		auto winding = [](const auto& ring)
+			{
+				double sum = 0.0;
+
+				for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+					sum += double(ring[j].x) * double(ring[i].y) - double(ring[i].x) * double(ring[j].y);
+
+				return sum < 0.0 ? -1.0 : 1.0;
+			};
+
+		auto normal = [](const auto& ring, size_t i, double sign)
+			{
+				const auto& p = ring[i];
+				const auto& q = ring[(i + 1) % ring.size()];
+
+				const double ex = double(q.x) - double(p.x);
+				const double ey = double(q.y) - double(p.y);
+				const double len = std::sqrt(ex * ex + ey * ey);
+
+				return len > 0.0 ? vec2d<double>(sign * ey / len, -sign * ex / len) : vec2d<double>();
+			};
+
+		// Finds the edge of p along which q is the most separated
+		auto max_separation = [&](const auto& p, double sign, const auto& q, size_t& edge)
+			{
+				double best = -std::numeric_limits<double>::max();
+
+				for (size_t i = 0; i < p.size(); i++)
+				{
+					const vec2d<double> n = normal(p, i, sign);
+					double sep = std::numeric_limits<double>::max();
+
+					for (size_t j = 0; j < q.size(); j++)
+						sep = std::min(sep, n.x * (double(q[j].x) - double(p[i].x)) + n.y * (double(q[j].y) - double(p[i].y)));
+
+					if (sep > best)
+					{
+						best = sep;
+						edge = i;
+					}
+				}
+
+				return best;
+			};
+
+		const double sign_a = winding(a), sign_b = winding(b);
+
+		size_t edge_a = 0, edge_b = 0;
+
+		const double sep_a = max_separation(a, sign_a, b, edge_a);
+
+		if (sep_a > 0.0)
+			return false;
+
+		const double sep_b = max_separation(b, sign_b, a, edge_b);
+
+		if (sep_b > 0.0)
+			return false;
+
+		// Clips the most anti-parallel edge of inc by the side planes of the reference edge
+		auto build = [&](const auto& ref, double ref_sign, size_t ref_edge, const auto& inc, double inc_sign)
+			{
+				const vec2d<double> n = normal(ref, ref_edge, ref_sign);
+
+				size_t inc_edge = 0;
+				double min_dot = std::numeric_limits<double>::max();
+
+				for (size_t i = 0; i < inc.size(); i++)
+				{
+					const double d = normal(inc, i, inc_sign).dot(n);
+
+					if (d < min_dot)
+					{
+						min_dot = d;
+						inc_edge = i;
+					}
+				}
+
+				const size_t ref_next = (ref_edge + 1) % ref.size();
+				const size_t inc_next = (inc_edge + 1) % inc.size();
+
+				const vec2d<double> v1(double(ref[ref_edge].x), double(ref[ref_edge].y));
+				const vec2d<double> v2(double(ref[ref_next].x), double(ref[ref_next].y));
+				const vec2d<double> tangent(-n.y * ref_sign, n.x * ref_sign);
+
+				vec2d<double> points[2] =
+				{
+					{ double(inc[inc_edge].x), double(inc[inc_edge].y) },
+					{ double(inc[inc_next].x), double(inc[inc_next].y) }
+				};
+
+				uint32_t features[2] =
+				{
+					contact_feature(uint32_t(ref_edge), FEATURE_EDGE, uint32_t(inc_edge), FEATURE_VERTEX),
+					contact_feature(uint32_t(ref_edge), FEATURE_EDGE, uint32_t(inc_next), FEATURE_VERTEX)
+				};
+
+				// Keeps the part of the segment where dot(plane, p) <= offset
+				auto clip_segment = [&](const vec2d<double>& plane, double offset, size_t ref_vertex)
+					{
+						const double d0 = plane.dot(points[0]) - offset;
+						const double d1 = plane.dot(points[1]) - offset;
+
+						if (d0 > 0.0 && d1 > 0.0)
+							return false;
+
+						if (d0 * d1 < 0.0)
+						{
+							const uint32_t i = d0 > 0.0 ? 0 : 1;
+							const double t = d0 / (d0 - d1);
+
+							points[i] = points[0] + (points[1] - points[0]) * t;
+							features[i] = contact_feature(uint32_t(ref_vertex), FEATURE_VERTEX, uint32_t(inc_edge), FEATURE_EDGE);
+						}
+
+						return true;
+					};
+
+				if (!clip_segment(-tangent, -tangent.dot(v1), ref_edge) || !clip_segment(tangent, tangent.dot(v2), ref_next))
+					return false;
+
+				m.normal = n;
+
+				for (uint32_t i = 0; i < 2; i++)
+				{
+					const double sep = n.dot(points[i] - v1);
+
+					if (sep <= 0.0)
+					{
+						// The point lies halfway between the reference edge and the incident vertex
+						m.points[m.count] = points[i] - n * (sep * 0.5);
+						m.depths[m.count] = -sep;
+						m.features[m.count] = features[i];
+						m.count++;
+					}
+				}
+
+				return m.count > 0;
+			};
+
+		// Prefer a as the reference so the choice doesn't flicker between frames
+		if (sep_b > 0.98 * sep_a + 1e-9)
+		{
+			if (!build(b, sign_b, edge_b, a, sign_a))
+				return false;
+
+			m.flip();
+			return true;
+		}
+
+		return build(a, sign_a, edge_a, b, sign_b);
+	}
+
+	template <class T1, class T2>
+	bool collide(std::span<const vec2d<T1>> a, const circle<T2>& c, contact_manifold& m)
+	{
+		m.count = 0;
+
+		if (a.size() < 3)
+			return false;
+
+		double sum = 0.0;
+
+		for (size_t i = 0, j = a.size() - 1; i < a.size(); j = i++)
+			sum += double(a[j].x) * double(a[i].y) - double(a[i].x) * double(a[j].y);
+
+		const double sign = sum < 0.0 ? -1.0 : 1.0;
+
+		const vec2d<double> center(double(c.pos.x), double(c.pos.y));
+		const double radius = double(c.radius);
+
+		size_t edge = 0;
+		double best = -std::numeric_limits<double>::max();
+		vec2d<double> best_normal;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			const auto& p = a[i];
+			const auto& q = a[(i + 1) % a.size()];
+
+			const double ex = double(q.x) - double(p.x);
+			const double ey = double(q.y) - double(p.y);
+			const double len = std::sqrt(ex * ex + ey * ey);
+
+			if (len == 0.0)
+				continue;
+
+			const vec2d<double> n(sign * ey / len, -sign * ex / len);
+			const double sep = n.x * (center.x - double(p.x)) + n.y * (center.y - double(p.y));
+
+			if (sep > radius)
+				return false;
+
+			if (sep > best)
+			{
+				best = sep;
+				edge = i;
+				best_normal = n;
+			}
+		}
+
+		const size_t next = (edge + 1) % a.size();
+
+		const vec2d<double> v1(double(a[edge].x), double(a[edge].y));
+		const vec2d<double> v2(double(a[next].x), double(a[next].y));
+
+		auto face_contact = [&]()
+			{
+				const double offset = (radius + best) * 0.5;
+
+				m.normal = best_normal;
+				m.points[0] = center - best_normal * offset;
+				m.depths[0] = radius - best;
+				m.features[0] = contact_feature(uint32_t(edge), FEATURE_EDGE, 0, FEATURE_VERTEX);
+				m.count = 1;
+
+				return true;
+			};
+
+		auto vertex_contact = [&](const vec2d<double>& v, size_t index)
+			{
+				const vec2d<double> d = center - v;
+				const double sqr_dist = d.dot(d);
+
+				if (sqr_dist > radius * radius)
+					return false;
+
+				const double dist = std::sqrt(sqr_dist);
+
+				m.normal = d / dist;
+				m.points[0] = v + m.normal * ((dist - radius) * 0.5);
+				m.depths[0] = radius - dist;
+				m.features[0] = contact_feature(uint32_t(index), FEATURE_VERTEX, 0, FEATURE_VERTEX);
+				m.count = 1;
+
+				return true;
+			};
+
+		// The center is inside the ring
+		if (best <= 0.0)
+			return face_contact();
+
+		if ((center - v1).dot(v2 - v1) <= 0.0)
+			return vertex_contact(v1, edge);
+
+		if ((center - v2).dot(v1 - v2) <= 0.0)
+			return vertex_contact(v2, next);
+
+		return face_contact();
+	}
+
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p1, const polygon<T2>& p2, contact_manifold& m)
+	{
+		return collide(std::span<const vec2d<T1>>(p1.vertices), std::span<const vec2d<T2>>(p2.vertices), m);
+	}
+
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p, const circle<T2>& c, contact_manifold& m)
+	{
+		return collide(std::span<const vec2d<T1>>(p.vertices), c, m);
+	}
+
+	template <class T1, class T2>
+	bool collide(const circle<T1>& c, const polygon<T2>& p, contact_manifold& m)
+	{
+		if (!collide(std::span<const vec2d<T2>>(p.vertices), c, m))
+			return false;
+
+		m.flip();
+		return true;
+	}
+
+	template <class T1, class T2>
+	bool collide(const rect<T1>& r, const polygon<T2>& p, contact_manifold& m)
+	{
+		// Edge i of the ring is side i of r
+		const vec2d<T1> corners[4] = { r.bottom_left(), r.top_left(), r.top_right(), r.bottom_right() };
+		return collide(std::span<const vec2d<T1>>(corners), std::span<const vec2d<T2>>(p.vertices), m);
+	}
+
+	template <class T1, class T2>
+	bool collide(const polygon<T1>& p, const rect<T2>& r, contact_manifold& m)
+	{
+		// Edge i of the ring is side i of r
+		const vec2d<T2> corners[4] = { r.bottom_left(), r.top_left(), r.top_right(), r.bottom_right() };
+		return collide(std::span<const vec2d<T1>>(p.vertices), std::span<const vec2d<T2>>(corners), m);
+	}
+
+	template <class S1, class S2>
+	bool collide(const S1& s1, const S2& s2, uint32_t a, uint32_t b, contact_buffer& contacts)
+	{
+		contact_manifold m;
+
+		if (!collide(s1, s2, m))
+			return false;
+
+		contacts.push(a, b, m);
+		return true;
+	}
+
+	template <class T>
+	template <class S>
+	uint32_t physics_world<T>::add(const S& s, double m, const vec2d<double>& v)
+	{
+		body b;
+
+		b.value = s;
+		b.velocity = v;
+		b.inv_mass = m > 0.0 ? 1.0 / m : 0.0;
+
+		bodies.push_back(std::move(b));
+
+		return uint32_t(bodies.size() - 1);
+	}
+
+	template <class T>
+	void physics_world<T>::step(double dt)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("physics step", "physics");
+
+		if (dt <= 0.0)
+			return;
+
+		for (auto& b : bodies)
+		{
+			if (b.inv_mass > 0.0)
+				b.velocity += gravity * dt;
+		}
+
+		broad_phase();
+		narrow_phase();
+		color_contacts();
+		prepare();
+		solve();
+		solve_positions(dt);
+		keep_impulses();
+		integrate();
+	}
+
+	template <class T>
+	void physics_world<T>::broad_phase()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("broad phase", "physics");
+
+		const size_t n = bodies.size();
+
+		aabbs.resize(n);
+		sorted.resize(n);
+
+		utils::parallel_for(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					aabbs[i] = bounds(bodies[i].value);
+					sorted[i] = uint32_t(i);
+				}
+			}, BLOCK);
+
+		std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b)
+			{
+				return aabbs[a].pos.x < aabbs[b].pos.x || (aabbs[a].pos.x == aabbs[b].pos.x && a < b);
+			});
+
+		const size_t blocks = (n + BLOCK - 1) / BLOCK;
+
+		block_pairs.resize(blocks);
+
+		// Each block sweeps its own bodies against everything to the right, so blocks are independent
+		utils::parallel_for(blocks, [&](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block++)
+				{
+					auto& out = block_pairs[block];
+					out.clear();
+
+					for (size_t i = block * BLOCK; i < std::min(n, (block + 1) * BLOCK); i++)
+					{
+						const uint32_t a = sorted[i];
+						const rect<double>& ra = aabbs[a];
+						const double right = ra.pos.x + ra.size.x;
+
+						for (size_t j = i + 1; j < n && aabbs[sorted[j]].pos.x <= right; j++)
+						{
+							const uint32_t b = sorted[j];
+							const rect<double>& rb = aabbs[b];
+
+							if (bodies[a].inv_mass == 0.0 && bodies[b].inv_mass == 0.0)
+								continue;
+
+							if (ra.pos.y <= rb.pos.y + rb.size.y && rb.pos.y <= ra.pos.y + ra.size.y)
+								out.push_back(uint64_t(std::min(a, b)) << 32 | std::max(a, b));
+						}
+					}
+				}
+			});
+
+		pairs.clear();
+
+		for (const auto& out : block_pairs)
+			pairs.insert(pairs.end(), out.begin(), out.end());
+	}
+
+	template <class T>
+	void physics_world<T>::narrow_phase()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("narrow phase", "physics");
+
+		manifolds.resize(pairs.size());
+		hits.resize(pairs.size());
+
+		utils::parallel_for(pairs.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const auto& a = bodies[pairs[i] >> 32].value;
+					const auto& b = bodies[pairs[i] & UINT32_MAX].value;
+
+					hits[i] = std::visit([&](const auto& sa, const auto& sb) { return collide(sa, sb, manifolds[i]); }, a, b);
+				}
+			}, 256);
+
+		contacts.clear();
+
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			if (hits[i])
+				contacts.push(uint32_t(pairs[i] >> 32), uint32_t(pairs[i] & UINT32_MAX), manifolds[i]);
+		}
+	}
+
+	template <class T>
+	void physics_world<T>::color_contacts()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("color contacts", "physics");
+
+		const size_t n = contacts.size();
+
+		body_colors.assign(bodies.size(), 0);
+		colors.resize(n);
+		color_offsets.assign(COLORS + 2, 0);
+
+		for (size_t c = 0; c < n; c++)
+		{
+			const uint32_t a = contacts.body_a[c], b = contacts.body_b[c];
+
+			// Static bodies are never written by the solver, so they don't restrict colors
+			const bool dynamic_a = bodies[a].inv_mass > 0.0;
+			const bool dynamic_b = bodies[b].inv_mass > 0.0;
+
+			const uint64_t used = (dynamic_a ? body_colors[a] : 0) | (dynamic_b ? body_colors[b] : 0);
+			const uint32_t color = used == UINT64_MAX ? COLORS : uint32_t(std::countr_one(used));
+
+			if (color < COLORS)
+			{
+				if (dynamic_a)
+					body_colors[a] |= uint64_t(1) << color;
+
+				if (dynamic_b)
+					body_colors[b] |= uint64_t(1) << color;
+			}
+
+			colors[c] = uint8_t(color);
+			color_offsets[color + 1]++;
+		}
+
+		for (uint32_t i = 0; i <= COLORS; i++)
+			color_offsets[i + 1] += color_offsets[i];
+
+		order.resize(n);
+
+		std::vector<uint32_t> cursor(color_offsets.begin(), color_offsets.end() - 1);
+
+		for (size_t c = 0; c < n; c++)
+			order[cursor[colors[c]]++] = uint32_t(c);
+	}
+
+	template <class T>
+	void physics_world<T>::prepare()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("prepare contacts", "physics");
+
+		const size_t n = contacts.size();
+
+		mass.resize(n);
+		friction.resize(n);
+
+		for (uint32_t p = 0; p < 2; p++)
+		{
+			bias[p].resize(n);
+			normal_impulse[p].assign(n, 0.0);
+			tangent_impulse[p].assign(n, 0.0);
+		}
+
+		utils::parallel_for(n, [&](size_t begin, size_t end)
+			{
+				for (size_t c = begin; c < end; c++)
+				{
+					const body& a = bodies[contacts.body_a[c]];
+					const body& b = bodies[contacts.body_b[c]];
+
+					const double nx = contacts.normal_x[c], ny = contacts.normal_y[c];
+					const double vn = (b.velocity.x - a.velocity.x) * nx + (b.velocity.y - a.velocity.y) * ny;
+
+					const double restitution = std::max(a.restitution, b.restitution);
+
+					mass[c] = 1.0 / (a.inv_mass + b.inv_mass);
+					friction[c] = std::sqrt(a.friction * b.friction);
+
+					const auto found = previous.find(uint64_t(contacts.body_a[c]) << 32 | contacts.body_b[c]);
+
+					for (uint32_t p = 0; p < contacts.count[c]; p++)
+					{
+						// Penetration is resolved by solve_positions, velocities only aim for the bounce
+						bias[p][c] = vn < -restitution_threshold ? -restitution * vn : 0.0;
+
+						if (found == previous.end())
+							continue;
+
+						const uint32_t old = found->second;
+
+						for (uint32_t q = 0; q < previous_contacts.count[old]; q++)
+						{
+							if (previous_contacts.feature[q][old] == contacts.feature[p][c])
+							{
+								normal_impulse[p][c] = previous_normal[q][old];
+								tangent_impulse[p][c] = previous_tangent[q][old];
+							}
+						}
+					}
+				}
+			}, 256);
+
+		// Warm starting writes velocities, so it goes color by color as the solver does
+		// Static bodies are shared by contacts of one color, so their velocities are only read
+		for_each_color(1, [&](uint32_t c)
+			{
+				body& a = bodies[contacts.body_a[c]];
+				body& b = bodies[contacts.body_b[c]];
+
+				const double nx = contacts.normal_x[c], ny = contacts.normal_y[c];
+
+				for (uint32_t p = 0; p < contacts.count[c]; p++)
+				{
+					const double px = nx * normal_impulse[p][c] - ny * tangent_impulse[p][c];
+					const double py = ny * normal_impulse[p][c] + nx * tangent_impulse[p][c];
+
+					if (a.inv_mass > 0.0)
+					{
+						a.velocity.x -= px * a.inv_mass;
+						a.velocity.y -= py * a.inv_mass;
+					}
+
+					if (b.inv_mass > 0.0)
+					{
+						b.velocity.x += px * b.inv_mass;
+						b.velocity.y += py * b.inv_mass;
+					}
+				}
+			});
+	}
+
+	template <class T>
+	void physics_world<T>::solve()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("solve contacts", "physics");
+
+		// Static bodies are shared by contacts of one color, so their velocities are only read
+		const auto apply = [](body& a, body& b, double px, double py)
+			{
+				if (a.inv_mass > 0.0)
+				{
+					a.velocity.x -= px * a.inv_mass;
+					a.velocity.y -= py * a.inv_mass;
+				}
+
+				if (b.inv_mass > 0.0)
+				{
+					b.velocity.x += px * b.inv_mass;
+					b.velocity.y += py * b.inv_mass;
+				}
+			};
+
+		for_each_color(iterations, [&](uint32_t c)
+			{
+				body& a = bodies[contacts.body_a[c]];
+				body& b = bodies[contacts.body_b[c]];
+
+				// Tangent is the normal rotated by 90 degrees
+				const double nx = contacts.normal_x[c], ny = contacts.normal_y[c];
+				const double tx = -ny, ty = nx;
+
+				for (uint32_t p = 0; p < contacts.count[c]; p++)
+				{
+					double dvx = b.velocity.x - a.velocity.x;
+					double dvy = b.velocity.y - a.velocity.y;
+
+					const double old_normal = normal_impulse[p][c];
+					normal_impulse[p][c] = std::max(old_normal + mass[c] * (bias[p][c] - (dvx * nx + dvy * ny)), 0.0);
+
+					const double dn = normal_impulse[p][c] - old_normal;
+
+					apply(a, b, nx * dn, ny * dn);
+
+					dvx = b.velocity.x - a.velocity.x;
+					dvy = b.velocity.y - a.velocity.y;
+
+					const double limit = friction[c] * normal_impulse[p][c];
+					const double old_tangent = tangent_impulse[p][c];
+
+					tangent_impulse[p][c] = std::clamp(old_tangent - mass[c] * (dvx * tx + dvy * ty), -limit, limit);
+
+					const double dtan = tangent_impulse[p][c] - old_tangent;
+
+					apply(a, b, tx * dtan, ty * dtan);
+				}
+			});
+	}
+
+	template <class T>
+	void physics_world<T>::keep_impulses()
+	{
+		previous.clear();
+
+		for (size_t c = 0; c < contacts.size(); c++)
+			previous[uint64_t(contacts.body_a[c]) << 32 | contacts.body_b[c]] = uint32_t(c);
+
+		std::swap(previous_contacts, contacts);
+
+		for (uint32_t p = 0; p < 2; p++)
+		{
+			std::swap(previous_normal[p], normal_impulse[p]);
+			std::swap(previous_tangent[p], tangent_impulse[p]);
+		}
+	}
+
+	template <class T>
+	void physics_world<T>::solve_positions(double dt)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("solve positions", "physics");
+
+		displacement.resize(bodies.size());
+
+		utils::parallel_for(bodies.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					displacement[i] = bodies[i].inv_mass > 0.0 ? bodies[i].velocity * dt : vec2d<double>();
+			}, BLOCK);
+
+		// Bodies only translate, so the depth of a point after moving is its depth in the manifold
+		// minus the relative displacement along the normal
+		for_each_color(position_iterations, [&](uint32_t c)
+			{
+				const uint32_t ia = contacts.body_a[c], ib = contacts.body_b[c];
+				const double inv_a = bodies[ia].inv_mass, inv_b = bodies[ib].inv_mass;
+
+				const double nx = contacts.normal_x[c], ny = contacts.normal_y[c];
+
+				for (uint32_t p = 0; p < contacts.count[c]; p++)
+				{
+					const vec2d<double> d = displacement[ib] - displacement[ia];
+					const double depth = contacts.depth[p][c] - (d.x * nx + d.y * ny);
+
+					const double correction = std::min(baumgarte * (depth - slop), max_correction);
+
+					if (correction <= 0.0)
+						continue;
+
+					const double impulse = correction * mass[c];
+
+					if (inv_a > 0.0)
+						displacement[ia] -= vec2d<double>(nx, ny) * (impulse * inv_a);
+
+					if (inv_b > 0.0)
+						displacement[ib] += vec2d<double>(nx, ny) * (impulse * inv_b);
+				}
+			});
+	}
+
+	template <class T>
+	void physics_world<T>::integrate()
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("integrate", "physics");
+
+		utils::parallel_for(bodies.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					if (bodies[i].inv_mass > 0.0)
+						translate(bodies[i].value, displacement[i]);
+				}
+			}, BLOCK);
+	}
+
+	template <class T>
+	template <class F>
+	void physics_world<T>::for_each_color(uint32_t passes, F&& func)
+	{
+		constexpr size_t GRAIN = 256;
+
+		for (uint32_t pass = 0; pass < passes; pass++)
+		{
+			for (uint32_t color = 0; color < COLORS; color++)
+			{
+				const uint32_t first = color_offsets[color];
+
+				utils::parallel_for(color_offsets[color + 1] - first, [&](size_t begin, size_t end)
+					{
+						for (size_t i = begin; i < end; i++)
+							func(order[first + i]);
+					}, GRAIN);
+			}
+
+			for (uint32_t i = color_offsets[COLORS]; i < color_offsets[COLORS + 1]; i++)
+				func(order[i]);
+		}
+	}
+
+	template <class T>
+	rect<double> physics_world<T>::bounds(const typename body::shape& s)
+	{
+		if (auto c = std::get_if<circle<T>>(&s))
+		{
+			const double r = double(c->radius);
+			return rect<double>({ double(c->pos.x) - r, double(c->pos.y) - r }, { r * 2.0, r * 2.0 });
+		}
+
+		if (auto r = std::get_if<rect<T>>(&s))
+			return rect<double>({ double(r->pos.x), double(r->pos.y) }, { double(r->size.x), double(r->size.y) });
+
+		const auto& v = std::get<polygon<T>>(s).vertices;
+
+		if (v.empty())
+			return {};
+
+		vec2d<double> lo(double(v[0].x), double(v[0].y)), hi = lo;
+
+		for (const auto& p : v)
+		{
+			lo = lo.min(vec2d<double>(double(p.x), double(p.y)));
+			hi = hi.max(vec2d<double>(double(p.x), double(p.y)));
+		}
+
+		return rect<double>(lo, hi - lo);
+	}
+
+	template <class T>
+	void physics_world<T>::translate(typename body::shape& s, const vec2d<double>& offset)
+	{
+		const vec2d<T> d(T(offset.x), T(offset.y));
+
+		if (auto c = std::get_if<circle<T>>(&s))
+			c->pos += d;
+		else if (auto r = std::get_if<rect<T>>(&s))
+			r->pos += d;
+		else
+		{
+			for (auto& p : std::get<polygon<T>>(s).vertices)
+				p += d;
+		}
+	}
+
+	template <class T>
+	prepared_polygon<T>::prepared_polygon(const polygon<T>& p, uint32_t resolution)
+	{
+		prepare(p, resolution);
+	}
+
+	template <class T>
+	void prepared_polygon<T>::prepare(const polygon<T>& p, uint32_t resolution)
+	{
+		const size_t n = p.vertices.size();
+
+		vertices.resize(n);
+		states.clear();
+		centers.clear();
+		cell_offsets.clear();
+		cell_edges.clear();
+		width = height = 0;
+
+		if (n < 3)
+			return;
+
+		vec2d<double> lo(double(p.vertices[0].x), double(p.vertices[0].y)), hi = lo;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			vertices[i] = { double(p.vertices[i].x), double(p.vertices[i].y) };
+			lo = lo.min(vertices[i]);
+			hi = hi.max(vertices[i]);
+		}
+
+		if (resolution == 0)
+			resolution = std::clamp(uint32_t(std::sqrt(double(n)) * 2.0), 4u, 4096u);
+
+		const vec2d<double> extent = hi - lo;
+
+		cell_size = std::max(extent.x, extent.y) / double(resolution);
+
+		if (cell_size <= 0.0)
+			return;
+
+		origin = lo;
+		width = std::max(1u, uint32_t(std::ceil(extent.x / cell_size)));
+		height = std::max(1u, uint32_t(std::ceil(extent.y / cell_size)));
+
+		const size_t cells = size_t(width) * height;
+
+		// A slightly padded range makes every edge listed in each closed cell it touches
+		const double pad = cell_size * 1e-9;
+
+		auto for_each_cell = [&](size_t i, auto&& func)
+			{
+				const vec2d<double>& a = vertices[i];
+				const vec2d<double>& b = vertices[(i + 1) % n];
+
+				const double y0 = std::min(a.y, b.y) - origin.y, y1 = std::max(a.y, b.y) - origin.y;
+
+				const int64_t row0 = std::max<int64_t>(int64_t(std::floor((y0 - pad) / cell_size)), 0);
+				const int64_t row1 = std::min<int64_t>(int64_t(std::floor((y1 + pad) / cell_size)), height - 1);
+
+				for (int64_t row = row0; row <= row1; row++)
+				{
+					// Part of the edge inside the band of the row
+					const double band0 = std::max(y0, double(row) * cell_size);
+					const double band1 = std::min(y1, double(row + 1) * cell_size);
+
+					double x0, x1;
+
+					if (a.y == b.y)
+					{
+						x0 = std::min(a.x, b.x);
+						x1 = std::max(a.x, b.x);
+					}
+					else
+					{
+						const double inv = (b.x - a.x) / (b.y - a.y);
+
+						x0 = a.x + (band0 + origin.y - a.y) * inv;
+						x1 = a.x + (band1 + origin.y - a.y) * inv;
+
+						if (x0 > x1)
+							std::swap(x0, x1);
+					}
+
+					const int64_t col0 = std::max<int64_t>(int64_t(std::floor((x0 - origin.x - pad) / cell_size)), 0);
+					const int64_t col1 = std::min<int64_t>(int64_t(std::floor((x1 - origin.x + pad) / cell_size)), width - 1);
+
+					for (int64_t col = col0; col <= col1; col++)
+						func(size_t(row) * width + size_t(col));
+				}
+			};
+
+		cell_offsets.assign(cells + 1, 0);
+
+		for (size_t i = 0; i < n; i++)
+			for_each_cell(i, [&](size_t cell) { cell_offsets[cell + 1]++; });
+
+		for (size_t c = 0; c < cells; c++)
+			cell_offsets[c + 1] += cell_offsets[c];
+
+		cell_edges.resize(cell_offsets[cells]);
+
+		std::vector<uint32_t> cursor(cell_offsets.begin(), cell_offsets.end() - 1);
+
+		for (size_t i = 0; i < n; i++)
+			for_each_cell(i, [&](size_t cell) { cell_edges[cursor[cell]++] = uint32_t(i); });
+
+		// Crossings of the reference line of each row with half-open rule, the same as ray casting uses
+		std::vector<uint32_t> row_offsets(size_t(height) + 1, 0);
+		std::vector<double> crossings;
+
+		auto for_each_crossing = [&](size_t i, auto&& func)
+			{
+				const vec2d<double>& a = vertices[i];
+				const vec2d<double>& b = vertices[(i + 1) % n];
+
+				const double y0 = std::min(a.y, b.y) - origin.y, y1 = std::max(a.y, b.y) - origin.y;
+
+				const int64_t row0 = std::max<int64_t>(int64_t(std::floor(y0 / cell_size - REFERENCE_Y)), 0);
+				const int64_t row1 = std::min<int64_t>(int64_t(std::ceil(y1 / cell_size - REFERENCE_Y)), height - 1);
+
+				for (int64_t row = row0; row <= row1; row++)
+				{
+					const double y = origin.y + (double(row) + REFERENCE_Y) * cell_size;
+
+					if ((a.y > y) != (b.y > y))
+						func(size_t(row), a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y));
+				}
+			};
+
+		for (size_t i = 0; i < n; i++)
+			for_each_crossing(i, [&](size_t row, double) { row_offsets[row + 1]++; });
+
+		for (size_t r = 0; r < height; r++)
+			row_offsets[r + 1] += row_offsets[r];
+
+		crossings.resize(row_offsets[height]);
+		cursor.assign(row_offsets.begin(), row_offsets.end() - 1);
+
+		for (size_t i = 0; i < n; i++)
+			for_each_crossing(i, [&](size_t row, double x) { crossings[cursor[row]++] = x; });
+
+		states.resize(cells);
+		centers.resize(cells);
+
+		for (size_t row = 0; row < height; row++)
+		{
+			const auto first = crossings.begin() + row_offsets[row];
+			const auto last = crossings.begin() + row_offsets[row + 1];
+
+			std::sort(first, last);
+
+			auto next = first;
+			bool inside = false;
+
+			for (size_t col = 0; col < width; col++)
+			{
+				const double x = origin.x + (double(col) + REFERENCE_X) * cell_size;
+
+				while (next != last && *next < x)
+				{
+					inside = !inside;
+					++next;
+				}
+
+				const size_t cell = row * width + col;
+
+				centers[cell] = inside;
+
+				if (cell_offsets[cell] != cell_offsets[cell + 1])
+					states[cell] = CELL_BOUNDARY;
+				else
+					states[cell] = inside ? CELL_INSIDE : CELL_OUTSIDE;
+			}
+		}
+	}
+
+	template <class T>
+	template <class T1>
+	bool prepared_polygon<T>::contains(const vec2d<T1>& p) const
+	{
+		const double px = double(p.x), py = double(p.y);
+
+		const double gx = (px - origin.x) / cell_size;
+		const double gy = (py - origin.y) / cell_size;
+
+		if (!(gx >= 0.0 && gy >= 0.0 && gx <= double(width) && gy <= double(height)))
+			return false;
+
+		const uint32_t col = std::min(uint32_t(gx), width - 1);
+		const uint32_t row = std::min(uint32_t(gy), height - 1);
+		const size_t cell = size_t(row) * width + col;
+
+		if (states[cell] != CELL_BOUNDARY)
+			return states[cell] == CELL_INSIDE;
+
+		// Counts edges crossed by the segment from the reference point to p, it never leaves the cell
+		const double cx = origin.x + (double(col) + REFERENCE_X) * cell_size;
+		const double cy = origin.y + (double(row) + REFERENCE_Y) * cell_size;
+
+		const double dx = px - cx, dy = py - cy;
+
+		bool inside = centers[cell];
+
+		for (uint32_t k = cell_offsets[cell]; k < cell_offsets[cell + 1]; k++)
+		{
+			const uint32_t i = cell_edges[k];
+
+			const vec2d<double>& a = vertices[i];
+			const vec2d<double>& b = vertices[i + 1 == vertices.size() ? 0 : i + 1];
+
+			const bool side_a = dx * (a.y - cy) - dy * (a.x - cx) > 0.0;
+			const bool side_b = dx * (b.y - cy) - dy * (b.x - cx) > 0.0;
+
+			if (side_a == side_b)
+				continue;
+
+			const double ex = b.x - a.x, ey = b.y - a.y;
+
+			const bool side_c = ex * (cy - a.y) - ey * (cx - a.x) > 0.0;
+			const bool side_p = ex * (py - a.y) - ey * (px - a.x) > 0.0;
+
+			if (side_c != side_p)
+				inside = !inside;
+		}
+
+		return inside;
+	}
+
+	template <class T1, class T2>
+	bool contains(const prepared_polygon<T1>& pp, const vec2d<T2>& p)
+	{
+		return pp.contains(p);
+	}
+
+	template <class T1, class T2>
+	void contains(const prepared_polygon<T1>& pp, std::span<const vec2d<T2>> points, std::span<uint8_t> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("contains points", "query");
+
+		utils::parallel_for(std::min(points.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("contains points chunk", "query");
+
+				for (size_t i = begin; i < end; i++)
+					results[i] = pp.contains(points[i]);
+			}, 16384);
+	}
+
+	template <size_t N>
+	utils::expansion<N>::expansion(double value)
+	{
+		if (value != 0.0)
+			terms[count++] = value;
+	}
+
+	template <size_t N>
+	utils::expansion<2> utils::expansion<N>::product(double a, double b)
+	{
+		const double x = a * b;
+		const double y = std::fma(a, b, -x);
+
+		expansion<2> e(y);
+		e.grow(x);
+
+		return e;
+	}
+
+	template <size_t N>
+	utils::expansion<2> utils::expansion<N>::difference(double a, double b)
+	{
+		expansion<2> e(a);
+		e.grow(-b);
+
+		return e;
+	}
+
+	template <size_t N>
+	void utils::expansion<N>::grow(double b)
+	{
+		// Two-sum of the running value with each term keeps the round-off as a new term
+		double q = b;
+		size_t kept = 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const double sum = q + terms[i];
+			const double bv = sum - q;
+			const double err = (q - (sum - bv)) + (terms[i] - bv);
+
+			q = sum;
+
+			if (err != 0.0)
+				terms[kept++] = err;
+		}
+
+		count = kept;
+
+		if (q != 0.0 || count == 0)
+			terms[count++] = q;
+	}
+
+	template <size_t N>
+	template <size_t M>
+	utils::expansion<N + M> utils::expansion<N>::operator+(const expansion<M>& e) const
+	{
+		expansion<N + M> result;
+
+		std::copy(terms, terms + count, result.terms);
+		result.count = count;
+
+		for (size_t i = 0; i < e.count; i++)
+			result.grow(e.terms[i]);
+
+		return result;
+	}
+
+	template <size_t N>
+	template <size_t M>
+	utils::expansion<N + M> utils::expansion<N>::operator-(const expansion<M>& e) const
+	{
+		return *this + -e;
+	}
+
+	template <size_t N>
+	template <size_t M>
+	utils::expansion<2 * N * M> utils::expansion<N>::operator*(const expansion<M>& e) const
+	{
+		expansion<2 * N * M> result;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t j = 0; j < e.count; j++)
+			{
+				const double a = terms[i], b = e.terms[j];
+				const double x = a * b;
+
+				result.grow(std::fma(a, b, -x));
+				result.grow(x);
+			}
+		}
+
+		return result;
+	}
+
+	template <size_t N>
+	utils::expansion<N> utils::expansion<N>::operator-() const
+	{
+		expansion result;
+
+		for (size_t i = 0; i < count; i++)
+			result.terms[i] = -terms[i];
+
+		result.count = count;
+
+		return result;
+	}
+
+	template <size_t N>
+	double utils::expansion<N>::estimate() const
+	{
+		return count == 0 ? 0.0 : terms[count - 1];
+	}
+
+	inline double utils::orient2d(double ax, double ay, double bx, double by, double cx, double cy)
+	{
+		const double left = (ax - cx) * (by - cy);
+		const double right = (ay - cy) * (bx - cx);
+		const double det = left - right;
+
+		// Error bound of the floating point evaluation from Shewchuk's predicates
+		if (std::abs(det) >= 3.3306690738754716e-16 * (std::abs(left) + std::abs(right)))
+			return det;
+
+		using exact = expansion<2>;
+
+		const exact acx = exact::difference(ax, cx), bcx = exact::difference(bx, cx);
+		const exact acy = exact::difference(ay, cy), bcy = exact::difference(by, cy);
+
+		return (acx * bcy - acy * bcx).estimate();
+	}
+
+	inline double utils::incircle(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy)
+	{
+		const double adx = ax - dx, ady = ay - dy;
+		const double bdx = bx - dx, bdy = by - dy;
+		const double cdx = cx - dx, cdy = cy - dy;
+
+		const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		const double cdxady = cdx * ady, adxcdy = adx * cdy;
+		const double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+		const double alift = adx * adx + ady * ady;
+		const double blift = bdx * bdx + bdy * bdy;
+		const double clift = cdx * cdx + cdy * cdy;
+
+		const double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+
+		const double permanent =
+			(std::abs(bdxcdy) + std::abs(cdxbdy)) * alift +
+			(std::abs(cdxady) + std::abs(adxcdy)) * blift +
+			(std::abs(adxbdy) + std::abs(bdxady)) * clift;
+
+		if (std::abs(det) >= 1.1102230246251577e-15 * permanent)
+			return det;
+
+		using exact = expansion<2>;
+
+		// Differences have 2 terms, lifts and 2x2 minors 16 and their products 512
+		const exact eadx = exact::difference(ax, dx), eady = exact::difference(ay, dy);
+		const exact ebdx = exact::difference(bx, dx), ebdy = exact::difference(by, dy);
+		const exact ecdx = exact::difference(cx, dx), ecdy = exact::difference(cy, dy);
+
+		const auto ea = eadx * eadx + eady * eady;
+		const auto eb = ebdx * ebdx + ebdy * ebdy;
+		const auto ec = ecdx * ecdx + ecdy * ecdy;
+
+		const auto sum =
+			ea * (ebdx * ecdy - ecdx * ebdy) +
+			eb * (ecdx * eady - eadx * ecdy) +
+			ec * (eadx * ebdy - ebdx * eady);
+
+		return sum.estimate();
+	}
+
+	template <class T>
+	uint32_t delaunay<T>::next(uint32_t e)
+	{
+		return e % 3 == 2 ? e - 2 : e + 1;
+	}
+
+	template <class T>
+	uint32_t delaunay<T>::prev(uint32_t e)
+	{
+		return e % 3 == 0 ? e + 2 : e - 1;
+	}
+
+	template <class T>
+	void delaunay<T>::link(uint32_t a, uint32_t b)
+	{
+		halfedges[a] = b;
+
+		if (b != NONE)
+			halfedges[b] = a;
+	}
+
+	template <class T>
+	uint32_t delaunay<T>::add_triangle(uint32_t i0, uint32_t i1, uint32_t i2, uint32_t a, uint32_t b, uint32_t c)
+	{
+		const uint32_t t = triangles_size;
+
+		triangles[t] = i0;
+		triangles[t + 1] = i1;
+		triangles[t + 2] = i2;
+
+		link(t, a);
+		link(t + 1, b);
+		link(t + 2, c);
+
+		triangles_size += 3;
+
+		return t;
+	}
+
+	template <class T>
+	uint32_t delaunay<T>::hash_key(double x, double y) const
+	{
+		// Pseudo-angle around the center grows monotonically with the real angle
+		const double dx = x - center.x, dy = center.y - y;
+		const double p = dx / (std::abs(dx) + std::abs(dy));
+		const double angle = (dy > 0.0 ? 3.0 - p : 1.0 + p) / 4.0;
+
+		const uint32_t size = uint32_t(hull_hash.size());
+
+		return uint32_t(std::floor(angle * size)) % size;
+	}
+
+	template <class T>
+	uint32_t delaunay<T>::legalize(uint32_t a, std::span<const vec2d<T>> points)
+	{
+		uint32_t ar = 0;
+
+		edge_stack.clear();
+
+		while (true)
+		{
+			const uint32_t b = halfedges[a];
+			const uint32_t a0 = a - a % 3;
+
+			ar = a0 + (a + 2) % 3;
+
+			if (b == NONE)
+			{
+				if (edge_stack.empty())
+					break;
+
+				a = edge_stack.back();
+				edge_stack.pop_back();
+
+				continue;
+			}
+
+			const uint32_t b0 = b - b % 3;
+			const uint32_t al = a0 + (a + 1) % 3;
+			const uint32_t bl = b0 + (b + 2) % 3;
+
+			const auto& p0 = points[triangles[ar]];
+			const auto& pr = points[triangles[a]];
+			const auto& pl = points[triangles[al]];
+			const auto& p1 = points[triangles[bl]];
+
+			const bool illegal = utils::incircle(
+				double(p0.x), double(p0.y), double(pr.x), double(pr.y),
+				double(pl.x), double(pl.y), double(p1.x), double(p1.y)) > 0.0;
+
+			if (illegal)
+			{
+				triangles[a] = triangles[bl];
+				triangles[b] = triangles[ar];
+
+				const uint32_t hbl = halfedges[bl];
+
+				// The flipped edge was on the hull, so the hull must point at the triangle that kept it
+				if (hbl == NONE)
+				{
+					uint32_t e = hull_start;
+
+					do
+					{
+						if (hull_tri[e] == bl)
+						{
+							hull_tri[e] = a;
+							break;
+						}
+
+						e = hull_prev[e];
+					}
+					while (e != hull_start);
+				}
+
+				link(a, hbl);
+				link(b, halfedges[ar]);
+				link(ar, bl);
+
+				edge_stack.push_back(b0 + (b + 1) % 3);
+			}
+			else
+			{
+				if (edge_stack.empty())
+					break;
+
+				a = edge_stack.back();
+				edge_stack.pop_back();
+			}
+		}
+
+		return ar;
+	}
+
+	template <class T>
+	bool delaunay<T>::build(std::span<const vec2d<T>> points)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("delaunay", "build");
+
+		const uint32_t n = uint32_t(points.size());
+
+		triangles.clear();
+		halfedges.clear();
+		hull.clear();
+		inedges.assign(n, NONE);
+
+		if (n < 3)
+			return false;
+
+		auto px = [&](uint32_t i) { return double(points[i].x); };
+		auto py = [&](uint32_t i) { return double(points[i].y); };
+
+		double min_x = px(0), min_y = py(0), max_x = min_x, max_y = min_y;
+
+		for (uint32_t i = 1; i < n; i++)
+		{
+			min_x = std::min(min_x, px(i));
+			min_y = std::min(min_y, py(i));
+			max_x = std::max(max_x, px(i));
+			max_y = std::max(max_y, py(i));
+		}
+
+		const double mid_x = (min_x + max_x) * 0.5, mid_y = (min_y + max_y) * 0.5;
+
+		auto sqr_dist = [](double ax, double ay, double bx, double by)
+			{
+				return (ax - bx) * (ax - bx) + (ay - by) * (ay - by);
+			};
+
+		// Squared radius of the circle through a, b and c, infinite if they are collinear
+		auto circumradius = [](double ax, double ay, double bx, double by, double cx, double cy)
+			{
+				const double dx = bx - ax, dy = by - ay;
+				const double ex = cx - ax, ey = cy - ay;
+
+				const double cross = dx * ey - dy * ex;
+
+				if (cross == 0.0)
+					return std::numeric_limits<double>::infinity();
+
+				const double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+				const double d = 0.5 / cross;
+
+				const double x = (ey * bl - dy * cl) * d;
+				const double y = (dx * cl - ex * bl) * d;
+
+				return x * x + y * y;
+			};
+
+		// The seed triangle is the point nearest to the middle, its nearest point and the point that makes the smallest circle
+		uint32_t i0 = 0, i1 = NONE, i2 = NONE;
+		double best = std::numeric_limits<double>::max();
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			const double d = sqr_dist(mid_x, mid_y, px(i), py(i));
+
+			if (d < best)
+			{
+				best = d;
+				i0 = i;
+			}
+		}
+
+		best = std::numeric_limits<double>::max();
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			const double d = sqr_dist(px(i0), py(i0), px(i), py(i));
+
+			if (i != i0 && d > 0.0 && d < best)
+			{
+				best = d;
+				i1 = i;
+			}
+		}
+
+		if (i1 == NONE)
+			return false;
+
+		best = std::numeric_limits<double>::infinity();
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			if (i == i0 || i == i1)
+				continue;
+
+			const double r = circumradius(px(i0), py(i0), px(i1), py(i1), px(i), py(i));
+
+			if (r < best)
+			{
+				best = r;
+				i2 = i;
+			}
+		}
+
+		if (i2 == NONE)
+			return false;
+
+		if (utils::orient2d(px(i0), py(i0), px(i1), py(i1), px(i2), py(i2)) < 0.0)
+			std::swap(i1, i2);
+
+		{
+			const double dx = px(i1) - px(i0), dy = py(i1) - py(i0);
+			const double ex = px(i2) - px(i0), ey = py(i2) - py(i0);
+
+			const double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+			const double d = 0.5 / (dx * ey - dy * ex);
+
+			center = { px(i0) + (ey * bl - dy * cl) * d, py(i0) + (dx * cl - ex * bl) * d };
+		}
+
+		ids.resize(n);
+		dists.resize(n);
+
+		utils::parallel_for(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					ids[i] = uint32_t(i);
+					dists[i] = sqr_dist(px(uint32_t(i)), py(uint32_t(i)), center.x, center.y);
+				}
+			}, 65536);
+
+		std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b)
+			{
+				return dists[a] < dists[b] || (dists[a] == dists[b] && a < b);
+			});
+
+		const uint32_t hash_size = std::max(1u, uint32_t(std::ceil(std::sqrt(double(n)))));
+
+		hull_prev.resize(n);
+		hull_next.resize(n);
+		hull_tri.resize(n);
+		hull_hash.assign(hash_size, NONE);
+
+		hull_start = i0;
+		uint32_t hull_size = 3;
+
+		hull_next[i0] = hull_prev[i2] = i1;
+		hull_next[i1] = hull_prev[i0] = i2;
+		hull_next[i2] = hull_prev[i1] = i0;
+
+		hull_tri[i0] = 0;
+		hull_tri[i1] = 1;
+		hull_tri[i2] = 2;
+
+		hull_hash[hash_key(px(i0), py(i0))] = i0;
+		hull_hash[hash_key(px(i1), py(i1))] = i1;
+		hull_hash[hash_key(px(i2), py(i2))] = i2;
+
+		const size_t max_triangles = std::max<size_t>(2 * size_t(n) - 5, 1);
+
+		triangles.resize(max_triangles * 3);
+		halfedges.resize(max_triangles * 3);
+		triangles_size = 0;
+
+		add_triangle(i0, i1, i2, NONE, NONE, NONE);
+
+		// The point can see edge a -> b of the counter-clockwise hull
+		auto visible = [&](uint32_t i, uint32_t a, uint32_t b)
+			{
+				return utils::orient2d(px(a), py(a), px(b), py(b), px(i), py(i)) < 0.0;
+			};
+
+		for (uint32_t k = 0; k < n; k++)
+		{
+			const uint32_t i = ids[k];
+
+			if (k > 0 && px(i) == px(ids[k - 1]) && py(i) == py(ids[k - 1]))
+				continue;
+
+			if (i == i0 || i == i1 || i == i2)
+				continue;
+
+			const uint32_t key = hash_key(px(i), py(i));
+			uint32_t start = 0;
+
+			for (uint32_t j = 0; j < hash_size; j++)
+			{
+				start = hull_hash[(key + j) % hash_size];
+
+				if (start != NONE && start != hull_next[start])
+					break;
+			}
+
+			start = hull_prev[start];
+
+			uint32_t e = start, q;
+
+			while (q = hull_next[e], !visible(i, e, q))
+			{
+				e = q;
+
+				if (e == start)
+				{
+					e = NONE;
+					break;
+				}
+			}
+
+			// The point lies on the hull, it can only be a duplicate that wasn't adjacent after sorting
+			if (e == NONE)
+				continue;
+
+			uint32_t t = add_triangle(e, i, hull_next[e], NONE, NONE, hull_tri[e]);
+
+			hull_tri[i] = legalize(t + 2, points);
+			hull_tri[e] = t;
+			hull_size++;
+
+			uint32_t m = hull_next[e];
+
+			while (q = hull_next[m], visible(i, m, q))
+			{
+				t = add_triangle(m, i, q, hull_tri[i], NONE, hull_tri[m]);
+				hull_tri[i] = legalize(t + 2, points);
+				hull_next[m] = m;
+				hull_size--;
+				m = q;
+			}
+
+			if (e == start)
+			{
+				while (q = hull_prev[e], visible(i, q, e))
+				{
+					t = add_triangle(q, i, e, NONE, hull_tri[e], hull_tri[q]);
+					legalize(t + 2, points);
+					hull_tri[q] = t;
+					hull_next[e] = e;
+					hull_size--;
+					e = q;
+				}
+			}
+
+			hull_start = hull_prev[i] = e;
+			hull_next[e] = hull_prev[m] = i;
+			hull_next[i] = m;
+
+			hull_hash[hash_key(px(i), py(i))] = i;
+			hull_hash[hash_key(px(e), py(e))] = e;
+		}
+
+		hull.resize(hull_size);
+
+		for (uint32_t i = 0, e = hull_start; i < hull_size; i++, e = hull_next[e])
+			hull[i] = e;
+
+		triangles.resize(triangles_size);
+		halfedges.resize(triangles_size);
+
+		// Hull edges win so fans around hull points start at the hull
+		for (uint32_t e = 0; e < triangles_size; e++)
+		{
+			const uint32_t p = triangles[next(e)];
+
+			if (halfedges[e] == NONE || inedges[p] == NONE)
+				inedges[p] = e;
+		}
+
+		return true;
+	}
+
+	template <class T>
+	template <class F>
+	void delaunay<T>::for_each_neighbour(uint32_t i, F&& func) const
+	{
+		const uint32_t e0 = inedges[i];
+
+		if (e0 == NONE)
+			return;
+
+		uint32_t e = e0;
+
+		do
+		{
+			func(triangles[e]);
+
+			const uint32_t out = next(e);
+			e = halfedges[out];
+
+			// The fan ends at the outgoing hull edge
+			if (e == NONE)
+			{
+				func(triangles[next(out)]);
+				break;
+			}
+		}
+		while (e != e0);
+	}
+
+	template <class T>
+	template <class T1>
+	uint32_t delaunay<T>::nearest(std::span<const vec2d<T>> points, const vec2d<T1>& p, uint32_t start) const
+	{
+		if (triangles.empty())
+			return start;
+
+		if (start >= inedges.size() || inedges[start] == NONE)
+			start = triangles[0];
+
+		auto sqr_dist = [&](uint32_t i)
+			{
+				const double dx = double(points[i].x) - double(p.x);
+				const double dy = double(points[i].y) - double(p.y);
+
+				return dx * dx + dy * dy;
+			};
+
+		// Greedy walk ends at the nearest point because Delaunay neighbours always contain a closer point if one exists
+		uint32_t current = start;
+		double current_dist = sqr_dist(current);
+
+		while (true)
+		{
+			uint32_t best = current;
+
+			for_each_neighbour(current, [&](uint32_t j)
+				{
+					const double d = sqr_dist(j);
+
+					if (d < current_dist)
+					{
+						current_dist = d;
+						best = j;
+					}
+				});
+
+			if (best == current)
+				return current;
+
+			current = best;
+		}
+	}
+
+	template <class T>
+	void voronoi(std::span<const vec2d<T>> points, const delaunay<T>& d, const rect<double>& bounds, std::vector<polygon<double>>& cells)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("voronoi", "build");
+
+		cells.resize(points.size());
+
+		const size_t count = d.triangles.size() / 3;
+
+		std::vector<vec2d<double>> centers(count);
+
+		utils::parallel_for(count, [&](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					const auto& a = points[d.triangles[t * 3]];
+					const auto& b = points[d.triangles[t * 3 + 1]];
+					const auto& c = points[d.triangles[t * 3 + 2]];
+
+					const double dx = double(b.x) - double(a.x), dy = double(b.y) - double(a.y);
+					const double ex = double(c.x) - double(a.x), ey = double(c.y) - double(a.y);
+
+					const double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+					const double k = 0.5 / (dx * ey - dy * ex);
+
+					centers[t] = { double(a.x) + (ey * bl - dy * cl) * k, double(a.y) + (dx * cl - ex * bl) * k };
+				}
+			}, 4096);
+
+		const vec2d<double> mid = bounds.pos + bounds.size * 0.5;
+		const double diagonal = bounds.size.mag();
+
+		utils::parallel_for(points.size(), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("voronoi chunk", "build");
+
+				clipper<double> work;
+				polygon<double> ring;
+
+				for (size_t i = begin; i < end; i++)
+				{
+					cells[i].vertices.clear();
+
+					const uint32_t e0 = d.inedges[i];
+
+					if (e0 == delaunay<T>::NONE)
+						continue;
+
+					// Triangles around the point go clockwise
+					ring.vertices.clear();
+
+					uint32_t e = e0, last = e0;
+
+					do
+					{
+						ring.vertices.push_back(centers[e / 3]);
+
+						last = delaunay<T>::next(e);
+						e = d.halfedges[last];
+					}
+					while (e != e0 && e != delaunay<T>::NONE);
+
+					if (d.halfedges[e0] == delaunay<T>::NONE)
+					{
+						// The cell of a hull point is open between rays that go along outward normals of both hull edges
+						const vec2d<double> p(double(points[i].x), double(points[i].y));
+
+						const auto& before = points[d.triangles[e0]];
+						const auto& after = points[d.triangles[delaunay<T>::next(last)]];
+
+						vec2d<double> n1(p.y - double(before.y), double(before.x) - p.x);
+						vec2d<double> n2(double(after.y) - p.y, p.x - double(after.x));
+
+						n1 = n1 / n1.mag();
+						n2 = n2 / n2.mag();
+
+						vec2d<double> bisector = n1 + n2;
+						const double len = bisector.mag();
+
+						bisector = len > 0.0 ? bisector / len : vec2d<double>(-n1.y, n1.x);
+
+						const vec2d<double> first = ring.vertices.front(), back = ring.vertices.back();
+						const double far = 4.0 * (diagonal + std::max((first - mid).mag(), (back - mid).mag()));
+
+						ring.vertices.insert(ring.vertices.begin(), first + n1 * far);
+						ring.vertices.push_back(back + n2 * far);
+						ring.vertices.push_back((first + back) * 0.5 + bisector * (far * 2.0));
+					}
+
+					std::reverse(ring.vertices.begin(), ring.vertices.end());
+
+					work.clip(ring, bounds, cells[i]);
+				}
+			}, 1024);
+	}
+
+	template <class T>
+	double simplifier<T>::sqr_segment_distance(const vec2d<T>& a, const vec2d<T>& b, const vec2d<T>& p)
+	{
+		const double ex = double(b.x) - double(a.x), ey = double(b.y) - double(a.y);
+		const double wx = double(p.x) - double(a.x), wy = double(p.y) - double(a.y);
+
+		const double len2 = ex * ex + ey * ey;
+		const double t = len2 > 0.0 ? std::clamp((wx * ex + wy * ey) / len2, 0.0, 1.0) : 0.0;
+
+		const double dx = wx - ex * t;
+		const double dy = wy - ey * t;
+
+		return dx * dx + dy * dy;
+	}
+
+	template <class T>
+	double simplifier<T>::triangle_area(const vec2d<T>& a, const vec2d<T>& b, const vec2d<T>& c)
+	{
+		return std::abs((double(b.x) - double(a.x)) * (double(c.y) - double(a.y)) - (double(b.y) - double(a.y)) * (double(c.x) - double(a.x))) * 0.5;
+	}
+
+	template <class T>
+	template <class A>
+	void simplifier<T>::simplify(std::span<const vec2d<T>> points, double tolerance, simplify_method method, std::vector<uint32_t, A>& kept)
+	{
+		kept.clear();
+
+		const size_t n = points.size();
+
+		if (n <= 2)
+		{
+			for (size_t i = 0; i < n; i++)
+				kept.push_back(uint32_t(i));
+
+			return;
+		}
+
+		keep.assign(n, 0);
+		keep[0] = keep[n - 1] = 1;
+
+		if (method == SIMPLIFY_DOUGLAS_PEUCKER)
+			douglas_peucker(points, tolerance);
+		else
+			visvalingam(points, tolerance);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (keep[i])
+				kept.push_back(uint32_t(i));
+		}
+	}
+
+	template <class T>
+	void simplifier<T>::douglas_peucker(std::span<const vec2d<T>> points, double tolerance)
+	{
+		const double sqr_tolerance = tolerance * tolerance;
+
+		ranges.clear();
+		ranges.push_back({ 0, uint32_t(points.size() - 1) });
+
+		while (!ranges.empty())
+		{
+			const auto [first, last] = ranges.back();
+			ranges.pop_back();
+
+			double farthest = sqr_tolerance;
+			uint32_t index = 0;
+
+			for (uint32_t i = first + 1; i < last; i++)
+			{
+				const double d = sqr_segment_distance(points[first], points[last], points[i]);
+
+				if (d > farthest)
+				{
+					farthest = d;
+					index = i;
+				}
+			}
+
+			if (index != 0)
+			{
+				keep[index] = 1;
+
+				ranges.push_back({ first, index });
+				ranges.push_back({ index, last });
+			}
+		}
+	}
+
+	template <class T>
+	void simplifier<T>::visvalingam(std::span<const vec2d<T>> points, double tolerance)
+	{
+		const uint32_t n = uint32_t(points.size());
+
+		prev.resize(n);
+		next.resize(n);
+		areas.resize(n);
+		heap.clear();
+
+		std::fill(keep.begin(), keep.end(), 1);
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			prev[i] = i - 1;
+			next[i] = i + 1;
+		}
+
+		auto greater = [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) { return a > b; };
+
+		for (uint32_t i = 1; i + 1 < n; i++)
+		{
+			areas[i] = triangle_area(points[i - 1], points[i], points[i + 1]);
+			heap.push_back({ areas[i], i });
+		}
+
+		std::make_heap(heap.begin(), heap.end(), greater);
+
+		while (!heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end(), greater);
+			const auto [area, i] = heap.back();
+			heap.pop_back();
+
+			// Entries of removed points and outdated areas are skipped instead of being removed from the heap
+			if (!keep[i] || area != areas[i])
+				continue;
+
+			if (area >= tolerance)
+				break;
+
+			keep[i] = 0;
+
+			const uint32_t a = prev[i], b = next[i];
+
+			next[a] = b;
+			prev[b] = a;
+
+			// Areas never drop below the area of the removed point, so neighbours can't leave earlier than it
+			if (a != 0)
+			{
+				areas[a] = std::max(area, triangle_area(points[prev[a]], points[a], points[b]));
+				heap.push_back({ areas[a], a });
+				std::push_heap(heap.begin(), heap.end(), greater);
+			}
+
+			if (b != n - 1)
+			{
+				areas[b] = std::max(area, triangle_area(points[a], points[b], points[next[b]]));
+				heap.push_back({ areas[b], b });
+				std::push_heap(heap.begin(), heap.end(), greater);
+			}
+		}
+	}
+
+	template <class T>
+	stream_simplifier<T>::stream_simplifier(double t, size_t c) : tolerance(t), capacity(std::max<size_t>(c, 3))
+	{
+		window.reserve(capacity);
+	}
+
+	template <class T>
+	template <class F>
+	void stream_simplifier<T>::push(const vec2d<T>& p, F&& emit)
+	{
+		window.push_back(p);
+
+		if (window.size() < capacity)
+			return;
+
+		work.simplify(std::span<const vec2d<T>>(window), tolerance, SIMPLIFY_DOUGLAS_PEUCKER, kept);
+
+		for (size_t i = 0; i + 1 < kept.size(); i++)
+			emit(window[kept[i]]);
+
+		const vec2d<T> last = window.back();
+
+		window.clear();
+		window.push_back(last);
+	}
+
+	template <class T>
+	template <class F>
+	void stream_simplifier<T>::finish(F&& emit)
+	{
+		work.simplify(std::span<const vec2d<T>>(window), tolerance, SIMPLIFY_DOUGLAS_PEUCKER, kept);
+
+		for (uint32_t i : kept)
+			emit(window[i]);
+
+		window.clear();
+	}
+
+	template <class T, class A>
+	void simplify(std::span<const vec2d<T>> points, double tolerance, std::vector<vec2d<T>, A>& result, simplify_method method)
+	{
+		simplifier<T> work;
+		std::vector<uint32_t> kept;
+
+		work.simplify(points, tolerance, method, kept);
+
+		result.clear();
+
+		for (uint32_t i : kept)
+			result.push_back(points[i]);
+	}
+
+	template <class T>
+	void simplify(std::span<const std::vector<vec2d<T>>> lines, double tolerance, std::vector<std::vector<vec2d<T>>>& results, simplify_method method)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("simplify", "build");
+
+		results.resize(lines.size());
+
+		utils::parallel_for(lines.size(), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("simplify chunk", "build");
+
+				simplifier<T> work;
+				std::vector<uint32_t> kept;
+
+				for (size_t i = begin; i < end; i++)
+				{
+					work.simplify(std::span<const vec2d<T>>(lines[i]), tolerance, method, kept);
+
+					results[i].clear();
+
+					for (uint32_t k : kept)
+						results[i].push_back(lines[i][k]);
+				}
+			}, 16);
+	}
+
+	template <class T>
+	offsetter<T>::offsetter(std::pmr::memory_resource* r) : resource(r)
+	{
+
+	}
+
+	template <class T>
+	void offsetter<T>::set_input(const polygon<T>& p)
+	{
+		input.clear();
+
+		for (const auto& v : p.vertices)
+		{
+			const vec2d<double> d(double(v.x), double(v.y));
+
+			if (input.empty() || input.back() != d)
+				input.push_back(d);
+		}
+
+		while (input.size() > 1 && input.front() == input.back())
+			input.pop_back();
+
+		double sum = 0.0;
+
+		for (size_t i = 0, j = input.size() - 1; i < input.size(); j = i++)
+			sum += input[j].cross(input[i]);
+
+		if (sum < 0.0)
+			std::reverse(input.begin(), input.end());
+	}
+
+	template <class T>
+	void offsetter<T>::build_ring(double delta, join_type join, double miter_limit, double arc_tolerance)
+	{
+		const size_t n = input.size();
+
+		points.clear();
+
+		const double tolerance = arc_tolerance > 0.0 ? arc_tolerance : std::abs(delta) * 0.005;
+		const double step = 2.0 * std::acos(1.0 - std::min(tolerance / std::abs(delta), 1.0));
+
+		for (size_t j = 0; j < n; j++)
+		{
+			const vec2d<double>& before = input[(j + n - 1) % n];
+			const vec2d<double>& v = input[j];
+			const vec2d<double>& after = input[(j + 1) % n];
+
+			const vec2d<double> e0 = (v - before) / (v - before).mag();
+			const vec2d<double> e1 = (after - v) / (after - v).mag();
+
+			// Outward normals of counter-clockwise edges are on their right
+			const vec2d<double> n0(e0.y, -e0.x), n1(e1.y, -e1.x);
+
+			const double cross = e0.cross(e1);
+			const double dot = e0.dot(e1);
+
+			const vec2d<double> p = v + n0 * delta;
+			const vec2d<double> q = v + n1 * delta;
+
+			if (std::abs(cross) < 1e-12 && dot > 0.0)
+			{
+				points.push_back(p);
+				continue;
+			}
+
+			// Inner joins go through the vertex so the loops they make have negative winding and are removed by resolve
+			if (cross * delta < 0.0)
+			{
+				points.push_back(p);
+				points.push_back(v);
+				points.push_back(q);
+				continue;
+			}
+
+			switch (join)
+			{
+			case JOIN_MITER:
+			{
+				const double k = 1.0 + n0.dot(n1);
+
+				// The miter is 1 / cos(angle / 2) times longer than delta
+				if (k * miter_limit * miter_limit > 2.0)
+					points.push_back(v + (n0 + n1) * (delta / k));
+				else
+				{
+					points.push_back(p);
+					points.push_back(q);
+				}
+			}
+			break;
+
+			case JOIN_ROUND:
+			{
+				const double angle = std::atan2(n0.cross(n1), n0.dot(n1));
+				const uint32_t steps = std::min(uint32_t(std::ceil(std::abs(angle) / step)), 1024u);
+
+				points.push_back(p);
+
+				for (uint32_t k = 1; k < steps; k++)
+				{
+					const double a = angle * double(k) / double(steps);
+					const double c = std::cos(a), s = std::sin(a);
+
+					points.push_back(v + vec2d<double>(n0.x * c - n0.y * s, n0.x * s + n0.y * c) * delta);
+				}
+
+				points.push_back(q);
+			}
+			break;
+
+			case JOIN_BEVEL:
+				points.push_back(p);
+				points.push_back(q);
+			break;
+
+			}
+		}
+
+		ring_size = uint32_t(points.size());
+	}
+
+	template <class T>
+	uint32_t offsetter<T>::find(uint32_t id)
+	{
+		while (parent[id] != id)
+		{
+			parent[id] = parent[parent[id]];
+			id = parent[id];
+		}
+
+		return id;
+	}
+
+	template <class T>
+	void offsetter<T>::intersect_edges(uint32_t ea, uint32_t eb)
+	{
+		constexpr double EPS = 1e-10;
+
+		const uint32_t na = ea + 1 == ring_size ? 0 : ea + 1;
+		const uint32_t nb = eb + 1 == ring_size ? 0 : eb + 1;
+
+		const auto p = points[ea];
+		const auto q = points[eb];
+		const auto r = points[na] - p;
+		const auto s = points[nb] - q;
+		const auto qp = q - p;
+
+		const double denom = r.cross(s);
+
+		if (std::abs(denom) <= EPS * r.mag() * s.mag())
+		{
+			const double rr = r.dot(r), ss = s.dot(s);
+
+			if (std::abs(qp.cross(r)) > EPS * rr)
+				return;
+
+			// Collinear edges are split at ends of each other so the overlap becomes the same pair of nodes on both
+			auto split_at = [&](uint32_t edge, uint32_t from, uint32_t to, double t, uint32_t vertex)
+				{
+					if (t <= EPS)
+						parent[find(vertex)] = find(from);
+					else if (t >= 1.0 - EPS)
+					{
+						if (t <= 1.0 + EPS)
+							parent[find(vertex)] = find(to);
+					}
+					else
+						splits.push_back({ edge, t, vertex });
+				};
+
+			const double tq = qp.dot(r) / rr, tn = (points[nb] - p).dot(r) / rr;
+			const double up = -qp.dot(s) / ss, un = (points[na] - q).dot(s) / ss;
+
+			if (tq >= -EPS && tq <= 1.0 + EPS)
+				split_at(ea, ea, na, tq, eb);
+
+			if (tn >= -EPS && tn <= 1.0 + EPS)
+				split_at(ea, ea, na, tn, nb);
+
+			if (up >= -EPS && up <= 1.0 + EPS)
+				split_at(eb, eb, nb, up, ea);
+
+			if (un >= -EPS && un <= 1.0 + EPS)
+				split_at(eb, eb, nb, un, na);
+
+			return;
+		}
+
+		const double t = qp.cross(s) / denom;
+		const double u = qp.cross(r) / denom;
+
+		if (t < -EPS || t > 1.0 + EPS || u < -EPS || u > 1.0 + EPS)
+			return;
+
+		const uint32_t end_a = t <= EPS ? ea : (t >= 1.0 - EPS ? na : UINT32_MAX);
+		const uint32_t end_b = u <= EPS ? eb : (u >= 1.0 - EPS ? nb : UINT32_MAX);
+
+		if (end_a != UINT32_MAX && end_b != UINT32_MAX)
+			parent[find(end_b)] = find(end_a);
+		else if (end_a != UINT32_MAX)
+			splits.push_back({ eb, u, end_a });
+		else if (end_b != UINT32_MAX)
+			splits.push_back({ ea, t, end_b });
+		else
+		{
+			const uint32_t id = (uint32_t)points.size();
+
+			points.push_back(p + r * t);
+			parent.push_back(id);
+
+			splits.push_back({ ea, t, id });
+			splits.push_back({ eb, u, id });
+		}
+	}
+
+	template <class T>
+	int32_t offsetter<T>::winding(const vec2d<double>& p, std::span<const uint32_t> skip, bool vertical) const
+	{
+		int32_t w = 0;
+
+		for (uint32_t i = 0; i < ring_size; i++)
+		{
+			if (std::find(skip.begin(), skip.end(), i) != skip.end())
+				continue;
+
+			const auto& a = points[i];
+			const auto& b = points[i + 1 == ring_size ? 0 : i + 1];
+
+			if (vertical)
+			{
+				if ((a.x > p.x) != (b.x > p.x) && a.y + (p.x - a.x) * (b.y - a.y) / (b.x - a.x) > p.y)
+					w += b.x < a.x ? 1 : -1;
+			}
+			else
+			{
+				if ((a.y > p.y) != (b.y > p.y) && a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y) > p.x)
+					w += b.y > a.y ? 1 : -1;
+			}
+		}
+
+		return w;
+	}
+
+	template <class T>
+	template <class A>
+	void offsetter<T>::resolve(std::vector<polygon<T>, A>& result)
+	{
+		result.clear();
+
+		if (ring_size < 3)
+			return;
+
+		splits.clear();
+		parent.resize(ring_size);
+
+		for (uint32_t i = 0; i < ring_size; i++)
+			parent[i] = i;
+
+		// Sweep along x so only edges with overlapping x ranges are tested against each other
+
+		sweep.clear();
+
+		for (uint32_t e = 0; e < ring_size; e++)
+		{
+			const double x1 = points[e].x;
+			const double x2 = points[e + 1 == ring_size ? 0 : e + 1].x;
+
+			sweep.push_back({ std::min(x1, x2), std::max(x1, x2), e });
+		}
+
+		std::sort(sweep.begin(), sweep.end(), [](const sweep_edge& lhs, const sweep_edge& rhs) { return lhs.min_x < rhs.min_x; });
+
+		active.clear();
+
+		for (uint32_t i = 0; i < sweep.size(); i++)
+		{
+			const auto& cur = sweep[i];
+
+			for (size_t j = 0; j < active.size();)
+			{
+				if (sweep[active[j]].max_x < cur.min_x)
+				{
+					active[j] = active.back();
+					active.pop_back();
+				}
+				else
+					j++;
+			}
+
+			const double y1 = points[cur.edge].y;
+			const double y2 = points[cur.edge + 1 == ring_size ? 0 : cur.edge + 1].y;
+
+			for (uint32_t j : active)
+			{
+				const uint32_t other = sweep[j].edge;
+
+				// Neighbouring edges only share their common vertex
+				if (other + 1 == cur.edge || cur.edge + 1 == other || (other == 0 && cur.edge + 1 == ring_size) || (cur.edge == 0 && other + 1 == ring_size))
+					continue;
+
+				const double y3 = points[other].y;
+				const double y4 = points[other + 1 == ring_size ? 0 : other + 1].y;
+
+				if (std::max(y1, y2) < std::min(y3, y4) || std::max(y3, y4) < std::min(y1, y2))
+					continue;
+
+				intersect_edges(std::min(cur.edge, other), std::max(cur.edge, other));
+			}
+
+			active.push_back(i);
+		}
+
+		// Vertices with the same coordinates become the same vertex
+
+		sorted.resize(points.size());
+
+		for (uint32_t i = 0; i < sorted.size(); i++)
+			sorted[i] = i;
+
+		std::sort(sorted.begin(), sorted.end(), [this](uint32_t lhs, uint32_t rhs)
+			{
+				return points[lhs].x < points[rhs].x || (points[lhs].x == points[rhs].x && points[lhs].y < points[rhs].y);
+			});
+
+		for (size_t i = 1; i < sorted.size(); i++)
+		{
+			if (points[sorted[i]] == points[sorted[i - 1]])
+				parent[find(sorted[i])] = find(sorted[i - 1]);
+		}
+
+		std::sort(splits.begin(), splits.end(), [](const split& lhs, const split& rhs)
+			{
+				return lhs.edge < rhs.edge || (lhs.edge == rhs.edge && lhs.t < rhs.t);
+			});
+
+		// Walk the ring through all vertices and intersections, each node remembers the raw edge that leaves it
+
+		nodes.clear();
+		node_edges.clear();
+
+		auto push = [&](uint32_t id, uint32_t edge)
+			{
+				id = find(id);
+
+				if (!nodes.empty() && nodes.back() == id)
+					node_edges.back() = edge;
+				else
+				{
+					nodes.push_back(id);
+					node_edges.push_back(edge);
+				}
+			};
+
+		for (uint32_t e = 0, next_split = 0; e < ring_size; e++)
+		{
+			push(e, e);
+
+			for (; next_split < splits.size() && splits[next_split].edge == e; next_split++)
+				push(splits[next_split].id, e);
+		}
+
+		while (nodes.size() > 1 && nodes.front() == nodes.back())
+		{
+			nodes.pop_back();
+			node_edges.pop_back();
+		}
+
+		const uint32_t count = uint32_t(nodes.size());
+
+		if (count < 3)
+			return;
+
+		occurrences.assign(points.size(), 0);
+
+		for (uint32_t id : nodes)
+			occurrences[id]++;
+
+		// Pieces run between nodes the ring passes more than once, a piece is kept if winding on its right side is zero and on its left side is positive
+
+		uint32_t start = 0;
+
+		while (start < count && occurrences[nodes[start]] < 2)
+			start++;
+
+		const bool simple = start == count;
+
+		if (simple)
+			start = 0;
+
+		pieces.clear();
+
+		for (uint32_t k = 0; k < count;)
+		{
+			uint32_t length = 1;
+
+			while (length < count && !(occurrences[nodes[(start + k + length) % count]] > 1))
+				length++;
+
+			const uint32_t first = (start + k) % count;
+			pieces.push_back({ first, length, nodes[first], nodes[(first + length) % count] });
+
+			k += length;
+		}
+
+		// Net is the number of pieces on the first segment going the same way minus the ones going the other way
+		auto right_winding = [&](const piece& pc, std::span<const uint32_t> skip, int32_t net)
+			{
+				const vec2d<double>& a = points[pc.from];
+				const vec2d<double>& b = points[nodes[(pc.first + 1) % count]];
+				const vec2d<double> d = b - a;
+
+				const bool vertical = std::abs(d.x) > std::abs(d.y);
+				const int32_t w = winding((a + b) * 0.5, skip, vertical);
+
+				return (vertical ? -d.x : d.y) > 0.0 ? w : w - net;
+			};
+
+		kept.assign(pieces.size(), false);
+		overlaps.clear();
+
+		for (uint32_t i = 0; i < pieces.size(); i++)
+		{
+			const piece& pc = pieces[i];
+
+			// Overlapping edges give pieces of one segment with the same ends, they bound the same area so they're classified together
+			if (pc.last == 1 && pc.from != pc.to)
+				overlaps.push_back({ uint64_t(std::min(pc.from, pc.to)) << 32 | std::max(pc.from, pc.to), i });
+			else
+				kept[i] = right_winding(pc, { &node_edges[pc.first], 1 }, 1) == 0;
+		}
+
+		std::sort(overlaps.begin(), overlaps.end());
+
+		for (size_t begin = 0, end; begin < overlaps.size(); begin = end)
+		{
+			const piece& ref = pieces[overlaps[begin].second];
+
+			int32_t net = 0;
+			skipped.clear();
+
+			for (end = begin; end < overlaps.size() && overlaps[end].first == overlaps[begin].first; end++)
+			{
+				const piece& pc = pieces[overlaps[end].second];
+
+				net += pc.from == ref.from ? 1 : -1;
+				skipped.push_back(node_edges[pc.first]);
+			}
+
+			const int32_t w = right_winding(ref, skipped, net);
+
+			// At most one of them bounds the filled area, going the way that keeps it on the left
+			if (w <= 0 && w + net > 0)
+				kept[overlaps[begin].second] = true;
+			else if (w > 0 && w + net <= 0)
+			{
+				for (size_t j = begin; j < end; j++)
+				{
+					if (pieces[overlaps[j].second].from != ref.from)
+					{
+						kept[overlaps[j].second] = true;
+						break;
+					}
+				}
+			}
+		}
+
+		size_t size = 0;
+
+		for (uint32_t i = 0; i < pieces.size(); i++)
+		{
+			if (kept[i])
+				pieces[size++] = pieces[i];
+		}
+
+		pieces.resize(size);
+
+		// Chain the kept pieces into rings
+
+		const uint32_t vertices = (uint32_t)points.size();
+
+		out_offset.assign(vertices + 1, 0);
+
+		for (const auto& pc : pieces)
+			out_offset[pc.from + 1]++;
+
+		for (uint32_t v = 0; v < vertices; v++)
+			out_offset[v + 1] += out_offset[v];
+
+		out_pieces.resize(pieces.size());
+		sorted.assign(out_offset.begin(), out_offset.end() - 1);
+
+		for (uint32_t i = 0; i < pieces.size(); i++)
+			out_pieces[sorted[pieces[i].from]++] = i;
+
+		used.assign(pieces.size(), false);
+
+		polygon<T> ring;
+
+		for (uint32_t begin = 0; begin < pieces.size(); begin++)
+		{
+			if (used[begin])
+				continue;
+
+			ring.vertices.clear();
+
+			bool closed = false;
+
+			for (uint32_t i = begin; i != UINT32_MAX;)
+			{
+				used[i] = true;
+
+				const piece& pc = pieces[i];
+
+				for (uint32_t k = 0; k < pc.last; k++)
+				{
+					const auto& p = points[nodes[(pc.first + k) % count]];
+					ring.vertices.push_back({ static_cast<T>(p.x), static_cast<T>(p.y) });
+				}
+
+				if (pc.to == pieces[begin].from)
+				{
+					closed = true;
+					break;
+				}
+
+				i = UINT32_MAX;
+
+				for (uint32_t j = out_offset[pc.to]; j < out_offset[pc.to + 1]; j++)
+				{
+					if (!used[out_pieces[j]])
+					{
+						i = out_pieces[j];
+						break;
+					}
+				}
+			}
+
+			if (closed && ring.vertices.size() >= 3)
+				result.push_back(ring);
+		}
+	}
+
+	template <class T>
+	template <class A>
+	bool offsetter<T>::offset(const polygon<T>& p, double delta, join_type join, std::vector<polygon<T>, A>& result, double miter_limit, double arc_tolerance)
+	{
+		set_input(p);
+
+		if (input.size() < 3)
+		{
+			result.clear();
+			return false;
+		}
+
+		if (delta == 0.0)
+		{
+			result.assign(1, p);
+			return true;
+		}
+
+		build_ring(delta, join, miter_limit, arc_tolerance);
+		resolve(result);
+
+		return !result.empty();
+	}
+
+	template <class T, class A>
+	bool offset(const polygon<T>& p, double delta, join_type join, std::vector<polygon<T>, A>& result, double miter_limit, double arc_tolerance)
+	{
+		offsetter<T> work(utils::resource_of(result.get_allocator()));
+		return work.offset(p, delta, join, result, miter_limit, arc_tolerance);
+	}
+
+	template <class T>
+	void offset(std::span<const polygon<T>> polygons, double delta, join_type join, std::vector<std::vector<polygon<T>>>& results, double miter_limit, double arc_tolerance)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("offset", "build");
+
+		results.resize(polygons.size());
+
+		utils::parallel_for(polygons.size(), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("offset chunk", "build");
+
+				offsetter<T> work;
+
+				for (size_t i = begin; i < end; i++)
+					work.offset(polygons[i], delta, join, results[i], miter_limit, arc_tolerance);
+			}, 16);
+	}
+
+	template <class T>
+	void minkowski_sum(const polygon<T>& a, const polygon<T>& b, polygon<T>& result)
+	{
+		result.vertices.clear();
+
+		// Counter-clockwise copies that start at the lowest vertex so edges of both go in the order of their angles
+		auto prepare = [](const polygon<T>& p, std::vector<vec2d<double>>& out)
+			{
+				const size_t n = p.vertices.size();
+
+				double sum = 0.0;
+
+				for (size_t i = 0, j = n - 1; i < n; j = i++)
+					sum += double(p.vertices[j].x) * double(p.vertices[i].y) - double(p.vertices[i].x) * double(p.vertices[j].y);
+
+				out.resize(n);
+
+				size_t lowest = 0;
+
+				for (size_t i = 0; i < n; i++)
+				{
+					const auto& v = p.vertices[sum < 0.0 ? n - 1 - i : i];
+					out[i] = { double(v.x), double(v.y) };
+
+					if (out[i].y < out[lowest].y || (out[i].y == out[lowest].y && out[i].x < out[lowest].x))
+						lowest = i;
+				}
+
+				std::rotate(out.begin(), out.begin() + lowest, out.end());
+			};
+
+		if (a.vertices.empty() || b.vertices.empty())
+			return;
+
+		std::vector<vec2d<double>> pa, pb;
+
+		prepare(a, pa);
+		prepare(b, pb);
+
+		const size_t n = pa.size(), m = pb.size();
+
+		size_t i = 0, j = 0;
+
+		while (i < n || j < m)
+		{
+			const vec2d<double> v = pa[i % n] + pb[j % m];
+			result.vertices.push_back({ static_cast<T>(v.x), static_cast<T>(v.y) });
+
+			const double cross = (pa[(i + 1) % n] - pa[i % n]).cross(pb[(j + 1) % m] - pb[j % m]);
+
+			if (cross >= 0.0 && i < n)
+				i++;
+
+			if (cross <= 0.0 && j < m)
+				j++;
+		}
+	}
+
+	template <class T>
+	void minkowski_sum(const polygon<T>& p, const rect<T>& r, polygon<T>& result)
+	{
+		minkowski_sum(p, polygon<T>({ r.top_left(), r.top_right(), r.bottom_right(), r.bottom_left() }), result);
+	}
+
+	template <class T>
+	void minkowski_sum(const polygon<T>& p, const circle<T>& c, polygon<T>& result, double arc_tolerance)
+	{
+		result.vertices.clear();
+
+		offsetter<T> work;
+		work.set_input(p);
+
+		if (work.input.empty())
+			return;
+
+		if (work.input.size() < 3 || c.radius <= T(0))
+		{
+			for (const auto& v : work.input)
+				result.vertices.push_back({ static_cast<T>(v.x + double(c.pos.x)), static_cast<T>(v.y + double(c.pos.y)) });
+
+			return;
+		}
+
+		// A convex ring with round joins has no self-intersections, so it's the sum itself
+		work.build_ring(double(c.radius), JOIN_ROUND, 2.0, arc_tolerance);
+
+		for (const auto& v : work.points)
+			result.vertices.push_back({ static_cast<T>(v.x + double(c.pos.x)), static_cast<T>(v.y + double(c.pos.y)) });
+	}
+
+	template <class T, class S>
+	void minkowski_sum(std::span<const polygon<T>> polygons, const S& shape, std::vector<polygon<T>>& results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("minkowski sum", "build");
+
+		results.resize(polygons.size());
+
+		utils::parallel_for(polygons.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					minkowski_sum(polygons[i], shape, results[i]);
+			}, 64);
+	}
+
+	template <class T1, class T2>
+	constexpr double closest_points(const line<T1>& l1, const line<T2>& l2, double& s, double& t)
+	{
+		const double d1x = double(l1.end.x) - double(l1.start.x), d1y = double(l1.end.y) - double(l1.start.y);
+		const double d2x = double(l2.end.x) - double(l2.start.x), d2y = double(l2.end.y) - double(l2.start.y);
+		const double rx = double(l1.start.x) - double(l2.start.x), ry = double(l1.start.y) - double(l2.start.y);
+
+		const double a = d1x * d1x + d1y * d1y;
+		const double e = d2x * d2x + d2y * d2y;
+		const double f = d2x * rx + d2y * ry;
+
+		s = 0.0;
+		t = 0.0;
+
+		if (a <= 0.0)
+		{
+			if (e > 0.0)
+				t = std::clamp(f / e, 0.0, 1.0);
+		}
+		else
+		{
+			const double c = d1x * rx + d1y * ry;
+
+			if (e <= 0.0)
+				s = std::clamp(-c / a, 0.0, 1.0);
+			else
+			{
+				// Closest points of the infinite lines are clamped to l1 first and then to l2
+				const double b = d1x * d2x + d1y * d2y;
+				const double denom = a * e - b * b;
+
+				if (denom > 0.0)
+					s = std::clamp((b * f - c * e) / denom, 0.0, 1.0);
+
+				t = (b * s + f) / e;
+
+				if (t < 0.0)
+				{
+					t = 0.0;
+					s = std::clamp(-c / a, 0.0, 1.0);
+				}
+				else if (t > 1.0)
+				{
+					t = 1.0;
+					s = std::clamp((b - c) / a, 0.0, 1.0);
+				}
+			}
+		}
+
+		const double dx = rx + d1x * s - d2x * t;
+		const double dy = ry + d1y * s - d2y * t;
+
+		return dx * dx + dy * dy;
+	}
+
+	template <class T1, class T2>
+	constexpr double sqr_distance(const line<T1>& l, const rect<T2>& r)
+	{
+		double s, t;
+
+		if (clip(l, r, s, t))
+			return 0.0;
+
+		// Closest points of a segment and a rectangle that don't cross involve an end of the segment or a corner of the rectangle
+		double sqr_dist = std::numeric_limits<double>::max();
+
+		for (const vec2d<T1>& p : { l.start, l.end })
+		{
+			const double dx = std::max({ double(r.pos.x) - double(p.x), double(p.x) - double(r.pos.x) - double(r.size.x), 0.0 });
+			const double dy = std::max({ double(r.pos.y) - double(p.y), double(p.y) - double(r.pos.y) - double(r.size.y), 0.0 });
+
+			sqr_dist = std::min(sqr_dist, dx * dx + dy * dy);
+		}
+
+		for (const vec2d<T2>& corner : { r.top_left(), r.top_right(), r.bottom_left(), r.bottom_right() })
+			sqr_dist = std::min(sqr_dist, closest_points(l, line<T2>(corner, corner), s, t));
+
+		return sqr_dist;
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const circle<T2>& c)
+	{
+		double s, t;
+
+		const double radius = double(cp.radius) + double(c.radius);
+		return closest_points(cp.axis(), line<T2>(c.pos, c.pos), s, t) <= radius * radius;
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const circle<T1>& c, const capsule<T2>& cp)
+	{
+		return intersects(cp, c);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const rect<T2>& r)
+	{
+		return sqr_distance(cp.axis(), r) <= double(cp.radius) * double(cp.radius);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const rect<T1>& r, const capsule<T2>& cp)
+	{
+		return intersects(cp, r);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp, const line<T2>& l)
+	{
+		double s, t;
+		return closest_points(cp.axis(), l, s, t) <= double(cp.radius) * double(cp.radius);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const line<T1>& l, const capsule<T2>& cp)
+	{
+		return intersects(cp, l);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const capsule<T1>& cp1, const capsule<T2>& cp2)
+	{
+		double s, t;
+
+		const double radius = double(cp1.radius) + double(cp2.radius);
+		return closest_points(cp1.axis(), cp2.axis(), s, t) <= radius * radius;
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const circle<T2>& c)
+	{
+		double s, t;
+		return std::max(utils::sqrt(closest_points(cp.axis(), line<T2>(c.pos, c.pos), s, t)) - double(cp.radius) - double(c.radius), 0.0);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const circle<T1>& c, const capsule<T2>& cp)
+	{
+		return distance(cp, c);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const rect<T2>& r)
+	{
+		return std::max(utils::sqrt(sqr_distance(cp.axis(), r)) - double(cp.radius), 0.0);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const rect<T1>& r, const capsule<T2>& cp)
+	{
+		return distance(cp, r);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp, const line<T2>& l)
+	{
+		double s, t;
+		return std::max(utils::sqrt(closest_points(cp.axis(), l, s, t)) - double(cp.radius), 0.0);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const line<T1>& l, const capsule<T2>& cp)
+	{
+		return distance(cp, l);
+	}
+
+	template <class T1, class T2>
+	constexpr double distance(const capsule<T1>& cp1, const capsule<T2>& cp2)
+	{
+		double s, t;
+		return std::max(utils::sqrt(closest_points(cp1.axis(), cp2.axis(), s, t)) - double(cp1.radius) - double(cp2.radius), 0.0);
+	}
+
+	template <class T>
+	void capsule_buffer<T>::clear()
+	{
+		start_x.clear();
+		start_y.clear();
+		end_x.clear();
+		end_y.clear();
+		radius.clear();
+	}
+
+	template <class T>
+	size_t capsule_buffer<T>::size() const
+	{
+		return radius.size();
+	}
+
+	template <class T>
+	void capsule_buffer<T>::push(const capsule<T>& c)
+	{
+		start_x.push_back(c.start.x);
+		start_y.push_back(c.start.y);
+		end_x.push_back(c.end.x);
+		end_y.push_back(c.end.y);
+		radius.push_back(c.radius);
+	}
+
+	template <class T>
+	capsule<T> capsule_buffer<T>::at(size_t i) const
+	{
+		return capsule<T>({ start_x[i], start_y[i] }, { end_x[i], end_y[i] }, radius[i]);
+	}
+
+	template <class T1, class T2>
+	void intersects(const capsule_buffer<T1>& capsules, const circle<T2>& c, std::span<uint8_t> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("capsule intersects", "query");
+
+		const double cx = double(c.pos.x), cy = double(c.pos.y), cr = double(c.radius);
+
+		utils::parallel_for(std::min(capsules.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("capsule intersects chunk", "query");
+
+				const T1* sx = capsules.start_x.data();
+				const T1* sy = capsules.start_y.data();
+				const T1* ex = capsules.end_x.data();
+				const T1* ey = capsules.end_y.data();
+				const float* rs = capsules.radius.data();
+
+				// Branchless point to segment distance so the loop vectorizes over the columns
+				for (size_t i = begin; i < end; i++)
+				{
+					const double dx = double(ex[i]) - double(sx[i]), dy = double(ey[i]) - double(sy[i]);
+					const double px = cx - double(sx[i]), py = cy - double(sy[i]);
+
+					const double len2 = dx * dx + dy * dy;
+					const double t = std::clamp((px * dx + py * dy) / std::max(len2, std::numeric_limits<double>::min()), 0.0, 1.0);
+
+					const double wx = px - dx * t, wy = py - dy * t;
+					const double radius = double(rs[i]) + cr;
+
+					results[i] = uint8_t(wx * wx + wy * wy <= radius * radius);
+				}
+			}, 16384);
+	}
+
+	template <class T, class S>
+	void intersects(const capsule_buffer<T>& capsules, const S& shape, std::span<uint8_t> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("capsule intersects", "query");
+
+		utils::parallel_for(std::min(capsules.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("capsule intersects chunk", "query");
+
+				for (size_t i = begin; i < end; i++)
+					results[i] = uint8_t(intersects(capsules.at(i), shape));
+			}, 16384);
+	}
+
+	template <class T1, class T2>
+	void distance(const capsule_buffer<T1>& capsules, const circle<T2>& c, std::span<double> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("capsule distance", "query");
+
+		const double cx = double(c.pos.x), cy = double(c.pos.y), cr = double(c.radius);
+
+		utils::parallel_for(std::min(capsules.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("capsule distance chunk", "query");
+
+				const T1* sx = capsules.start_x.data();
+				const T1* sy = capsules.start_y.data();
+				const T1* ex = capsules.end_x.data();
+				const T1* ey = capsules.end_y.data();
+				const float* rs = capsules.radius.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const double dx = double(ex[i]) - double(sx[i]), dy = double(ey[i]) - double(sy[i]);
+					const double px = cx - double(sx[i]), py = cy - double(sy[i]);
+
+					const double len2 = dx * dx + dy * dy;
+					const double t = std::clamp((px * dx + py * dy) / std::max(len2, std::numeric_limits<double>::min()), 0.0, 1.0);
+
+					const double wx = px - dx * t, wy = py - dy * t;
+
+					results[i] = std::max(std::sqrt(wx * wx + wy * wy) - double(rs[i]) - cr, 0.0);
+				}
+			}, 16384);
+	}
+
+	template <class T, class S>
+	void distance(const capsule_buffer<T>& capsules, const S& shape, std::span<double> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("capsule distance", "query");
+
+		utils::parallel_for(std::min(capsules.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("capsule distance chunk", "query");
+
+				for (size_t i = begin; i < end; i++)
+					results[i] = distance(capsules.at(i), shape);
+			}, 16384);
+	}
+
+	template <class T1, class T2>
+	constexpr bool contains(const triangle<T1>& t, const vec2d<T2>& p)
+	{
+		DEF_GEOMETRY2D_PROBE(PROBE_CONTAINS_TRIANGLE_POINT);
+
+		// A degenerate triangle has no inside, otherwise it would contain its whole supporting line
+		if (t.degenerate())
+			return DEF_GEOMETRY2D_EARLY_OUT(false);
+
+		const double px = double(p.x), py = double(p.y);
+
+		// Edge functions are twice the signed areas of triangles made by each edge and p
+		const double e0 = (double(t.b.x) - double(t.a.x)) * (py - double(t.a.y)) - (double(t.b.y) - double(t.a.y)) * (px - double(t.a.x));
+		const double e1 = (double(t.c.x) - double(t.b.x)) * (py - double(t.b.y)) - (double(t.c.y) - double(t.b.y)) * (px - double(t.b.x));
+		const double e2 = (double(t.a.x) - double(t.c.x)) * (py - double(t.c.y)) - (double(t.a.y) - double(t.c.y)) * (px - double(t.c.x));
+
+		return DEF_GEOMETRY2D_RESULT((e0 >= 0.0 && e1 >= 0.0 && e2 >= 0.0) || (e0 <= 0.0 && e1 <= 0.0 && e2 <= 0.0));
+	}
+
+	template <class T1, class T2>
+	void contains(const triangle<T1>& t, std::span<const vec2d<T2>> points, std::span<uint8_t> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("triangle contains", "query");
+
+		const size_t count = std::min(points.size(), results.size());
+
+		// The sign comes from the double cross product since signed_area() rounds to T
+		const double area = (double(t.b.x) - double(t.a.x)) * (double(t.c.y) - double(t.a.y)) - (double(t.c.x) - double(t.a.x)) * (double(t.b.y) - double(t.a.y));
+
+		if (area == 0.0)
+		{
+			std::fill(results.begin(), results.begin() + count, uint8_t(0));
+			return;
+		}
+
+		// Edges of a clockwise triangle are flipped so each edge function is nonnegative inside
+		const double sign = area < 0.0 ? -1.0 : 1.0;
+
+		double nx[3], ny[3], d[3];
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			const line<T1> s = t.side(i);
+
+			nx[i] = -(double(s.end.y) - double(s.start.y)) * sign;
+			ny[i] = (double(s.end.x) - double(s.start.x)) * sign;
+			d[i] = -(nx[i] * double(s.start.x) + ny[i] * double(s.start.y));
+		}
+
+		utils::parallel_for(count, [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("triangle contains chunk", "query");
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const double x = double(points[i].x), y = double(points[i].y);
+
+					const double e0 = nx[0] * x + ny[0] * y + d[0];
+					const double e1 = nx[1] * x + ny[1] * y + d[1];
+					const double e2 = nx[2] * x + ny[2] * y + d[2];
+
+					results[i] = uint8_t(e0 >= 0.0) & uint8_t(e1 >= 0.0) & uint8_t(e2 >= 0.0);
+				}
+			}, 16384);
+	}
+
+	template <class T1, class T2>
+	void contains(const triangle_buffer<T1>& triangles, const vec2d<T2>& p, std::span<uint8_t> results)
+	{
+		DEF_GEOMETRY2D_TRACE_SCOPE("triangles contain", "query");
+
+		const double px = double(p.x), py = double(p.y);
+
+		utils::parallel_for(std::min(triangles.size(), results.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("triangles contain chunk", "query");
+
+				const T1* ax = triangles.ax.data();
+				const T1* ay = triangles.ay.data();
+				const T1* bx = triangles.bx.data();
+				const T1* by = triangles.by.data();
+				const T1* cx = triangles.cx.data();
+				const T1* cy = triangles.cy.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const double e0 = (double(bx[i]) - double(ax[i])) * (py - double(ay[i])) - (double(by[i]) - double(ay[i])) * (px - double(ax[i]));
+					const double e1 = (double(cx[i]) - double(bx[i])) * (py - double(by[i])) - (double(cy[i]) - double(by[i])) * (px - double(bx[i]));
+					const double e2 = (double(ax[i]) - double(cx[i])) * (py - double(cy[i])) - (double(ay[i]) - double(cy[i])) * (px - double(cx[i]));
+
+					const double area = (double(bx[i]) - double(ax[i])) * (double(cy[i]) - double(ay[i])) - (double(cx[i]) - double(ax[i])) * (double(by[i]) - double(ay[i]));
+
+					const uint8_t ccw = uint8_t(e0 >= 0.0) & uint8_t(e1 >= 0.0) & uint8_t(e2 >= 0.0);
+					const uint8_t cw = uint8_t(e0 <= 0.0) & uint8_t(e1 <= 0.0) & uint8_t(e2 <= 0.0);
+
+					// Degenerate triangles contain nothing
+					results[i] = (ccw | cw) & uint8_t(area != 0.0);
+				}
+			}, 16384);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const rect<T2>& r)
+	{
+		const double vx[3] = { double(t.a.x), double(t.b.x), double(t.c.x) };
+		const double vy[3] = { double(t.a.y), double(t.b.y), double(t.c.y) };
+
+		const double left = double(r.pos.x), right = double(r.pos.x) + double(r.size.x);
+		const double top = double(r.pos.y), bottom = double(r.pos.y) + double(r.size.y);
+
+		// Degenerate triangles intersect nothing, the same as they contain nothing
+		if (t.degenerate())
+			return false;
+
+		// Separating axes are the axes of the rectangle and normals of the edges
+		if (std::max({ vx[0], vx[1], vx[2] }) < left || std::min({ vx[0], vx[1], vx[2] }) > right)
+			return false;
+
+		if (std::max({ vy[0], vy[1], vy[2] }) < top || std::min({ vy[0], vy[1], vy[2] }) > bottom)
+			return false;
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			const uint32_t j = i == 2 ? 0 : i + 1;
+			const uint32_t k = j == 2 ? 0 : j + 1;
+
+			const double nx = vy[i] - vy[j], ny = vx[j] - vx[i];
+
+			const double edge = nx * vx[i] + ny * vy[i];
+			const double opposite = nx * vx[k] + ny * vy[k];
+
+			const double a = nx * left + ny * top, b = nx * right + ny * top;
+			const double c = nx * left + ny * bottom, d = nx * right + ny * bottom;
+
+			if (opposite >= edge ? std::max({ a, b, c, d }) < edge : std::min({ a, b, c, d }) > edge)
+				return false;
+		}
+
+		return true;
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const rect<T1>& r, const triangle<T2>& t)
+	{
+		return intersects(t, r);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const circle<T2>& c)
+	{
+		// Degenerate triangles intersect nothing, otherwise a circle touching one would intersect it
+		if (t.degenerate())
+			return false;
+
+		if (contains(t, c.pos))
+			return true;
+
+		const double sqr_radius = double(c.radius) * double(c.radius);
+		const line<T2> center(c.pos, c.pos);
+
+		double s, u;
+
+		for (uint32_t i = 0; i < triangle<T1>::SIDES; i++)
+		{
+			if (closest_points(t.side(i), center, s, u) <= sqr_radius)
+				return true;
+		}
+
+		return false;
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const circle<T1>& c, const triangle<T2>& t)
+	{
+		return intersects(t, c);
+	}
+
+	template <class T1, class T2>
+	constexpr bool intersects(const triangle<T1>& t, const line<T2>& l)
+	{
+		const double vx[3] = { double(t.a.x), double(t.b.x), double(t.c.x) };
+		const double vy[3] = { double(t.a.y), double(t.b.y), double(t.c.y) };
+
+		const double sx = double(l.start.x), sy = double(l.start.y);
+		const double ex = double(l.end.x), ey = double(l.end.y);
+
+		if (t.degenerate())
+			return false;
+
+		// Separating axes are the normal of l and normals of the edges
+		auto separated = [&](double nx, double ny)
+			{
+				const double a = nx * vx[0] + ny * vy[0], b = nx * vx[1] + ny * vy[1], c = nx * vx[2] + ny * vy[2];
+				const double s = nx * sx + ny * sy, e = nx * ex + ny * ey;
+
+				return std::max({ a, b, c }) < std::min(s, e) || std::max(s, e) < std::min({ a, b, c });
+			};
+
+		if (separated(sy - ey, ex - sx))
+			return false;
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			const uint32_t j = i == 2 ? 0 : i + 1;
+
+			if (separated(vy[i] - vy[j], vx[j] - vx[i]))
+				return false;
+		}
+
+		return true;
+	}
 
-	// Checks if p intersects r
 	template <class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, side* s = nullptr);
+	constexpr bool intersects(const line<T1>& l, const triangle<T2>& t)
+	{
+		return intersects(t, l);
+	}
+
+	template <class T>
+	void triangle_buffer<T>::clear()
+	{
+		ax.clear();
+		ay.clear();
+		bx.clear();
+		by.clear();
+		cx.clear();
+		cy.clear();
+	}
+
+	template <class T>
+	size_t triangle_buffer<T>::size() const
+	{
+		return ax.size();
+	}
+
+	template <class T>
+	void triangle_buffer<T>::push(const triangle<T>& t)
+	{
+		ax.push_back(t.a.x);
+		ay.push_back(t.a.y);
+		bx.push_back(t.b.x);
+		by.push_back(t.b.y);
+		cx.push_back(t.c.x);
+		cy.push_back(t.c.y);
+	}
+
+	template <class T>
+	triangle<T> triangle_buffer<T>::at(size_t i) const
+	{
+		return triangle<T>({ ax[i], ay[i] }, { bx[i], by[i] }, { cx[i], cy[i] });
+	}
+
+	template <class T>
+	constexpr affine<T>::affine(T a_, T b_, T c_, T d_, T tx_, T ty_)
+	{
+		a = a_;
+		b = b_;
+		c = c_;
+		d = d_;
+		tx = tx_;
+		ty = ty_;
+	}
+
+	template <class T>
+	constexpr affine<T> affine<T>::translation(const vec2d<T>& offset)
+	{
+		return affine(1, 0, 0, 1, offset.x, offset.y);
+	}
+
+	template <class T>
+	affine<T> affine<T>::rotation(double angle)
+	{
+		const T cos = static_cast<T>(std::cos(angle));
+		const T sin = static_cast<T>(std::sin(angle));
+
+		return affine(cos, sin, -sin, cos, 0, 0);
+	}
+
+	template <class T>
+	constexpr affine<T> affine<T>::scale(const vec2d<T>& factor)
+	{
+		return affine(factor.x, 0, 0, factor.y, 0, 0);
+	}
+
+	template <class T>
+	constexpr affine<T> affine<T>::shear(T factor)
+	{
+		return affine(1, 0, factor, 1, 0, 0);
+	}
+
+	template <class T>
+	constexpr affine<T> affine<T>::operator*(const affine& m) const
+	{
+		return affine(
+			a * m.a + c * m.b, b * m.a + d * m.b,
+			a * m.c + c * m.d, b * m.c + d * m.d,
+			a * m.tx + c * m.ty + tx, b * m.tx + d * m.ty + ty);
+	}
+
+	template <class T>
+	constexpr vec2d<T> affine<T>::apply(const vec2d<T>& p) const
+	{
+		return vec2d<T>(a * p.x + c * p.y + tx, b * p.x + d * p.y + ty);
+	}
+
+	template <class T>
+	constexpr vec2d<T> affine<T>::apply_vector(const vec2d<T>& v) const
+	{
+		return vec2d<T>(a * v.x + c * v.y, b * v.x + d * v.y);
+	}
+
+	template <class T>
+	constexpr T affine<T>::determinant() const
+	{
+		return a * d - b * c;
+	}
+
+	template <class T>
+	constexpr bool affine<T>::invert(affine& result) const
+	{
+		const T det = determinant();
+
+		if (det == 0)
+			return false;
+
+		const double inv = 1.0 / double(det);
+
+		const double ia = double(d) * inv, ib = -double(b) * inv;
+		const double ic = -double(c) * inv, id = double(a) * inv;
+
+		result = affine(
+			static_cast<T>(ia), static_cast<T>(ib),
+			static_cast<T>(ic), static_cast<T>(id),
+			static_cast<T>(-(ia * double(tx) + ic * double(ty))), static_cast<T>(-(ib * double(tx) + id * double(ty))));
+
+		return true;
+	}
+
+	template <class T>
+	bool affine<T>::decompose(vec2d<T>& offset, double& angle, T& skew, vec2d<T>& factor) const
+	{
+		// The first column is the rotated x scale, the second one is the rotated sheared y scale
+		const double sx = std::sqrt(double(a) * double(a) + double(b) * double(b));
+
+		if (sx == 0.0)
+			return false;
+
+		const double sy = double(determinant()) / sx;
+
+		if (sy == 0.0)
+			return false;
+
+		offset = vec2d<T>(tx, ty);
+		angle = std::atan2(double(b), double(a));
+		skew = static_cast<T>((double(a) * double(c) + double(b) * double(d)) / (sx * sy));
+		factor = vec2d<T>(static_cast<T>(sx), static_cast<T>(sy));
+
+		return true;
+	}
+
+	template <class T>
+	constexpr quadratic_bezier<T>::quadratic_bezier(const vec2d<T>& v0, const vec2d<T>& v1, const vec2d<T>& v2)
+	{
+		p0 = v0;
+		p1 = v1;
+		p2 = v2;
+	}
+
+	template <class T>
+	constexpr vec2d<T> quadratic_bezier<T>::point(double t) const
+	{
+		const double s = 1.0 - t;
+		const double a = s * s, b = 2.0 * s * t, c = t * t;
+
+		return vec2d<T>(
+			static_cast<T>(a * double(p0.x) + b * double(p1.x) + c * double(p2.x)),
+			static_cast<T>(a * double(p0.y) + b * double(p1.y) + c * double(p2.y)));
+	}
+
+	template <class T>
+	constexpr rect<T> quadratic_bezier<T>::bounds() const
+	{
+		const double c0[2] = { double(p0.x), double(p0.y) };
+		const double c1[2] = { double(p1.x), double(p1.y) };
+		const double c2[2] = { double(p2.x), double(p2.y) };
+
+		double min[2] = { std::min(c0[0], c2[0]), std::min(c0[1], c2[1]) };
+		double max[2] = { std::max(c0[0], c2[0]), std::max(c0[1], c2[1]) };
+
+		// The derivative is linear, so each axis has at most one extremum inside
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			const double denom = c0[i] - 2.0 * c1[i] + c2[i];
+
+			if (denom == 0.0)
+				continue;
+
+			const double t = (c0[i] - c1[i]) / denom;
+
+			if (t > 0.0 && t < 1.0)
+			{
+				const double s = 1.0 - t;
+				const double v = s * s * c0[i] + 2.0 * s * t * c1[i] + t * t * c2[i];
+
+				min[i] = std::min(min[i], v);
+				max[i] = std::max(max[i], v);
+			}
+		}
+
+		return rect<T>(vec2d<T>(static_cast<T>(min[0]), static_cast<T>(min[1])), vec2d<T>(static_cast<T>(max[0] - min[0]), static_cast<T>(max[1] - min[1])));
+	}
+
+	template <class T>
+	constexpr void quadratic_bezier<T>::split(double t, quadratic_bezier& left, quadratic_bezier& right) const
+	{
+		const vec2d<T> a = p0 + (p1 - p0) * t;
+		const vec2d<T> b = p1 + (p2 - p1) * t;
+		const vec2d<T> m = a + (b - a) * t;
+
+		left = quadratic_bezier(p0, a, m);
+		right = quadratic_bezier(m, b, p2);
+	}
 
-	// Checks if p intersects circle
-	template <class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const circle<T2>& c, std::vector<vec2d<T2>>& intersections);
+	template <class T>
+	uint32_t quadratic_bezier<T>::segments(double tolerance) const
+	{
+		const double dx = double(p0.x) - 2.0 * double(p1.x) + double(p2.x);
+		const double dy = double(p0.y) - 2.0 * double(p1.y) + double(p2.y);
 
-	// Checks if c intersects p
-	template <class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections);
+		// A chord over a parameter step h deviates by at most |p0 - 2 * p1 + p2| * h^2 / 4
+		const double n = std::ceil(std::sqrt(std::sqrt(dx * dx + dy * dy) / (4.0 * std::max(tolerance, 1e-12))));
 
-	// Checks if r intersects p
-	template <class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections, side* s = nullptr);
+		return uint32_t(std::clamp(n, 1.0, 65536.0));
+	}
 
-	// Checks if r1 intersects r2
-	template <class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r1, const rect<T2>& r2, std::vector<vec2d<T2>>& intersections, std::vector<side>* s = nullptr);
+	template <class T>
+	template <class F>
+	void quadratic_bezier<T>::flatten(double tolerance, F&& func) const
+	{
+		const uint32_t n = segments(tolerance);
 
-	// Checks if r intersects c
-	template <class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const circle<T2>& c, std::vector<vec2d<T2>>& intersections, std::vector<side>* s = nullptr);
+		const double h = 1.0 / n;
+		const double h2 = h * h;
 
-	// Checks if l1 intersects l2
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l1, const line<T2>& l2, std::vector<vec2d<T2>>& intersections);
+		// B(t) = a * t^2 + b * t + p0 stepped with forward differences
+		const double ax = double(p0.x) - 2.0 * double(p1.x) + double(p2.x);
+		const double ay = double(p0.y) - 2.0 * double(p1.y) + double(p2.y);
+		const double bx = 2.0 * (double(p1.x) - double(p0.x));
+		const double by = 2.0 * (double(p1.y) - double(p0.y));
 
-	// Checks if l intersects r
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, std::vector<side>* s = nullptr);
+		double x = double(p0.x), y = double(p0.y);
+		double dx = ax * h2 + bx * h, dy = ay * h2 + by * h;
 
-	// Checks if l intersects c
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const circle<T2>& c, std::vector<vec2d<T2>>& intersections);
+		const double ddx = 2.0 * ax * h2, ddy = 2.0 * ay * h2;
 
-	// Checks if r intersects l
-	template <class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const line<T2>& l, std::vector<vec2d<T2>>& intersections, std::vector<side>* s = nullptr);
+		func(p0);
 
-	// Checks if l intersects p
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections);
+		for (uint32_t i = 1; i < n; i++)
+		{
+			x += dx;
+			y += dy;
+			dx += ddx;
+			dy += ddy;
 
-	// Checks if c1 intersects c2
-	template <class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c1, const circle<T2>& c2, std::vector<vec2d<T2>>& intersections);
+			func(vec2d<T>(static_cast<T>(x), static_cast<T>(y)));
+		}
 
-	// Checks if c intersects l
-	template <class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const line<T2>& l, std::vector<vec2d<T2>>& intersections);
+		func(p2);
+	}
 
-	// Checks if c intersects r
-	template <class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, std::vector<side>* s = nullptr);
+	template <class T>
+	constexpr cubic_bezier<T>::cubic_bezier(const vec2d<T>& v0, const vec2d<T>& v1, const vec2d<T>& v2, const vec2d<T>& v3)
+	{
+		p0 = v0;
+		p1 = v1;
+		p2 = v2;
+		p3 = v3;
+	}
 
-#define DEF_GEOMETRY2D_IMPL
+	template <class T>
+	constexpr vec2d<T> cubic_bezier<T>::point(double t) const
+	{
+		const double s = 1.0 - t;
+		const double a = s * s * s, b = 3.0 * s * s * t, c = 3.0 * s * t * t, d = t * t * t;
 
-#ifdef DEF_GEOMETRY2D_IMPL
-#undef DEF_GEOMETRY2D_IMPL
+		return vec2d<T>(
+			static_cast<T>(a * double(p0.x) + b * double(p1.x) + c * double(p2.x) + d * double(p3.x)),
+			static_cast<T>(a * double(p0.y) + b * double(p1.y) + c * double(p2.y) + d * double(p3.y)));
+	}
 
 	template <class T>
-	constexpr vec2d<T>::vec2d(const T& x, const T& y) : x(x), y(y)
+	constexpr rect<T> cubic_bezier<T>::bounds() const
 	{
+		const double c0[2] = { double(p0.x), double(p0.y) };
+		const double c1[2] = { double(p1.x), double(p1.y) };
+		const double c2[2] = { double(p2.x), double(p2.y) };
+		const double c3[2] = { double(p3.x), double(p3.y) };
+
+		double min[2] = { std::min(c0[0], c3[0]), std::min(c0[1], c3[1]) };
+		double max[2] = { std::max(c0[0], c3[0]), std::max(c0[1], c3[1]) };
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			// Roots of the derivative a * t^2 + b * t + c are the extrema
+			const double a = -c0[i] + 3.0 * c1[i] - 3.0 * c2[i] + c3[i];
+			const double b = 2.0 * (c0[i] - 2.0 * c1[i] + c2[i]);
+			const double c = c1[i] - c0[i];
+
+			double roots[2] = {};
+			uint32_t count = 0;
+
+			if (std::abs(a) <= 1e-12 * (std::abs(b) + std::abs(c)))
+			{
+				if (b != 0.0)
+					roots[count++] = -c / b;
+			}
+			else
+			{
+				const double disc = b * b - 4.0 * a * c;
+
+				if (disc >= 0.0)
+				{
+					const double root = std::sqrt(disc);
+
+					roots[count++] = (-b + root) / (2.0 * a);
+					roots[count++] = (-b - root) / (2.0 * a);
+				}
+			}
+
+			for (uint32_t k = 0; k < count; k++)
+			{
+				const double t = roots[k];
+
+				if (t > 0.0 && t < 1.0)
+				{
+					const double s = 1.0 - t;
+					const double v = s * s * s * c0[i] + 3.0 * s * s * t * c1[i] + 3.0 * s * t * t * c2[i] + t * t * t * c3[i];
+
+					min[i] = std::min(min[i], v);
+					max[i] = std::max(max[i], v);
+				}
+			}
+		}
 
+		return rect<T>(vec2d<T>(static_cast<T>(min[0]), static_cast<T>(min[1])), vec2d<T>(static_cast<T>(max[0] - min[0]), static_cast<T>(max[1] - min[1])));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator+=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr void cubic_bezier<T>::split(double t, cubic_bezier& left, cubic_bezier& right) const
 	{
-		v1.x += v2.x;
-		v1.y += v2.y;
-		return v1;
+		const vec2d<T> a = p0 + (p1 - p0) * t;
+		const vec2d<T> b = p1 + (p2 - p1) * t;
+		const vec2d<T> c = p2 + (p3 - p2) * t;
+		const vec2d<T> ab = a + (b - a) * t;
+		const vec2d<T> bc = b + (c - b) * t;
+		const vec2d<T> m = ab + (bc - ab) * t;
+
+		left = cubic_bezier(p0, a, ab, m);
+		right = cubic_bezier(m, bc, c, p3);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator-=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	uint32_t cubic_bezier<T>::segments(double tolerance) const
 	{
-		v1.x -= v2.x;
-		v1.y -= v2.y;
-		return v1;
+		const double ax = double(p0.x) - 2.0 * double(p1.x) + double(p2.x), ay = double(p0.y) - 2.0 * double(p1.y) + double(p2.y);
+		const double bx = double(p1.x) - 2.0 * double(p2.x) + double(p3.x), by = double(p1.y) - 2.0 * double(p2.y) + double(p3.y);
+
+		// Wang's formula bounds the deviation of chords by the second differences of the control points
+		const double m = std::sqrt(std::max(ax * ax + ay * ay, bx * bx + by * by));
+		const double n = std::ceil(std::sqrt(0.75 * m / std::max(tolerance, 1e-12)));
+
+		return uint32_t(std::clamp(n, 1.0, 65536.0));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator*=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	template <class F>
+	void cubic_bezier<T>::flatten(double tolerance, F&& func) const
 	{
-		v1.x *= v2.x;
-		v1.y *= v2.y;
-		return v1;
+		const uint32_t n = segments(tolerance);
+
+		const double h = 1.0 / n;
+		const double h2 = h * h, h3 = h2 * h;
+
+		// B(t) = a * t^3 + b * t^2 + c * t + p0 stepped with forward differences
+		const double ax = -double(p0.x) + 3.0 * (double(p1.x) - double(p2.x)) + double(p3.x);
+		const double ay = -double(p0.y) + 3.0 * (double(p1.y) - double(p2.y)) + double(p3.y);
+		const double bx = 3.0 * (double(p0.x) - 2.0 * double(p1.x) + double(p2.x));
+		const double by = 3.0 * (double(p0.y) - 2.0 * double(p1.y) + double(p2.y));
+		const double cx = 3.0 * (double(p1.x) - double(p0.x));
+		const double cy = 3.0 * (double(p1.y) - double(p0.y));
+
+		double x = double(p0.x), y = double(p0.y);
+		double dx = ax * h3 + bx * h2 + cx * h, dy = ay * h3 + by * h2 + cy * h;
+		double ddx = 6.0 * ax * h3 + 2.0 * bx * h2, ddy = 6.0 * ay * h3 + 2.0 * by * h2;
+
+		const double dddx = 6.0 * ax * h3, dddy = 6.0 * ay * h3;
+
+		func(p0);
+
+		for (uint32_t i = 1; i < n; i++)
+		{
+			x += dx;
+			y += dy;
+			dx += ddx;
+			dy += ddy;
+			ddx += dddx;
+			ddy += dddy;
+
+			func(vec2d<T>(static_cast<T>(x), static_cast<T>(y)));
+		}
+
+		func(p3);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator/=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr arc<T>::arc(const vec2d<T>& c, float r, double start, double s)
 	{
-		v1.x /= v2.x;
-		v1.y /= v2.y;
-		return v1;
+		center = c;
+		radius = r;
+		start_angle = start;
+		sweep = s;
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator%=(vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr vec2d<T> arc<T>::point(double t) const
 	{
-		v1.x %= v2.x;
-		v1.y %= v2.y;
-		return v1;
+		const double angle = start_angle + sweep * t;
+
+		return vec2d<T>(
+			static_cast<T>(double(center.x) + double(radius) * std::cos(angle)),
+			static_cast<T>(double(center.y) + double(radius) * std::sin(angle)));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator+=(vec2d<T1>& v1, const T2& v2)
+	template <class T>
+	constexpr rect<T> arc<T>::bounds() const
 	{
-		v1.x += v2;
-		v1.y += v2;
-		return v1;
+		const double x = double(center.x), y = double(center.y), r = double(radius);
+
+		const double a0 = start_angle, a1 = start_angle + sweep;
+
+		double min_x = x + r * std::min(std::cos(a0), std::cos(a1)), max_x = x + r * std::max(std::cos(a0), std::cos(a1));
+		double min_y = y + r * std::min(std::sin(a0), std::sin(a1)), max_y = y + r * std::max(std::sin(a0), std::sin(a1));
+
+		// Each multiple of PI / 2 inside the sweep is an extreme point on one of the axes
+		for (double k = std::ceil(std::min(a0, a1) / (PI * 0.5)); k * PI * 0.5 <= std::max(a0, a1); k++)
+		{
+			switch ((int64_t(k) % 4 + 4) % 4)
+			{
+			case 0: max_x = x + r; break;
+			case 1: max_y = y + r; break;
+			case 2: min_x = x - r; break;
+			case 3: min_y = y - r; break;
+			}
+		}
+
+		return rect<T>(vec2d<T>(static_cast<T>(min_x), static_cast<T>(min_y)), vec2d<T>(static_cast<T>(max_x - min_x), static_cast<T>(max_y - min_y)));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator-=(vec2d<T1>& v1, const T2& v2)
+	template <class T>
+	constexpr void arc<T>::split(double t, arc& left, arc& right) const
 	{
-		v1.x -= v2;
-		v1.y -= v2;
-		return v1;
+		left = arc(center, radius, start_angle, sweep * t);
+		right = arc(center, radius, start_angle + sweep * t, sweep * (1.0 - t));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator*=(vec2d<T1>& v1, const T2& v2)
+	template <class T>
+	uint32_t arc<T>::segments(double tolerance) const
 	{
-		v1.x *= v2;
-		v1.y *= v2;
-		return v1;
+		const double r = double(radius);
+
+		if (r <= 0.0)
+			return 1;
+
+		// A chord of angle a deviates from the arc by r * (1 - cos(a / 2))
+		const double step = 2.0 * std::acos(1.0 - std::min(std::max(tolerance, 1e-12) / r, 1.0));
+		const double n = std::ceil(std::abs(sweep) / step);
+
+		return uint32_t(std::clamp(n, 1.0, 65536.0));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator/=(vec2d<T1>& v1, const T2& v2)
+	template <class T>
+	template <class F>
+	void arc<T>::flatten(double tolerance, F&& func) const
 	{
-		v1.x /= v2;
-		v1.y /= v2;
-		return v1;
+		const uint32_t n = segments(tolerance);
+
+		const double step = sweep / n;
+		const double c = std::cos(step), s = std::sin(step);
+
+		// The radius vector is turned by the step, so only the first point needs trigonometry
+		double x = double(radius) * std::cos(start_angle);
+		double y = double(radius) * std::sin(start_angle);
+
+		func(point(0.0));
+
+		for (uint32_t i = 1; i < n; i++)
+		{
+			const double turned = x * c - y * s;
+
+			y = x * s + y * c;
+			x = turned;
+
+			func(vec2d<T>(static_cast<T>(double(center.x) + x), static_cast<T>(double(center.y) + y)));
+		}
+
+		func(point(1.0));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<T1>& operator%=(vec2d<T1>& v1, const T2& v2)
+	template <class T, class A>
+	void flatten(const quadratic_bezier<T>& c, double tolerance, std::vector<vec2d<T>, A>& points)
 	{
-		v1.x %= v2;
-		v1.y %= v2;
-		return v1;
+		points.clear();
+		points.reserve(c.segments(tolerance) + 1);
+
+		c.flatten(tolerance, [&](const vec2d<T>& p) { points.push_back(p); });
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T, class A>
+	void flatten(const cubic_bezier<T>& c, double tolerance, std::vector<vec2d<T>, A>& points)
 	{
-		return vec2d(v1.x + v2.x, v1.y + v2.y);
+		points.clear();
+		points.reserve(c.segments(tolerance) + 1);
+
+		c.flatten(tolerance, [&](const vec2d<T>& p) { points.push_back(p); });
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T, class A>
+	void flatten(const arc<T>& a, double tolerance, std::vector<vec2d<T>, A>& points)
 	{
-		return vec2d(v1.x - v2.x, v1.y - v2.y);
+		points.clear();
+		points.reserve(a.segments(tolerance) + 1);
+
+		a.flatten(tolerance, [&](const vec2d<T>& p) { points.push_back(p); });
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T, class A>
+	void flatten(const quadratic_bezier<T>& c, double tolerance, std::vector<line<T>, A>& lines)
 	{
-		return vec2d(v1.x * v2.x, v1.y * v2.y);
+		lines.clear();
+		lines.reserve(c.segments(tolerance));
+
+		vec2d<T> last;
+		bool first = true;
+
+		c.flatten(tolerance, [&](const vec2d<T>& p)
+			{
+				if (!first)
+					lines.push_back(line<T>(last, p));
+
+				last = p;
+				first = false;
+			});
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T, class A>
+	void flatten(const cubic_bezier<T>& c, double tolerance, std::vector<line<T>, A>& lines)
 	{
-		return vec2d(v1.x / v2.x, v1.y / v2.y);
+		lines.clear();
+		lines.reserve(c.segments(tolerance));
+
+		vec2d<T> last;
+		bool first = true;
+
+		c.flatten(tolerance, [&](const vec2d<T>& p)
+			{
+				if (!first)
+					lines.push_back(line<T>(last, p));
+
+				last = p;
+				first = false;
+			});
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator%(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T, class A>
+	void flatten(const arc<T>& a, double tolerance, std::vector<line<T>, A>& lines)
 	{
-		return vec2d(v1.x % v2.x, v1.y % v2.y);
+		lines.clear();
+		lines.reserve(a.segments(tolerance));
+
+		vec2d<T> last;
+		bool first = true;
+
+		a.flatten(tolerance, [&](const vec2d<T>& p)
+			{
+				if (!first)
+					lines.push_back(line<T>(last, p));
+
+				last = p;
+				first = false;
+			});
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const vec2d<T1>& v1, const T2& v2)
+	template <class C, class V, class A>
+	void flatten(std::span<const C> curves, double tolerance, std::vector<V, A>& results)
 	{
-		return vec2d(v1.x + v2, v1.y + v2);
+		DEF_GEOMETRY2D_TRACE_SCOPE("flatten", "build");
+
+		results.resize(curves.size());
+
+		utils::parallel_for(curves.size(), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("flatten chunk", "build");
+
+				for (size_t i = begin; i < end; i++)
+					flatten(curves[i], tolerance, results[i]);
+			}, 64);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const vec2d<T1>& v1, const T2& v2)
+	template <class C1, class C2, class T, class A>
+	bool utils::intersect_curves(const C1& a, const C2& b, double tolerance, std::vector<vec2d<T>, A>& intersections)
 	{
-		return vec2d(v1.x - v2, v1.y - v2);
+		struct pair
+		{
+			C1 a;
+			C2 b;
+			uint32_t depth;
+		};
+
+		// Only the larger piece is split each time, so the stack never holds more than one pair per level,
+		// curves that overlap along a stretch would cross at ends of every piece there, so the number of steps is limited
+		constexpr uint32_t MAX_DEPTH = 96;
+
+		pair stack[MAX_DEPTH + 2];
+		uint32_t size = 0;
+
+		stack[size++] = { a, b, 0 };
+
+		for (uint32_t steps = 0; size > 0; steps++)
+		{
+			// Pieces are left on the stack, so the search is cut short
+			if (steps == CURVE_STEPS)
+				return false;
+
+			const pair top = stack[--size];
+
+			const rect<double> ra = top.a.bounds();
+			const rect<double> rb = top.b.bounds();
+
+			if (ra.pos.x > rb.pos.x + rb.size.x + tolerance || rb.pos.x > ra.pos.x + ra.size.x + tolerance ||
+				ra.pos.y > rb.pos.y + rb.size.y + tolerance || rb.pos.y > ra.pos.y + ra.size.y + tolerance)
+				continue;
+
+			// Pieces that a single chord approximates within tolerance are intersected as segments
+			if ((top.a.segments(tolerance) == 1 && top.b.segments(tolerance) == 1) || top.depth >= MAX_DEPTH)
+			{
+				const vec2d<double> p = top.a.point(0.0), p_end = top.a.point(1.0), r = p_end - p;
+				const vec2d<double> q = top.b.point(0.0), q_end = top.b.point(1.0), s = q_end - q;
+
+				vec2d<double> hit;
+				bool at_end = true;
+
+				// The longer chord is the axis the other one is measured against
+				const bool a_longer = r.mag2() >= s.mag2();
+
+				const vec2d<double> origin = a_longer ? p : q, axis = a_longer ? r : s;
+				const vec2d<double> other = a_longer ? q : p, other_end = a_longer ? q_end : p_end;
+
+				const double length = std::sqrt(axis.mag2());
+
+				const bool collinear = length == 0.0 ? (other - origin).mag2() <= tolerance * tolerance && (other_end - origin).mag2() <= tolerance * tolerance :
+					std::abs((other - origin).cross(axis)) <= tolerance * length && std::abs((other_end - origin).cross(axis)) <= tolerance * length;
+
+				if (collinear)
+				{
+					const double from = length == 0.0 ? 0.0 : (other - origin).dot(axis) / length;
+					const double to = length == 0.0 ? 0.0 : (other_end - origin).dot(axis) / length;
+
+					const double low = std::max(0.0, std::min(from, to)), high = std::min(length, std::max(from, to));
+
+					if (high - low > tolerance)
+						return false;
+
+					if (high - low < -tolerance)
+						continue;
+
+					// The chords only touch, the point is the end of a piece closest to where they touch, ends of a go first
+					const vec2d<double> touch = length == 0.0 ? origin : origin + axis * (std::clamp((low + high) * 0.5, 0.0, length) / length);
+
+					hit = (p - touch).mag2() <= (p_end - touch).mag2() ? p : p_end;
+
+					if ((hit - touch).mag2() > tolerance * tolerance)
+						hit = (q - touch).mag2() <= (q_end - touch).mag2() ? q : q_end;
+				}
+				else
+				{
+					const double denom = r.cross(s);
+
+					if (denom == 0.0)
+						continue;
+
+					const double t = (q - p).cross(s) / denom;
+					const double u = (q - p).cross(r) / denom;
+
+					constexpr double EPS = 1e-9;
+
+					if (t < -EPS || t > 1.0 + EPS || u < -EPS || u > 1.0 + EPS)
+						continue;
+
+					// Crossings at the ends of pieces snap to the ends, so the neighbouring piece that shares the end finds the same point
+					if (t <= EPS)
+						hit = p;
+					else if (t >= 1.0 - EPS)
+						hit = p_end;
+					else if (u <= EPS)
+						hit = q;
+					else if (u >= 1.0 - EPS)
+						hit = q_end;
+					else
+					{
+						hit = p + r * t;
+						at_end = false;
+					}
+				}
+
+				const vec2d<T> point(static_cast<T>(hit.x), static_cast<T>(hit.y));
+
+				// Only points at the ends of pieces are found twice and they are equal, so distinct crossings are never merged
+				if (!at_end || std::find(intersections.begin(), intersections.end(), point) == intersections.end())
+					intersections.push_back(point);
+
+				continue;
+			}
+
+			const double size_a = std::max(ra.size.x, ra.size.y);
+			const double size_b = std::max(rb.size.x, rb.size.y);
+
+			if (size_a >= size_b)
+			{
+				C1 left, right;
+				top.a.split(0.5, left, right);
+
+				stack[size++] = { right, top.b, top.depth + 1 };
+				stack[size++] = { left, top.b, top.depth + 1 };
+			}
+			else
+			{
+				C2 left, right;
+				top.b.split(0.5, left, right);
+
+				stack[size++] = { top.a, right, top.depth + 1 };
+				stack[size++] = { top.a, left, top.depth + 1 };
+			}
+		}
+
+		return true;
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const vec2d<T1>& v1, const T2& v2)
+	template <class S1, class S2, class T, class A> requires utils::curve_pair<S1, S2>
+	bool intersects(const S1& a, const S2& b, std::vector<vec2d<T>, A>& intersections, double tolerance, bool* complete)
 	{
-		return vec2d(v1.x * v2, v1.y * v2);
+		intersections.clear();
+
+		bool finished = true;
+
+		utils::for_each_curve(a, [&](const auto& ca)
+			{
+				utils::for_each_curve(b, [&](const auto& cb)
+					{
+						finished = utils::intersect_curves(ca, cb, tolerance, intersections) && finished;
+					});
+			});
+
+		if (complete)
+			*complete = finished;
+
+		return !intersections.empty();
+	}
+
+	template <class S, class F>
+	void utils::for_each_curve(const S& s, F&& func)
+	{
+		func(to_double(s));
+	}
+
+	template <class T, class F>
+	void utils::for_each_curve(const rect<T>& r, F&& func)
+	{
+		for (uint32_t i = 0; i < rect<T>::SIDES; i++)
+			func(to_double(r.side(i)));
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const vec2d<T1>& v1, const T2& v2)
+	template <class T>
+	constexpr quadratic_bezier<double> utils::to_double(const quadratic_bezier<T>& c)
 	{
-		return vec2d(v1.x / v2, v1.y / v2);
+		return quadratic_bezier<double>({ double(c.p0.x), double(c.p0.y) }, { double(c.p1.x), double(c.p1.y) }, { double(c.p2.x), double(c.p2.y) });
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator+(const T1& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr cubic_bezier<double> utils::to_double(const cubic_bezier<T>& c)
 	{
-		return vec2d(v1 + v2.x, v1 + v2.y);
+		return cubic_bezier<double>({ double(c.p0.x), double(c.p0.y) }, { double(c.p1.x), double(c.p1.y) }, { double(c.p2.x), double(c.p2.y) }, { double(c.p3.x), double(c.p3.y) });
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator-(const T1& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr arc<double> utils::to_double(const arc<T>& a)
 	{
-		return vec2d(v1 - v2.x, v1 - v2.y);
+		return arc<double>({ double(a.center.x), double(a.center.y) }, a.radius, a.start_angle, a.sweep);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator*(const T1& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr quadratic_bezier<double> utils::to_double(const line<T>& l)
 	{
-		return vec2d(v1 * v2.x, v1 * v2.y);
+		const vec2d<double> start(double(l.start.x), double(l.start.y));
+		const vec2d<double> end(double(l.end.x), double(l.end.y));
+
+		return quadratic_bezier<double>(start, (start + end) * 0.5, end);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator/(const T1& v1, const vec2d<T2>& v2)
+	template <class T>
+	void transform(const affine<T>& m, std::span<const vec2d<T>> points, std::span<vec2d<T>> out)
 	{
-		return vec2d(v1 / v2.x, v1 / v2.y);
+		DEF_GEOMETRY2D_TRACE_SCOPE("transform points", "query");
+
+		const T a = m.a, b = m.b, c = m.c, d = m.d, tx = m.tx, ty = m.ty;
+
+		utils::parallel_for(std::min(points.size(), out.size()), [&](size_t begin, size_t end)
+			{
+				const vec2d<T>* src = points.data();
+				vec2d<T>* dst = out.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const T x = src[i].x, y = src[i].y;
+
+					dst[i].x = a * x + c * y + tx;
+					dst[i].y = b * x + d * y + ty;
+				}
+			}, affine<T>::PARALLEL_THRESHOLD);
 	}
 
-	template <class T1, class T2>
-	constexpr vec2d<decltype(T1(1) + T2(1))> operator%(const T1& v1, const vec2d<T2>& v2)
+	template <class T>
+	void transform(const affine<T>& m, std::span<circle<T>> circles)
 	{
-		return vec2d(v1 % v2.x, v1 % v2.y);
+		DEF_GEOMETRY2D_TRACE_SCOPE("transform circles", "query");
+
+		const T a = m.a, b = m.b, c = m.c, d = m.d, tx = m.tx, ty = m.ty;
+		const float scale = float(std::sqrt(std::abs(double(m.determinant()))));
+
+		utils::parallel_for(circles.size(), [&](size_t begin, size_t end)
+			{
+				circle<T>* dst = circles.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const T x = dst[i].pos.x, y = dst[i].pos.y;
+
+					dst[i].pos.x = a * x + c * y + tx;
+					dst[i].pos.y = b * x + d * y + ty;
+					dst[i].radius *= scale;
+				}
+			}, affine<T>::PARALLEL_THRESHOLD);
 	}
 
 	template <class T>
-	constexpr vec2d<T> operator-(const vec2d<T>& v)
+	void transform(const affine<T>& m, std::span<rect<T>> rects)
 	{
-		return vec2d(-v.x, -v.y);
+		DEF_GEOMETRY2D_TRACE_SCOPE("transform rects", "query");
+
+		const T a = m.a, b = m.b, c = m.c, d = m.d, tx = m.tx, ty = m.ty;
+
+		// Bounds of the transformed corners are the transformed center plus the absolute linear part applied to the half size
+		const T abs_a = a < 0 ? -a : a, abs_b = b < 0 ? -b : b;
+		const T abs_c = c < 0 ? -c : c, abs_d = d < 0 ? -d : d;
+
+		utils::parallel_for(rects.size(), [&](size_t begin, size_t end)
+			{
+				rect<T>* dst = rects.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const T x = dst[i].pos.x, y = dst[i].pos.y;
+					const T w = dst[i].size.x, h = dst[i].size.y;
+
+					const T min_x = a * x + c * y + tx + std::min<T>(a * w, 0) + std::min<T>(c * h, 0);
+					const T min_y = b * x + d * y + ty + std::min<T>(b * w, 0) + std::min<T>(d * h, 0);
+
+					dst[i].pos.x = min_x;
+					dst[i].pos.y = min_y;
+					dst[i].size.x = abs_a * w + abs_c * h;
+					dst[i].size.y = abs_b * w + abs_d * h;
+				}
+			}, affine<T>::PARALLEL_THRESHOLD);
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator==(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	void transform(const affine<T>& m, std::span<line<T>> lines)
 	{
-		return v1.x == v2.x && v1.y == v2.y;
+		DEF_GEOMETRY2D_TRACE_SCOPE("transform lines", "query");
+
+		const T a = m.a, b = m.b, c = m.c, d = m.d, tx = m.tx, ty = m.ty;
+
+		utils::parallel_for(lines.size(), [&](size_t begin, size_t end)
+			{
+				line<T>* dst = lines.data();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					const T sx = dst[i].start.x, sy = dst[i].start.y;
+					const T ex = dst[i].end.x, ey = dst[i].end.y;
+
+					dst[i].start.x = a * sx + c * sy + tx;
+					dst[i].start.y = b * sx + d * sy + ty;
+					dst[i].end.x = a * ex + c * ey + tx;
+					dst[i].end.y = b * ex + d * ey + ty;
+				}
+			}, affine<T>::PARALLEL_THRESHOLD);
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator<=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	inline uint64_t utils::morton_encode(uint32_t x, uint32_t y)
 	{
-		return v1.x <= v2.x && v1.y <= v2.y;
+#if defined(__BMI2__) && (defined(__x86_64__) || defined(_M_X64))
+		return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xAAAAAAAAAAAAAAAAull);
+#else
+		auto spread = [](uint64_t v)
+			{
+				v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+				v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+				v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+				v = (v | (v << 2)) & 0x3333333333333333ull;
+				v = (v | (v << 1)) & 0x5555555555555555ull;
+				return v;
+			};
+
+		return spread(x) | (spread(y) << 1);
+#endif
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator>=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	inline void utils::morton_decode(uint64_t key, uint32_t& x, uint32_t& y)
 	{
-		return v1.x >= v2.x && v1.y >= v2.y;
+#if defined(__BMI2__) && (defined(__x86_64__) || defined(_M_X64))
+		x = (uint32_t)_pext_u64(key, 0x5555555555555555ull);
+		y = (uint32_t)_pext_u64(key, 0xAAAAAAAAAAAAAAAAull);
+#else
+		auto compact = [](uint64_t v)
+			{
+				v &= 0x5555555555555555ull;
+				v = (v | (v >> 1)) & 0x3333333333333333ull;
+				v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+				v = (v | (v >> 4)) & 0x00FF00FF00FF00FFull;
+				v = (v | (v >> 8)) & 0x0000FFFF0000FFFFull;
+				v = (v | (v >> 16)) & 0x00000000FFFFFFFFull;
+				return (uint32_t)v;
+			};
+
+		x = compact(key);
+		y = compact(key >> 1);
+#endif
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator<(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	inline uint64_t utils::hilbert_encode(uint32_t x, uint32_t y, uint32_t bits)
 	{
-		return v1.x < v2.x && v1.y < v2.y;
+		uint64_t key = 0;
+
+		// Each level picks a quadrant and turns the lower bits into its frame with masks instead of branches
+		for (uint32_t i = bits; i-- > 0;)
+		{
+			const uint32_t rx = (x >> i) & 1;
+			const uint32_t ry = (y >> i) & 1;
+
+			key |= uint64_t((3 * rx) ^ ry) << (2 * i);
+
+			const uint32_t low = uint32_t((uint64_t(1) << i) - 1);
+			const uint32_t swap = (ry - 1) & low;
+			const uint32_t flip = swap & (0u - rx);
+
+			x ^= flip;
+			y ^= flip;
+
+			const uint32_t t = (x ^ y) & swap;
+
+			x ^= t;
+			y ^= t;
+		}
+
+		return key;
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator>(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	inline void utils::hilbert_decode(uint64_t key, uint32_t bits, uint32_t& x, uint32_t& y)
 	{
-		return v1.x > v2.x && v1.y > v2.y;
+		x = 0;
+		y = 0;
+
+		for (uint32_t i = 0; i < bits; i++)
+		{
+			const uint32_t digit = uint32_t(key >> (2 * i)) & 3;
+			const uint32_t rx = digit >> 1;
+			const uint32_t ry = (digit ^ rx) & 1;
+
+			const uint32_t low = uint32_t((uint64_t(1) << i) - 1);
+			const uint32_t swap = (ry - 1) & low;
+			const uint32_t flip = swap & (0u - rx);
+
+			x ^= flip;
+			y ^= flip;
+
+			const uint32_t t = (x ^ y) & swap;
+
+			x ^= t;
+			y ^= t;
+
+			x |= rx << i;
+			y |= ry << i;
+		}
 	}
 
-	template <class T1, class T2>
-	constexpr bool operator!=(const vec2d<T1>& v1, const vec2d<T2>& v2)
+	template <class T>
+	constexpr vec2d<double> utils::key_point(const vec2d<T>& p)
 	{
-		return v1.x != v2.x || v1.y != v2.y;
+		return vec2d<double>(double(p.x), double(p.y));
 	}
 
 	template <class T>
-	constexpr vec2d<T> vec2d<T>::clamp(const vec2d& start, const vec2d& end) const
+	constexpr vec2d<double> utils::key_point(const circle<T>& c)
 	{
-		return { std::clamp(x, start.x, end.x), std::clamp(y, start.y, end.y) };
+		return vec2d<double>(double(c.pos.x), double(c.pos.y));
 	}
 
 	template <class T>
-	constexpr vec2d<T> vec2d<T>::lerp(const vec2d& v, const double t) const
+	constexpr vec2d<double> utils::key_point(const rect<T>& r)
 	{
-		return { (T)std::lerp(x, v.x, t), (T)std::lerp(y, v.y, t) };
+		return vec2d<double>(double(r.pos.x) + 0.5 * double(r.size.x), double(r.pos.y) + 0.5 * double(r.size.y));
 	}
 
 	template <class T>
-	constexpr auto vec2d<T>::dist(const vec2d<T>& v) const
+	constexpr vec2d<double> utils::key_point(const line<T>& l)
 	{
-		return (*this - v).length();
+		return vec2d<double>(0.5 * (double(l.start.x) + double(l.end.x)), 0.5 * (double(l.start.y) + double(l.end.y)));
 	}
 
 	template <class T>
-	constexpr auto vec2d<T>::dot(const vec2d& v) const
+	constexpr vec2d<double> utils::key_point(const capsule<T>& c)
 	{
-		return x * v.x + y * v.y;
+		return vec2d<double>(0.5 * (double(c.start.x) + double(c.end.x)), 0.5 * (double(c.start.y) + double(c.end.y)));
 	}
 
 	template <class T>
-	constexpr auto vec2d<T>::cross(const vec2d& v) const
+	constexpr vec2d<double> utils::key_point(const triangle<T>& t)
 	{
-		return x * v.y - y * v.x;
+		return vec2d<double>(
+			(double(t.a.x) + double(t.b.x) + double(t.c.x)) / 3.0,
+			(double(t.a.y) + double(t.b.y) + double(t.c.y)) / 3.0);
 	}
 
-	template<typename T>
-	constexpr auto vec2d<T>::angle(const vec2d& v) const
+	template <class T>
+	key_grid::key_grid(const rect<T>& bounds, uint32_t b)
 	{
-		return acos(dot(v) / (length() + v.length()));
+		bits = std::clamp<uint32_t>(b, 1, 32);
+		origin = vec2d<double>(double(bounds.pos.x), double(bounds.pos.y));
+
+		const double cells = std::ldexp(1.0, int(bits));
+
+		scale.x = bounds.size.x > 0 ? cells / double(bounds.size.x) : 1.0;
+		scale.y = bounds.size.y > 0 ? cells / double(bounds.size.y) : 1.0;
 	}
 
 	template <class T>
-	constexpr auto vec2d<T>::length() const
+	void key_grid::quantize(const vec2d<T>& p, uint32_t& x, uint32_t& y) const
 	{
-		return mag();
+		const double last = std::ldexp(1.0, int(bits)) - 1.0;
+
+		x = uint32_t(std::clamp((double(p.x) - origin.x) * scale.x, 0.0, last));
+		y = uint32_t(std::clamp((double(p.y) - origin.y) * scale.y, 0.0, last));
 	}
 
 	template <class T>
-	constexpr auto vec2d<T>::mag() const
+	uint64_t key_grid::key(const vec2d<T>& p, space_curve curve) const
 	{
-		return static_cast<T>(std::sqrt(x * x + y * y));
+		uint32_t x, y;
+		quantize(p, x, y);
+
+		return curve == CURVE_HILBERT ? utils::hilbert_encode(x, y, bits) : utils::morton_encode(x, y);
 	}
 
-	template <class T>
-	constexpr auto vec2d<T>::mag2() const
+	inline vec2d<double> key_grid::point(uint64_t key, space_curve curve) const
 	{
-		return static_cast<T>(x * x + y * y);
+		uint32_t x, y;
+
+		if (curve == CURVE_HILBERT)
+			utils::hilbert_decode(key, bits, x, y);
+		else
+			utils::morton_decode(key, x, y);
+
+		return vec2d<double>(origin.x + (double(x) + 0.5) / scale.x, origin.y + (double(y) + 0.5) / scale.y);
 	}
 
-	template <class T>
-	constexpr auto vec2d<T>::man(const vec2d& v) const
+	inline void key_sorter::sort(std::span<const uint64_t> input, std::vector<uint32_t>& order)
 	{
-		return std::abs(x - v.x) + std::abs(y - v.y);
+		DEF_GEOMETRY2D_TRACE_SCOPE("sort keys", "build");
+
+		const size_t count = input.size();
+
+		keys.assign(input.begin(), input.end());
+		keys_swap.resize(count);
+		order_swap.resize(count);
+
+		order.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+			order[i] = uint32_t(i);
+
+		if (count < 2)
+			return;
+
+		// Digits where all keys agree don't change the order
+		uint64_t any = 0, all = ~uint64_t(0);
+
+		for (uint64_t k : keys)
+		{
+			any |= k;
+			all &= k;
+		}
+
+		const uint64_t varying = any ^ all;
+
+		const size_t chunks = std::clamp<size_t>(count / PARALLEL_THRESHOLD, 1, utils::concurrency());
+		const size_t chunk_size = (count + chunks - 1) / chunks;
+
+		histograms.resize(chunks);
+
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			if (((varying >> shift) & 0xFF) == 0)
+				continue;
+
+			auto count_chunks = [&](size_t first, size_t last)
+				{
+					DEF_GEOMETRY2D_TRACE_SCOPE("sort keys count", "build");
+
+					for (size_t c = first; c < last; c++)
+					{
+						size_t* counts = histograms[c].counts;
+						std::fill(counts, counts + 256, 0);
+
+						const size_t end = std::min(count, (c + 1) * chunk_size);
+
+						for (size_t i = c * chunk_size; i < end; i++)
+							counts[(keys[i] >> shift) & 0xFF]++;
+					}
+				};
+
+			auto scatter_chunks = [&](size_t first, size_t last)
+				{
+					DEF_GEOMETRY2D_TRACE_SCOPE("sort keys scatter", "build");
+
+					for (size_t c = first; c < last; c++)
+					{
+						size_t* offsets = histograms[c].counts;
+
+						const size_t end = std::min(count, (c + 1) * chunk_size);
+
+						for (size_t i = c * chunk_size; i < end; i++)
+						{
+							const size_t to = offsets[(keys[i] >> shift) & 0xFF]++;
+
+							keys_swap[to] = keys[i];
+							order_swap[to] = order[i];
+						}
+					}
+				};
+
+			if (chunks == 1)
+				count_chunks(0, 1);
+			else
+				utils::parallel_for(chunks, count_chunks);
+
+			// Turning counts into offsets digit by digit and chunk by chunk keeps equal digits in their order
+			size_t offset = 0;
+
+			for (size_t d = 0; d < 256; d++)
+			{
+				for (size_t c = 0; c < chunks; c++)
+				{
+					const size_t current = histograms[c].counts[d];
+					histograms[c].counts[d] = offset;
+					offset += current;
+				}
+			}
+
+			if (chunks == 1)
+				scatter_chunks(0, 1);
+			else
+				utils::parallel_for(chunks, scatter_chunks);
+
+			keys.swap(keys_swap);
+			order.swap(order_swap);
+		}
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::max(const vec2d& v) const
+	inline void packed_rtree::build(std::span<const rect<double>> bounds)
 	{
-		return vec2d(std::max(x, v.x), std::max(y, v.y));
+		DEF_GEOMETRY2D_TRACE_SCOPE("build rtree", "build");
+
+		nodes.clear();
+		levels.assign(1, 0);
+		items.clear();
+
+		if (bounds.empty())
+		{
+			levels.push_back(0);
+			return;
+		}
+
+		vec2d<double> lo = bounds[0].pos, hi = lo;
+
+		for (const auto& b : bounds)
+		{
+			lo = lo.min(b.pos);
+			hi = hi.max(b.pos + b.size);
+		}
+
+		const key_grid grid(rect<double>(lo, hi - lo));
+
+		keys.resize(bounds.size());
+
+		for (size_t i = 0; i < bounds.size(); i++)
+			keys[i] = grid.key(bounds[i].pos + bounds[i].size * 0.5, CURVE_HILBERT);
+
+		sorter.sort(keys, items);
+
+		for (uint32_t i : items)
+			nodes.push_back(bounds[i]);
+
+		// Each level bounds runs of NODE_SIZE nodes of the level below until a single root is left
+		for (uint32_t begin = 0, end = uint32_t(nodes.size()); end - begin > 1; begin = end, end = uint32_t(nodes.size()))
+		{
+			levels.push_back(end);
+
+			for (uint32_t first = begin; first < end; first += NODE_SIZE)
+			{
+				const uint32_t last = std::min(end, first + NODE_SIZE);
+
+				vec2d<double> a = nodes[first].pos, b = a;
+
+				for (uint32_t i = first; i < last; i++)
+				{
+					a = a.min(nodes[i].pos);
+					b = b.max(nodes[i].pos + nodes[i].size);
+				}
+
+				nodes.push_back(rect<double>(a, b - a));
+			}
+		}
+
+		levels.push_back(uint32_t(nodes.size()));
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::min(const vec2d& v) const
+	inline void packed_rtree::children(uint32_t node, uint32_t& first, uint32_t& last) const
 	{
-		return vec2d(std::min(x, v.x), std::min(y, v.y));
+		// levels[l] <= node < levels[l + 1], there are only a few levels
+		size_t l = 1;
+
+		while (levels[l + 1] <= node)
+			l++;
+
+		first = levels[l - 1] + (node - levels[l]) * NODE_SIZE;
+		last = std::min(levels[l], first + NODE_SIZE);
 	}
 
-	template <class T>
-	constexpr void vec2d<T>::swap(vec2d& v)
+	inline double packed_rtree::distance(const rect<double>& r, const vec2d<double>& p)
 	{
-		std::swap(x, v.x);
-		std::swap(y, v.y);
+		const double dx = std::max({ r.pos.x - p.x, 0.0, p.x - r.pos.x - r.size.x });
+		const double dy = std::max({ r.pos.y - p.y, 0.0, p.y - r.pos.y - r.size.y });
+
+		return std::sqrt(dx * dx + dy * dy);
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::norm() const
+	template <class F>
+	void packed_rtree::query(const rect<double>& r, F&& func)
 	{
-		auto n = (T)1 / mag();
-		return vec2d(x * n, y * n);
+		if (nodes.empty())
+			return;
+
+		const double x0 = r.pos.x, y0 = r.pos.y;
+		const double x1 = x0 + r.size.x, y1 = y0 + r.size.y;
+
+		const uint32_t leaves = levels[1];
+
+		stack.clear();
+		stack.push_back(uint32_t(nodes.size() - 1));
+
+		while (!stack.empty())
+		{
+			const uint32_t node = stack.back();
+			stack.pop_back();
+
+			const rect<double>& b = nodes[node];
+
+			if (b.pos.x > x1 || b.pos.y > y1 || b.pos.x + b.size.x < x0 || b.pos.y + b.size.y < y0)
+				continue;
+
+			if (node < leaves)
+			{
+				func(items[node]);
+				continue;
+			}
+
+			uint32_t first, last;
+			children(node, first, last);
+
+			for (uint32_t c = first; c < last; c++)
+				stack.push_back(c);
+		}
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::abs() const
+	template <class F>
+	void packed_rtree::nearest(const vec2d<double>& p, F&& func)
 	{
-		return vec2d(std::abs(x), std::abs(y));
+		if (nodes.empty())
+			return;
+
+		// Min-heap of nodes by the distance to their bounds
+		auto farther = [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) { return a > b; };
+
+		const uint32_t leaves = levels[1];
+		const uint32_t root = uint32_t(nodes.size() - 1);
+
+		queue.clear();
+		queue.push_back({ distance(nodes[root], p), root });
+
+		while (!queue.empty())
+		{
+			std::pop_heap(queue.begin(), queue.end(), farther);
+			const auto [d, node] = queue.back();
+			queue.pop_back();
+
+			if (node < leaves)
+			{
+				if (!func(items[node], d))
+					return;
+
+				continue;
+			}
+
+			uint32_t first, last;
+			children(node, first, last);
+
+			for (uint32_t c = first; c < last; c++)
+			{
+				queue.push_back({ distance(nodes[c], p), c });
+				std::push_heap(queue.begin(), queue.end(), farther);
+			}
+		}
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::perp() const
+	template <class S>
+	void spatial_keys(const key_grid& grid, std::span<const S> shapes, space_curve curve, std::span<uint64_t> keys)
 	{
-		return vec2d(-y, x);
+		DEF_GEOMETRY2D_TRACE_SCOPE("spatial keys", "build");
+
+		utils::parallel_for(std::min(shapes.size(), keys.size()), [&](size_t begin, size_t end)
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("spatial keys chunk", "build");
+
+				for (size_t i = begin; i < end; i++)
+					keys[i] = grid.key(utils::key_point(shapes[i]), curve);
+			}, 16384);
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::floor() const
+	template <class S>
+	void spatial_sort(std::span<S> shapes, const key_grid& grid, space_curve curve, key_sorter& sorter)
 	{
-		return vec2d(std::floor(x), std::floor(y));
+		DEF_GEOMETRY2D_TRACE_SCOPE("spatial sort", "build");
+
+		std::vector<uint64_t> keys(shapes.size());
+		spatial_keys(grid, std::span<const S>(shapes), curve, std::span<uint64_t>(keys));
+
+		std::vector<uint32_t> order;
+		sorter.sort(keys, order);
+
+		std::vector<S> sorted;
+		sorted.reserve(shapes.size());
+
+		for (uint32_t i : order)
+			sorted.push_back(std::move(shapes[i]));
+
+		std::move(sorted.begin(), sorted.end(), shapes.begin());
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::ceil() const
+	template <class S>
+	void spatial_sort(std::span<S> shapes, space_curve curve)
 	{
-		return vec2d(std::ceil(x), std::ceil(y));
+		if (shapes.empty())
+			return;
+
+		vec2d<double> lo = utils::key_point(shapes[0]), hi = lo;
+
+		for (const S& s : shapes)
+		{
+			const vec2d<double> p = utils::key_point(s);
+
+			lo.x = std::min(lo.x, p.x);
+			lo.y = std::min(lo.y, p.y);
+			hi.x = std::max(hi.x, p.x);
+			hi.y = std::max(hi.y, p.y);
+		}
+
+		key_sorter sorter;
+		spatial_sort(shapes, key_grid(rect<double>(lo, hi - lo)), curve, sorter);
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::round() const
+	template <class M, class T>
+	void norm(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out)
 	{
-		return vec2d(std::round(x), std::round(y));
+		DEF_GEOMETRY2D_TRACE_SCOPE("norm", "query");
+
+		using P = std::conditional_t<std::is_void_v<M>, math_policy_t<T>, M>;
+
+		utils::parallel_for(std::min(vectors.size(), out.size()), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					out[i] = vectors[i].template norm<P>();
+			}, 1 << 15);
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::cart() const
+	template <class M, class T>
+	void polar(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out)
 	{
-		return vec2d(cos(y) * x, sin(y) * x);
+		DEF_GEOMETRY2D_TRACE_SCOPE("polar", "query");
+
+		using P = std::conditional_t<std::is_void_v<M>, math_policy_t<T>, M>;
+
+		utils::parallel_for(std::min(vectors.size(), out.size()), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					out[i] = vectors[i].template polar<P>();
+			}, 1 << 15);
 	}
 
-	template <class T>
-	constexpr vec2d<T> vec2d<T>::polar() const
+	template <class M, class T>
+	void cart(std::span<const vec2d<T>> vectors, std::span<vec2d<T>> out)
 	{
-		return vec2d(mag(), atan2(y, x));
+		DEF_GEOMETRY2D_TRACE_SCOPE("cart", "query");
+
+		using P = std::conditional_t<std::is_void_v<M>, math_policy_t<T>, M>;
+
+		utils::parallel_for(std::min(vectors.size(), out.size()), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					out[i] = vectors[i].template cart<P>();
+			}, 1 << 15);
 	}
 
+#if defined(DEF_GEOMETRY2D_SHARDING) && defined(__linux__)
 	template <class T>
-	std::string vec2d<T>::str() const
+	shard_service<T>::~shard_service()
 	{
-		return "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
+		stop();
 	}
 
-	template <class T1, class T2>
-	constexpr auto utils::equal(T1 lhs, T2 rhs)
+	template <class T>
+	double shard_service<T>::distance(const shape& s, const vec2d<T>& p)
 	{
-		return abs(lhs - rhs) <= EPSILON;
+		if (auto c = std::get_if<circle<T>>(&s))
+		{
+			const double dx = double(p.x) - double(c->pos.x);
+			const double dy = double(p.y) - double(c->pos.y);
+
+			return std::max(std::sqrt(dx * dx + dy * dy) - double(c->radius), 0.0);
+		}
+
+		if (auto rc = std::get_if<rect<T>>(&s))
+		{
+			const double dx = std::max({ double(rc->pos.x) - double(p.x), 0.0, double(p.x) - double(rc->pos.x) - double(rc->size.x) });
+			const double dy = std::max({ double(rc->pos.y) - double(p.y), 0.0, double(p.y) - double(rc->pos.y) - double(rc->size.y) });
+
+			return std::sqrt(dx * dx + dy * dy);
+		}
+
+		return std::sqrt(sqr_distance(std::get<line<T>>(s), rect<T>(p, vec2d<T>(0, 0))));
 	}
 
 	template <class T>
-	constexpr rect<T>::rect(const vec2d<T>& p, const vec2d<T>& s)
+	void shard_service<T>::shard::build(std::vector<entry>&& shapes, const rect<T>& tile)
 	{
-		pos = p;
-		size = s;
+		DEF_GEOMETRY2D_TRACE_SCOPE("build shard", "build");
+
+		const key_grid grid(tile);
+
+		std::vector<uint64_t> keys(shapes.size());
+
+		for (size_t i = 0; i < shapes.size(); i++)
+			keys[i] = std::visit([&](const auto& s) { return grid.key(utils::key_point(s), CURVE_HILBERT); }, shapes[i].value);
+
+		std::vector<uint32_t> order;
+		key_sorter sorter;
+		sorter.sort(keys, order);
+
+		entries.clear();
+		entries.reserve(shapes.size());
+
+		for (uint32_t i : order)
+			entries.push_back(std::move(shapes[i]));
+
+		blocks.clear();
+
+		for (size_t begin = 0; begin < entries.size(); begin += BLOCK_SIZE)
+		{
+			const size_t end = std::min(entries.size(), begin + BLOCK_SIZE);
+
+			vec2d<double> lo = shape_store<T>::bounds(entries[begin].value).pos, hi = lo;
+
+			for (size_t i = begin; i < end; i++)
+			{
+				const rect<double> b = shape_store<T>::bounds(entries[i].value);
+
+				lo = lo.min(b.pos);
+				hi = hi.max(b.pos + b.size);
+			}
+
+			blocks.push_back(rect<double>(lo, hi - lo));
+		}
+
+		index.build(blocks);
 	}
 
 	template <class T>
-	constexpr T rect<T>::area() const
+	void shard_service<T>::shard::query(const rect<T>& r, std::vector<hit>& out)
 	{
-		return size.x * size.y;
+		const rect<double> area(vec2d<double>(double(r.pos.x), double(r.pos.y)), vec2d<double>(double(r.size.x), double(r.size.y)));
+
+		index.query(area, [&](uint32_t b)
+			{
+				const size_t end = std::min(entries.size(), (b + 1) * BLOCK_SIZE);
+
+				for (size_t i = b * BLOCK_SIZE; i < end; i++)
+				{
+					if (shape_store<T>::overlaps(entries[i].value, r))
+						out.push_back({ entries[i].id, 0.0 });
+				}
+			});
 	}
 
 	template <class T>
-	constexpr T rect<T>::perimeter() const
+	void shard_service<T>::shard::nearest(const vec2d<T>& p, uint32_t k, std::vector<hit>& out)
 	{
-		return 2 * (size.x + size.y);
+		if (k == 0)
+			return;
+
+		// Max-heap of the best hits so far, the worst one is on top
+		auto farther = [](const hit& a, const hit& b) { return a.distance < b.distance || (a.distance == b.distance && a.id < b.id); };
+
+		heap.clear();
+
+		index.nearest(vec2d<double>(double(p.x), double(p.y)), [&](uint32_t b, double bound)
+			{
+				if (heap.size() == k && bound > heap.front().distance)
+					return false;
+
+				const size_t end = std::min(entries.size(), (b + 1) * BLOCK_SIZE);
+
+				for (size_t i = b * BLOCK_SIZE; i < end; i++)
+				{
+					const hit h{ entries[i].id, distance(entries[i].value, p) };
+
+					if (heap.size() < k)
+					{
+						heap.push_back(h);
+						std::push_heap(heap.begin(), heap.end(), farther);
+					}
+					else if (farther(h, heap.front()))
+					{
+						std::pop_heap(heap.begin(), heap.end(), farther);
+						heap.back() = h;
+						std::push_heap(heap.begin(), heap.end(), farther);
+					}
+				}
+
+				return true;
+			});
+
+		std::sort_heap(heap.begin(), heap.end(), farther);
+		out.insert(out.end(), heap.begin(), heap.end());
 	}
 
 	template <class T>
-	constexpr line<T> rect<T>::left() const
+	bool shard_service<T>::write_all(int socket, const void* data, size_t size)
 	{
-		return { pos, { pos.x, pos.y + size.y } };
+		const char* bytes = static_cast<const char*>(data);
+
+		while (size > 0)
+		{
+			// MSG_NOSIGNAL turns a dead peer into an error instead of SIGPIPE
+			const ssize_t n = ::send(socket, bytes, size, MSG_NOSIGNAL);
+
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			if (n <= 0)
+				return false;
+
+			bytes += n;
+			size -= size_t(n);
+		}
+
+		return true;
 	}
 
 	template <class T>
-	constexpr line<T> rect<T>::top() const
+	bool shard_service<T>::read_all(int socket, void* data, size_t size)
 	{
-		return { pos, { pos.x + size.x, pos.y } };
+		char* bytes = static_cast<char*>(data);
+
+		while (size > 0)
+		{
+			const ssize_t n = ::recv(socket, bytes, size, 0);
+
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			if (n <= 0)
+				return false;
+
+			bytes += n;
+			size -= size_t(n);
+		}
+
+		return true;
 	}
 
 	template <class T>
-	constexpr line<T> rect<T>::right() const
+	void shard_service<T>::serve(int socket, shard& s)
 	{
-		return { { pos.x + size.x, pos.y }, bottom_right() };
+		std::vector<double> coords;
+		std::vector<uint32_t> counts;
+		std::vector<hit> hits;
+
+		std::vector<uint32_t> ids;
+		std::vector<double> distances;
+
+		request_header header;
+
+		while (read_all(socket, &header, sizeof(header)) && header.op != OP_STOP)
+		{
+			coords.resize(size_t(header.count) * 4);
+
+			if (!read_all(socket, coords.data(), coords.size() * sizeof(double)))
+				break;
+
+			counts.resize(size_t(header.count));
+			hits.clear();
+
+			for (size_t i = 0; i < header.count; i++)
+			{
+				const rect<T> r(vec2d<T>(T(coords[4 * i]), T(coords[4 * i + 1])), vec2d<T>(T(coords[4 * i + 2]), T(coords[4 * i + 3])));
+				const size_t before = hits.size();
+
+				if (header.op == OP_QUERY)
+					s.query(r, hits);
+				else
+					s.nearest(r.pos, header.k, hits);
+
+				counts[i] = uint32_t(hits.size() - before);
+			}
+
+			const uint64_t total = hits.size();
+
+			ids.resize(hits.size());
+			distances.resize(hits.size());
+
+			for (size_t i = 0; i < hits.size(); i++)
+			{
+				ids[i] = hits[i].id;
+				distances[i] = hits[i].distance;
+			}
+
+			if (!write_all(socket, &total, sizeof(total)) ||
+				!write_all(socket, counts.data(), counts.size() * sizeof(uint32_t)) ||
+				!write_all(socket, ids.data(), ids.size() * sizeof(uint32_t)) ||
+				!write_all(socket, distances.data(), distances.size() * sizeof(double)))
+				break;
+		}
 	}
 
 	template <class T>
-	constexpr line<T> rect<T>::bottom() const
+	bool shard_service<T>::start(const rect<T>& w, uint32_t c, uint32_t r, std::span<const entry> entries)
 	{
-		return { { pos.x, pos.y + size.y }, bottom_right() };
-	}
+		DEF_GEOMETRY2D_TRACE_SCOPE("start shards", "build");
 
-	template<class T>
-	constexpr vec2d<T> rect<T>::top_left() const
-	{
-		return pos;
-	}
+		stop();
 
-	template<class T>
-	constexpr vec2d<T> rect<T>::top_right() const
-	{
-		return { pos.x + size.x, pos.y };
-	}
+		world = rect<double>(vec2d<double>(double(w.pos.x), double(w.pos.y)), vec2d<double>(double(w.size.x), double(w.size.y)));
+		columns = std::max(c, 1u);
+		rows = std::max(r, 1u);
 
-	template<class T>
-	constexpr vec2d<T> rect<T>::bottom_left() const
-	{
-		return { pos.x, pos.y + size.y };;
-	}
+		const uint32_t tiles = columns * rows;
 
-	template<class T>
-	constexpr vec2d<T> rect<T>::bottom_right() const
-	{
-		return pos + size;
-	}
+		std::vector<std::vector<entry>> lists(tiles);
 
-	template<class T>
-	constexpr line<T> rect<T>::side(uint32_t i) const
-	{
-		switch (i)
+		for (const entry& e : entries)
 		{
-		case SIDE_LEFT: return left();
-		case SIDE_TOP: return top();
-		case SIDE_RIGHT: return right();
-		case SIDE_BOTTOM: return bottom();
+			uint32_t x0, y0, x1, y1;
+			tile_range(shape_store<T>::bounds(e.value), x0, y0, x1, y1);
+
+			for (uint32_t y = y0; y <= y1; y++)
+				for (uint32_t x = x0; x <= x1; x++)
+					lists[y * columns + x].push_back(e);
 		}
 
-		return {};
+		for (uint32_t t = 0; t < tiles; t++)
+		{
+			int sockets[2];
+
+			if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+			{
+				stop();
+				return false;
+			}
+
+			const pid_t pid = ::fork();
+
+			if (pid < 0)
+			{
+				::close(sockets[0]);
+				::close(sockets[1]);
+
+				stop();
+				return false;
+			}
+
+			if (pid == 0)
+			{
+				::close(sockets[0]);
+
+				// Sockets of earlier workers and shapes of other tiles were copied by fork but are not needed here
+				for (const worker& other : workers)
+					::close(other.socket);
+
+				std::vector<entry> own = std::move(lists[t]);
+				std::vector<std::vector<entry>>().swap(lists);
+
+				const double tw = world.size.x / columns, th = world.size.y / rows;
+				const rect<T> tile(
+					vec2d<T>(T(world.pos.x + tw * (t % columns)), T(world.pos.y + th * (t / columns))),
+					vec2d<T>(T(tw), T(th)));
+
+				shard s;
+				s.build(std::move(own), tile);
+
+				serve(sockets[1], s);
+
+				::close(sockets[1]);
+				::_exit(0);
+			}
+
+			::close(sockets[1]);
+			workers.push_back({ pid, sockets[0] });
+
+			std::vector<entry>().swap(lists[t]);
+		}
+
+		return true;
 	}
 
 	template <class T>
-	constexpr circle<T>::circle(const vec2d<T>& p, float r)
+	void shard_service<T>::stop()
 	{
-		pos = p;
-		radius = r;
+		const request_header header;
+
+		for (const worker& w : workers)
+			write_all(w.socket, &header, sizeof(header));
+
+		close_workers();
 	}
 
 	template <class T>
-	constexpr T circle<T>::area() const
+	void shard_service<T>::close_workers()
 	{
-		return PI * double(radius * radius);
+		// A worker blocked on sending a reply gets an error once its peer is closed
+		for (const worker& w : workers)
+			::close(w.socket);
+
+		for (const worker& w : workers)
+			::waitpid(w.pid, nullptr, 0);
+
+		workers.clear();
 	}
 
 	template <class T>
-	constexpr T circle<T>::circumference() const
+	void shard_service<T>::tile_range(const rect<double>& b, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) const
 	{
-		return 2.0 * PI * (double)radius;
+		auto cell = [](double v, double origin, double size, uint32_t count)
+			{
+				const double f = size > 0.0 ? std::floor((v - origin) / size * count) : 0.0;
+				return uint32_t(std::clamp(f, 0.0, double(count - 1)));
+			};
+
+		x0 = cell(b.pos.x, world.pos.x, world.size.x, columns);
+		y0 = cell(b.pos.y, world.pos.y, world.size.y, rows);
+		x1 = cell(b.pos.x + b.size.x, world.pos.x, world.size.x, columns);
+		y1 = cell(b.pos.y + b.size.y, world.pos.y, world.size.y, rows);
 	}
 
 	template <class T>
-	constexpr line<T>::line(const vec2d<T>& s, const vec2d<T>& e)
+	double shard_service<T>::tile_distance(const vec2d<T>& p, uint32_t tile) const
 	{
-		start = s;
-		end = e;
+		const uint32_t tx = tile % columns, ty = tile / columns;
+
+		const double tw = world.size.x / columns, th = world.size.y / rows;
+		const double inf = std::numeric_limits<double>::infinity();
+
+		const double x0 = tx == 0 ? -inf : world.pos.x + tw * tx;
+		const double y0 = ty == 0 ? -inf : world.pos.y + th * ty;
+		const double x1 = tx + 1 == columns ? inf : world.pos.x + tw * (tx + 1);
+		const double y1 = ty + 1 == rows ? inf : world.pos.y + th * (ty + 1);
+
+		const double dx = std::max({ x0 - double(p.x), 0.0, double(p.x) - x1 });
+		const double dy = std::max({ y0 - double(p.y), 0.0, double(p.y) - y1 });
+
+		return std::sqrt(dx * dx + dy * dy);
 	}
 
 	template <class T>
-	constexpr vec2d<T> line<T>::vector() const
+	bool shard_service<T>::dispatch(op_code op, uint32_t k, std::span<const rect<T>> queries, const std::vector<std::vector<uint32_t>>& routes, std::vector<std::vector<hit>>& hits)
 	{
-		return end - start;
-	}
+		DEF_GEOMETRY2D_TRACE_SCOPE("dispatch shards", "query");
 
-	template <class T1, class T2>
-	constexpr bool contains(const vec2d<T1>& p1, const vec2d<T2>& p2)
-	{
-		return utils::equal(p1.x, p2.x) && utils::equal(p1.y, p2.y);
-	}
+		// All requests go out before any reply is read so workers run at the same time
+		for (size_t w = 0; w < workers.size(); w++)
+		{
+			if (routes[w].empty())
+				continue;
 
-	template <class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const vec2d<T2>& p)
-	{
-		auto sqr_radius = c.radius * c.radius;
-		auto sqr_dist = (c.pos - p).mag2();
+			const request_header header{ op, k, routes[w].size() };
+
+			send_buffer.clear();
+
+			for (uint32_t q : routes[w])
+			{
+				const rect<T>& r = queries[q];
+				send_buffer.insert(send_buffer.end(), { double(r.pos.x), double(r.pos.y), double(r.size.x), double(r.size.y) });
+			}
+
+			if (!write_all(workers[w].socket, &header, sizeof(header)) ||
+				!write_all(workers[w].socket, send_buffer.data(), send_buffer.size() * sizeof(double)))
+			{
+				close_workers();
+				return false;
+			}
+		}
+
+		for (size_t w = 0; w < workers.size(); w++)
+		{
+			if (routes[w].empty())
+				continue;
+
+			uint64_t total;
+			hit_counts.resize(routes[w].size());
+
+			bool received = read_all(workers[w].socket, &total, sizeof(total)) &&
+				read_all(workers[w].socket, hit_counts.data(), hit_counts.size() * sizeof(uint32_t));
+
+			if (received)
+			{
+				reply_ids.resize(size_t(total));
+				reply_distances.resize(size_t(total));
+
+				received = read_all(workers[w].socket, reply_ids.data(), reply_ids.size() * sizeof(uint32_t)) &&
+					read_all(workers[w].socket, reply_distances.data(), reply_distances.size() * sizeof(double));
+			}
+
+			if (!received)
+			{
+				close_workers();
+				return false;
+			}
+
+			size_t offset = 0;
+
+			for (size_t i = 0; i < routes[w].size(); i++)
+			{
+				auto& out = hits[routes[w][i]];
+
+				for (size_t j = offset; j < offset + hit_counts[i]; j++)
+					out.push_back({ reply_ids[j], reply_distances[j] });
+
+				offset += hit_counts[i];
+			}
+		}
 
-		return sqr_dist < sqr_radius || utils::equal(sqr_dist, sqr_radius);
+		return true;
 	}
 
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const vec2d<T2>& p)
+	template <class T>
+	bool shard_service<T>::query(std::span<const vec2d<T>> points, std::vector<std::vector<uint32_t>>& results)
 	{
-		return p >= r.pos && p <= r.bottom_right();
+		std::vector<rect<T>> rects;
+		rects.reserve(points.size());
+
+		for (const auto& p : points)
+			rects.push_back(rect<T>(p, vec2d<T>(0, 0)));
+
+		return query(std::span<const rect<T>>(rects), results);
 	}
 
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r1, const rect<T2>& r2)
+	template <class T>
+	bool shard_service<T>::query(std::span<const rect<T>> rects, std::vector<std::vector<uint32_t>>& results)
 	{
-		return r1.pos <= r2.pos && r1.bottom_right() >= r2.bottom_right();
+		DEF_GEOMETRY2D_TRACE_SCOPE("query shards", "query");
+
+		// Not started or closed after a failure
+		if (workers.empty())
+			return false;
+
+		std::vector<std::vector<uint32_t>> routes(workers.size());
+
+		for (size_t q = 0; q < rects.size(); q++)
+		{
+			const rect<T>& r = rects[q];
+
+			uint32_t x0, y0, x1, y1;
+			tile_range(rect<double>(vec2d<double>(double(r.pos.x), double(r.pos.y)), vec2d<double>(double(r.size.x), double(r.size.y))), x0, y0, x1, y1);
+
+			for (uint32_t y = y0; y <= y1; y++)
+				for (uint32_t x = x0; x <= x1; x++)
+					routes[y * columns + x].push_back(uint32_t(q));
+		}
+
+		std::vector<std::vector<hit>> hits(rects.size());
+
+		if (!dispatch(OP_QUERY, 0, rects, routes, hits))
+			return false;
+
+		results.resize(rects.size());
+
+		// A shape copied to several tiles is found by each of them
+		for (size_t q = 0; q < rects.size(); q++)
+		{
+			auto& ids = results[q];
+			ids.clear();
+
+			for (const hit& h : hits[q])
+				ids.push_back(h.id);
+
+			std::sort(ids.begin(), ids.end());
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		}
+
+		return true;
 	}
 
-	template <class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const line<T2>& l)
+#ifdef DEF_GEOMETRY2D_COROUTINES
+	template <class T>
+	async_task<bool> shard_service<T>::query_async(std::span<const vec2d<T>> points, std::vector<std::vector<uint32_t>>& results, async_scheduler scheduler)
 	{
-		return l.start >= r.pos && l.end >= r.pos && l.start <= r.bottom_right() && l.end <= r.bottom_right();
+		return async_task<bool>([this, points, &results]() { return query(points, results); }, std::move(scheduler));
 	}
 
-	template<class T1, class T2>
-	constexpr bool contains(const rect<T1>& r, const circle<T2>& c)
+	template <class T>
+	async_task<bool> shard_service<T>::query_async(std::span<const rect<T>> rects, std::vector<std::vector<uint32_t>>& results, async_scheduler scheduler)
 	{
-		rect<T2> rect_circle(c.pos - c.radius, vec2d<T2>(c.radius * 2));
-		return contains(r, rect_circle);
+		return async_task<bool>([this, rects, &results]() { return query(rects, results); }, std::move(scheduler));
 	}
 
-	template <class T1, class T2>
-	constexpr bool contains(const line<T1>& l1, const line<T2>& l2)
+	template <class T>
+	async_task<bool> shard_service<T>::nearest_async(std::span<const vec2d<T>> points, uint32_t k, std::vector<std::vector<hit>>& results, async_scheduler scheduler)
 	{
-		return (contains(l1.start, l2.start) && contains(l1.end, l2.end)) || (contains(l1.start, l2.end) && contains(l1.end, l2.start));
+		return async_task<bool>([this, points, k, &results]() { return nearest(points, k, results); }, std::move(scheduler));
 	}
+#endif
 
-	template<class T1, class T2>
-	constexpr bool contains(const line<T1>& l, const vec2d<T2>& p)
+	template <class T>
+	bool shard_service<T>::nearest(std::span<const vec2d<T>> points, uint32_t k, std::vector<std::vector<hit>>& results)
 	{
-		vec2d<T1> vec = l.vector();
+		DEF_GEOMETRY2D_TRACE_SCOPE("nearest shards", "query");
 
-		auto dp = vec.dot(p - l.start) / vec.mag2();
+		// Not started or closed after a failure
+		if (workers.empty())
+			return false;
 
-		if (dp < 0 || dp > 1)
+		std::vector<rect<T>> queries;
+		queries.reserve(points.size());
+
+		std::vector<uint32_t> home(points.size());
+		std::vector<std::vector<uint32_t>> routes(workers.size());
+
+		for (size_t q = 0; q < points.size(); q++)
+		{
+			const vec2d<T>& p = points[q];
+			queries.push_back(rect<T>(p, vec2d<T>(0, 0)));
+
+			uint32_t x0, y0, x1, y1;
+			tile_range(rect<double>(vec2d<double>(double(p.x), double(p.y)), vec2d<double>(0.0, 0.0)), x0, y0, x1, y1);
+
+			home[q] = y0 * columns + x0;
+			routes[home[q]].push_back(uint32_t(q));
+		}
+
+		std::vector<std::vector<hit>> hits(points.size());
+
+		if (!dispatch(OP_NEAREST, k, queries, routes, hits))
 			return false;
 
-		vec2d<T2> proj = l.start.lerp(l.end, dp);
+		// The k-th hit of the home tile bounds the distance to tiles that can still have closer shapes
+		for (auto& route : routes)
+			route.clear();
 
-		// We need to find a proper epsilon value
-		return p.dist(proj) < EPSILON;
+		for (size_t q = 0; q < points.size(); q++)
+		{
+			const double radius = hits[q].size() < k ? std::numeric_limits<double>::infinity() : hits[q].back().distance;
+
+			for (uint32_t t = 0; t < workers.size(); t++)
+			{
+				if (t != home[q] && tile_distance(points[q], t) <= radius)
+					routes[t].push_back(uint32_t(q));
+			}
+		}
+
+		if (!dispatch(OP_NEAREST, k, queries, routes, hits))
+			return false;
+
+		results.resize(points.size());
+
+		for (size_t q = 0; q < points.size(); q++)
+		{
+			auto& out = results[q];
+			out = std::move(hits[q]);
+
+			std::sort(out.begin(), out.end(), [](const hit& a, const hit& b) { return a.distance < b.distance || (a.distance == b.distance && a.id < b.id); });
+			out.erase(std::unique(out.begin(), out.end(), [](const hit& a, const hit& b) { return a.id == b.id; }), out.end());
+
+			if (out.size() > k)
+				out.resize(k);
+		}
+
+		return true;
 	}
+#endif
 
-	template<class T1, class T2>
-	constexpr bool contains(const circle<T1>& c1, const circle<T2>& c2)
+#ifdef DEF_GEOMETRY2D_COROUTINES
+	template <class R>
+	async_task<R>::async_task(utils::unique_function<R> j, async_scheduler s) : job(std::move(j)), scheduler(std::move(s))
 	{
-		return c1.radius >= c1.pos.dist(c2.pos) + c2.radius;
+
 	}
 
-	template<class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const line<T2>& l)
+	template <class R>
+	bool async_task<R>::await_ready() const noexcept
 	{
-		return contains(c, l.start) && contains(c, l.end);
+		return false;
 	}
 
-	template<class T1, class T2>
-	constexpr bool contains(const circle<T1>& c, const rect<T2>& r)
+	template <class R>
+	void async_task<R>::await_suspend(std::coroutine_handle<> awaiting)
 	{
-		auto radius2 = c.radius * c.radius;
-
-		auto check_dist = [&](const vec2d<T2>& edge)
+		// The task lives in the frame of the suspended coroutine only until it is resumed, so the pool job owns the job
+		// and the scheduler and touches the task just to publish the result
+		utils::thread_pool::shared().submit([this, awaiting, job = std::move(job), scheduler = std::move(scheduler)]() mutable
 			{
-				const auto diff = edge - c.pos;
-				return diff.dot(diff) <= radius2;
-			};
+				try
+				{
+					if constexpr (std::is_void_v<R>)
+					{
+						job();
+						result.emplace();
+					}
+					else
+						result.emplace(job());
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
 
-		return check_dist(r.pos) && check_dist(r.top_right()) && check_dist(r.bottom_left()) && check_dist(r.bottom_right());
+				if (scheduler)
+					scheduler(awaiting);
+				else
+					awaiting.resume();
+			});
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p1, const vec2d<T2>& p2, std::vector<vec2d<T2>>& intersections)
+	template <class R>
+	R async_task<R>::await_resume()
 	{
-		if (contains(p1, p2))
-		{
-			intersections.push_back(p2);
-			return true;
-		}
+		if (error)
+			std::rethrow_exception(error);
 
-		return false;
+		if constexpr (!std::is_void_v<R>)
+			return std::move(*result);
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const line<T2>& l, std::vector<vec2d<T2>>& intersections)
+	template <class V>
+	bool async_stream<V>::state::enter()
 	{
-		return intersects(l, p, intersections);
-	}
+		std::lock_guard guard(lock);
 
-	template<class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, side* s)
-	{
-		return intersects(r, p, intersections, s);
+		active++;
+		return !cancelled && !error;
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const vec2d<T1>& p, const circle<T2>& c, std::vector<vec2d<T2>>& intersections)
+	template <class V>
+	void async_stream<V>::state::leave(std::exception_ptr e)
 	{
-		return intersects(c, p, intersections);
-	}
+		std::vector<utils::unique_function<void>> dropped;
+		std::unique_lock guard(lock);
 
-	template<class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections)
-	{
-		if (utils::equal((c.pos - p).mag2(), c.radius * c.radius))
+		active--;
+		idle.notify_all();
+
+		// Parked jobs won't be resumed after a failure, so they end here
+		if (e && !error)
 		{
-			intersections.push_back(p);
-			return true;
+			error = e;
+			producers -= parked.size();
+			dropped.swap(parked);
 		}
 
-		return false;
+		retire(guard);
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections, side* s)
+	template <class V>
+	void async_stream<V>::state::park(utils::unique_function<void> job)
 	{
-		for (uint8_t i = 0; i < r.SIDES; i++)
 		{
-			if (contains(r.side(i), p))
+			std::unique_lock guard(lock);
+
+			active--;
+			idle.notify_all();
+
+			if (cancelled)
+				return;
+
+			if (error)
 			{
-				if (s) *s = i;
-				intersections.push_back(p);
-				return true;
+				retire(guard);
+				return;
+			}
+
+			// The consumer may have taken values since the job saw the stream full
+			if (values.size() >= capacity)
+			{
+				parked.push_back(std::move(job));
+				return;
 			}
 		}
 
-		return false;
+		utils::thread_pool::shared().submit(std::move(job));
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r1, const rect<T2>& r2, std::vector<vec2d<T2>>& intersections, std::vector<side>* s)
+	template <class V>
+	bool async_stream<V>::state::push(V value)
 	{
-		intersections.clear();
-
-		for (uint8_t i = 0; i < r1.SIDES; i++)
-		{
-			line<T1> side = r1.side(i);
-			bool intersected = false;
-
-			for (uint8_t j = 0; j < r2.SIDES; j++)
-			{
-				std::vector<vec2d<T2>> points;
-				intersects(side, r2.side(j), points);
+		std::unique_lock guard(lock);
 
-				if (!points.empty())
-				{
-					intersections.push_back(points[0]);
-					intersected = true;
-				}
-			}
+		if (cancelled || error)
+			return false;
 
-			if (intersected)
-				if (s) s->push_back(def::side(i));
-		}
+		values.push_back(std::move(value));
+		wake(guard);
 
-		return !intersections.empty();
+		return !cancelled && !error;
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const circle<T2>& c, std::vector<vec2d<T2>>& intersections, std::vector<side>* s)
+	template <class V>
+	bool async_stream<V>::state::full()
 	{
-		return intersects(c, r, intersections, s);
+		std::lock_guard guard(lock);
+		return values.size() >= capacity;
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const line<T1>& l1, const line<T2>& l2, std::vector<vec2d<T2>>& intersections)
+	template <class V>
+	void async_stream<V>::state::wake(std::unique_lock<std::mutex>& guard)
 	{
-		// l1: a1 * x + b1 * y = -c1
-		// l2: a2 * x + b2 * y = -c2
-
-		const auto a1 = l1.start.y - l1.end.y;
-		const auto b1 = l1.end.x - l1.start.x;
-
-		const auto a2 = l2.start.y - l2.end.y;
-		const auto b2 = l2.end.x - l2.start.x;
+		if (!waiting)
+			return;
 
-		const auto det = a1 * b2 - b1 * a2;
+		std::coroutine_handle<> h = std::exchange(waiting, {});
+		const std::thread::id self = std::this_thread::get_id();
 
-		if (det == 0)
-		{
-			// Determinant is 0 so the lines are collinear
+		// A scheduler may run the consumer right away as well
+		resuming = self;
+		guard.unlock();
 
-			// one line is inside another line so there are infinite
-			// number of solutions or no solutions at all
-			return contains(l2, l1.start) || contains(l1, l2.start);
-		}
+		if (scheduler)
+			scheduler(h);
+		else
+			h.resume();
 
-		const auto c1 = l1.start.x * l1.end.y - l1.end.x * l1.start.y;
-		const auto c2 = l2.start.x * l2.end.y - l2.end.x * l2.start.y;
+		guard.lock();
 
-		const vec2d<T2> point = { (b1 * c2 - b2 * c1) / det, (a2 * c1 - a1 * c2) / det };
+		// The consumer may have suspended again and been resumed by a job on another thread
+		if (resuming == self)
+			resuming = {};
+	}
 
-		if (contains(l1, point) && contains(l2, point))
-		{
-			intersections.resize(1);
-			intersections[0] = point;
-			return true;
-		}
+	template <class V>
+	void async_stream<V>::state::retire(std::unique_lock<std::mutex>& guard)
+	{
+		if (--producers > 0 || cancelled)
+			return;
 
-		return false;
+		done = true;
+		wake(guard);
 	}
 
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, std::vector<side>* s)
+	template <class V>
+	bool async_stream<V>::next_awaiter::await_ready() const noexcept
 	{
-		return intersects(r, l, intersections, s);
+		return false;
 	}
 
-	template <class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const circle<T2>& c, std::vector<vec2d<T2>>& intersections)
+	template <class V>
+	bool async_stream<V>::next_awaiter::await_suspend(std::coroutine_handle<> awaiting)
 	{
-		return intersects(c, l, intersections);
+		std::lock_guard guard(s->lock);
+
+		if (!s->values.empty() || s->done)
+			return false;
+
+		s->waiting = awaiting;
+		return true;
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const rect<T1>& r, const line<T2>& l, std::vector<vec2d<T2>>& intersections, std::vector<side>* s)
+	template <class V>
+	std::optional<V> async_stream<V>::next_awaiter::await_resume()
 	{
-		intersections.clear();
+		std::optional<V> value;
+		utils::unique_function<void> job;
 
-		for (uint8_t i = 0; i < r.SIDES; i++)
 		{
-			std::vector<vec2d<T1>> points;
-			intersects(l, r.side(i), points);
+			std::lock_guard guard(s->lock);
 
-			if (!points.empty())
+			if (!s->values.empty())
 			{
-				if (s) s->push_back(i);
-				intersections.push_back(points[0]);
+				value.emplace(std::move(s->values.front()));
+				s->values.pop_front();
 			}
-		}
-
-		return !intersections.empty();
-	}
+			else if (s->error)
+				std::rethrow_exception(s->error);
 
-	template<class T1, class T2>
-	constexpr bool intersects(const line<T1>& l, const vec2d<T2>& p, std::vector<vec2d<T2>>& intersections)
-	{
-		if (contains(l, p))
-		{
-			intersections.push_back(p);
-			return true;
+			if (!s->parked.empty() && s->values.size() < s->capacity)
+			{
+				job = std::move(s->parked.back());
+				s->parked.pop_back();
+			}
 		}
 
-		return false;
+		if (job)
+			utils::thread_pool::shared().submit(std::move(job));
+
+		return value;
 	}
 
-	template<class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c1, const circle<T2>& c2, std::vector<vec2d<T2>>& intersections)
+	template <class V>
+	async_stream<V>::~async_stream()
 	{
-		intersections.clear();
-
-		const auto sqr_r1 = c1.radius * c1.radius;
-		const auto sqr_r2 = c2.radius * c2.radius;
+		if (!shared)
+			return;
 
-		const auto dist = c1.pos.dist(c2.pos);
-		const auto adj = (sqr_r1 - sqr_r2 + dist * dist) / (2 * dist);
-		const auto sqr_hyp = sqr_r1 - adj * adj;
+		std::vector<utils::unique_function<void>> dropped;
+		std::unique_lock guard(shared->lock);
 
-		if (sqr_hyp < 0)
-			return false;
+		shared->cancelled = true;
+		dropped.swap(shared->parked);
 
-		const auto hyp = sqrt(sqr_hyp);
+		// Running jobs stop at their next push and queued ones don't read the spans, so only running jobs are waited for,
+		// except the one this consumer was resumed from, which is below on this stack and stops once the consumer suspends
+		shared->idle.wait(guard, [&]()
+			{
+				return shared->active <= (shared->resuming == std::this_thread::get_id() ? 1u : 0u);
+			});
+	}
 
-		vec2d<T2> p = (c2.pos - c1.pos) * (adj / dist) + c1.pos;
-		vec2d<T2> inter1, inter2;
+	template <class V>
+	typename async_stream<V>::next_awaiter async_stream<V>::next()
+	{
+		return next_awaiter{ shared.get() };
+	}
 
-		inter1.x = p.x + hyp * (c2.pos.y - c1.pos.y) / dist;
-		inter1.y = p.y - hyp * (c2.pos.x - c1.pos.x) / dist;
+	template <class F>
+	async_task<std::invoke_result_t<F&>> run_async(F func, async_scheduler scheduler)
+	{
+		return async_task<std::invoke_result_t<F&>>(std::move(func), std::move(scheduler));
+	}
 
-		inter2.x = p.x - hyp * (c2.pos.y - c1.pos.y) / dist;
-		inter2.y = p.y + hyp * (c2.pos.x - c1.pos.x) / dist;
+	template <template <class> class S1, template <class> class S2, class T1, class T2>
+	async_stream<intersection_hit<T2>> intersections_async(std::span<const S1<T1>> a, std::span<const S2<T2>> b, size_t capacity, async_scheduler scheduler)
+	{
+		using state_type = typename async_stream<intersection_hit<T2>>::state;
 
-		intersections.push_back(inter1);
+		async_stream<intersection_hit<T2>> stream;
 
-		if (!utils::equal(inter1, inter2))
-			intersections.push_back(inter2);
+		stream.shared = std::make_shared<state_type>();
+		stream.shared->capacity = std::max<size_t>(capacity, 1);
+		stream.shared->scheduler = std::move(scheduler);
 
-		return true;
-	}
+		// A chunk of rows of a, it remembers the pair and the hit it stopped at when the stream got full
+		struct producer
+		{
+			void operator()()
+			{
+				DEF_GEOMETRY2D_TRACE_SCOPE("intersections async chunk", "query");
 
-	template<class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const line<T2>& l, std::vector<vec2d<T2>>& intersections)
-	{
-		intersections.clear();
+				std::exception_ptr error;
 
-		const auto dist = l.dist(c.pos);
+				if (s->enter())
+				{
+					try
+					{
+						if (produce())
+							return;
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+				}
 
-		if (utils::equal(dist, c.radius))
-		{
-			// No intersection at all
-			return false;
-		}
+				s->leave(error);
+			}
 
-		// Compute point closest to the circle on the line
-		const auto d = l.vector();
-		const auto uLine = d.dot(c.pos - l.start) / d.mag2();
-		const auto closestPointToLine = l.start + uLine * d;
-		const auto distToLine = (c.pos - closestPointToLine).mag2();
+			// Pushes hits of the remaining pairs, returns true once the job parked itself, it must not be touched then
+			bool produce()
+			{
+				for (; i < end; i++, j = 0)
+				{
+					for (; j < b.size(); j++, next = 0)
+					{
+						if (next == 0)
+						{
+							points.clear();
+
+							if (!intersects(a[i], b[j], points))
+								continue;
+						}
+
+						while (next < points.size())
+						{
+							if (!s->push({ uint32_t(i), uint32_t(j), points[next++] }))
+								return false;
+
+							if (s->full())
+							{
+								std::shared_ptr<state_type> keep = s;
+								keep->park(std::move(*this));
+								return true;
+							}
+						}
+					}
+				}
 
-		if (utils::equal(distToLine, c.radius * c.radius))
-		{
-			// Only one intersection point
-			intersections.push_back(closestPointToLine);
-			return true;
-		}
+				return false;
+			}
 
-		// Circle intersects the line
-		const auto length = sqrt(c.radius * c.radius - distToLine);
-		const auto p1 = closestPointToLine + d.norm() * length;
-		const auto p2 = closestPointToLine - d.norm() * length;
+			std::shared_ptr<state_type> s;
+			std::span<const S1<T1>> a;
+			std::span<const S2<T2>> b;
 
-		if (contains(l, p1)) intersections.push_back(p1);
-		if (contains(l, p2)) intersections.push_back(p2);
+			size_t i = 0, end = 0, j = 0, next = 0;
+			std::vector<vec2d<T2>> points;
+		};
 
-		return !intersections.empty();
-	}
+		DEF_GEOMETRY2D_TRACE_SCOPE("intersections async", "query");
 
-	template<class T1, class T2>
-	constexpr bool intersects(const circle<T1>& c, const rect<T2>& r, std::vector<vec2d<T2>>& intersections, std::vector<side>* s)
-	{
-		intersections.clear();
+		const size_t grain = std::max<size_t>(1, 4096 / std::max<size_t>(b.size(), 1));
+		const size_t chunk = std::max(grain, (a.size() + utils::concurrency() - 1) / utils::concurrency());
 
-		for (uint8_t i = 0; i < r.SIDES; i++)
-		{
-			for (const auto& p : intersects(c, r.side(i)))
-			{
-				if (s) s->push_back(i);
-				intersections.push_back(p);
-			}
-		}
+		stream.shared->producers = (a.size() + chunk - 1) / chunk;
 
-		return !intersections.empty();
-	}
+		if (stream.shared->producers == 0)
+			stream.shared->done = true;
 
-	template<class T>
-	template<class T1>
-	constexpr T line<T>::dist(const vec2d<T1>& v) const
-	{
-		auto a = end.y - start.y;
-		auto b = start.x - end.x;
+		for (size_t begin = 0; begin < a.size(); begin += chunk)
+		{
+			producer job;
 
-		if (a == 0 && b == 0)
-			return v.dist(start);
+			job.s = stream.shared;
+			job.a = a;
+			job.b = b;
+			job.i = begin;
+			job.end = std::min(a.size(), begin + chunk);
 
-		auto c = end.x * start.y - start.x * end.y;
+			utils::thread_pool::shared().submit(std::move(job));
+		}
 
-		return abs(a * v.x + b * v.y + c) / sqrt(a * a + b * b);
+		return stream;
 	}
+#endif
 
 #endif
 }